@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <string.h>
+#include "barrel.h"
+
+// Policy named on the command line, -1 if unknown
+int barrelParsePolicy(const char *name) {
+  if (strcmp(name, "rr") == 0)
+    return BARREL_ROUND_ROBIN;
+  if (strcmp(name, "miss") == 0)
+    return BARREL_SWITCH_ON_MISS;
+  return -1;
+}
+
+int barrelSetUp(Barrel *b, int threads, int policy) {
+  if (threads < 1 || threads > BARREL_MAX_THREADS) {
+    fprintf(stderr, "Error - 1 to %d hardware threads\n", BARREL_MAX_THREADS);
+    return -1;
+  }
+  if (policy != BARREL_ROUND_ROBIN && policy != BARREL_SWITCH_ON_MISS) {
+    fprintf(stderr, "Error - unknown thread selection policy %d\n", policy);
+    return -1;
+  }
+  memset(b, 0, sizeof(*b));
+  b->threads = threads;
+  b->policy = policy;
+  return 0;
+}
+
+// Start every thread from the boot register state, with its id and stack
+void barrelReset(Barrel *b, const regfile_t *boot) {
+  memset(b->exited, 0, sizeof(b->exited));
+  memset(b->thread, 0, sizeof(b->thread));
+  memset(&b->pregs, 0, sizeof(b->pregs));
+  memset(&b->pwires, 0, sizeof(b->pwires));
+  for (int i = 0; i < b->threads; i++) {
+    b->regfile[i] = *boot;
+    b->regfile[i].R[2] = boot->R[2] - i * BARREL_STACK_BYTES;
+    b->regfile[i].R[4] = i;
+  }
+  bootstrap(&b->pwires, &b->pregs, &b->regfile[0]);
+  b->current = b->threads - 1; // round robin starts with thread 0
+  b->cycles = b->idle = b->switches = 0;
+}
+
+static bool thread_done(const Barrel *b, int i) {
+  return b->exited[i] || (!b->untilEcall && b->thread[i].issued >= b->maxCycles);
+}
+
+/* Thread to fetch for this cycle, -1 if none is ready. Round robin starts
+ * looking after the current thread, switch-on-miss keeps it while it is ready.
+ */
+static int select_thread(Barrel *b) {
+  int first = b->current + 1;
+
+  if (b->policy == BARREL_SWITCH_ON_MISS)
+    first = b->current;
+  for (int n = 0; n < b->threads; n++) {
+    int i = (first + n) % b->threads;
+    if (!thread_done(b, i) && b->thread[i].readyAt <= b->cycles)
+      return i;
+  }
+  return -1;
+}
+
+// Thread i fetches again latency cycles after this one at the earliest
+static void wait_for(Barrel *b, int i, uint64_t latency) {
+  HwThread *t = &b->thread[i];
+  if (t->readyAt < b->cycles + latency)
+    t->readyAt = b->cycles + latency;
+}
+
+/* One core cycle with fetch taking from thread `fetch` (-1 for a bubble).
+ * Round robin takes a thread out for all of its memory latency beyond one
+ * cycle: its instructions behind the access are squashed, and fetched again
+ * once the access completes while the other threads use the pipeline.
+ * Switch-on-miss only does so for an L1D miss; the core waits out hits and
+ * fetches. A taken branch squashes its thread's wrong path the same way.
+ */
+static void step_core(Barrel *b, int fetch, Byte *memory, CacheHierarchy *hier) {
+  uint64_t stalls = stall_counter, mem_stalls = mem_stall_counter;
+  uint64_t accesses = mem_access_counter, hits = hit_count, misses = miss_count;
+  const memwb_reg_t *wb = &b->pregs.memwb_preg.out;
+  int ex_tid = b->pregs.idex_preg.out.tid;
+  int mem_tid = b->pregs.exmem_preg.out.tid; // in WB after the cycle
+  bool mem_exited = b->exited[mem_tid];
+
+  // the instruction leaving WB, bubbles carry no address
+  if (wb->instr_addr != 0 && !b->exited[wb->tid])
+    b->thread[wb->tid].retired += wb->fused ? 2 : 1;
+
+  // the core clock already holds every memory stall, the hierarchy must not add them again
+  total_cycle_counter = b->cycles;
+  hier->stall_cycles = 0;
+  b->pwires.fetch_tid = fetch;
+  cycle_pipeline(b->regfile, memory, hier, &b->pregs, &b->pwires, b->exited);
+  b->cycles++;
+
+  uint64_t fetch_latency = b->pwires.fetch_stall;
+  uint64_t data_latency = mem_stall_counter - mem_stalls - fetch_latency;
+  if (fetch >= 0 && !b->pwires.stall && !b->pwires.ex_hold) {
+    b->thread[fetch].issued++;
+    b->thread[fetch].mem_stalls += fetch_latency;
+  }
+  b->thread[ex_tid].stalls += stall_counter - stalls;
+  b->thread[mem_tid].mem_stalls += data_latency;
+  b->thread[mem_tid].mem_accesses += mem_access_counter - accesses;
+  b->thread[mem_tid].hits += hit_count - hits;
+  b->thread[mem_tid].misses += miss_count - misses;
+
+  int out = -1;
+  if (b->exited[mem_tid] && !mem_exited) {
+    // nothing behind the ecall runs
+    pipelineSquash(&b->pregs, &b->pwires, mem_tid, true);
+  } else if (b->pwires.pcsrc) {
+    pipelineSquash(&b->pregs, &b->pwires, b->pwires.pc_tid, true);
+  } else if (data_latency > 0) {
+    if (b->policy == BARREL_ROUND_ROBIN || miss_count != misses) {
+      const memwb_reg_t *access = &b->pregs.memwb_preg.out;
+      out = mem_tid;
+      pipelineSquash(&b->pregs, &b->pwires, out, true);
+      b->regfile[out].PC = access->instr_addr + (access->fused ? 8 : 4);
+      wait_for(b, out, data_latency);
+    } else {
+      b->cycles += data_latency;
+    }
+  }
+  if (fetch_latency > 0 && fetch != out) {
+    if (b->policy == BARREL_ROUND_ROBIN) {
+      // the instruction is fetched again once it arrived
+      pipelineSquash(&b->pregs, &b->pwires, fetch, false);
+      wait_for(b, fetch, fetch_latency);
+    } else {
+      b->cycles += fetch_latency;
+    }
+  }
+}
+
+/* Run the threads until each reached its ecall (untilEcall) or fetched for
+ * maxCycles cycles.
+ */
+void barrelRun(Barrel *b, Byte *memory, CacheHierarchy *hier, bool untilEcall, uint64_t maxCycles) {
+  b->untilEcall = untilEcall;
+  b->maxCycles = maxCycles;
+  while (true) {
+    bool done = true;
+    for (int i = 0; i < b->threads; i++)
+      done = done && thread_done(b, i);
+    if (done)
+      break;
+    int i = select_thread(b);
+    if (i < 0) {
+      // everybody waits for memory, the pipeline drains
+      b->idle++;
+    } else {
+      if (b->policy == BARREL_SWITCH_ON_MISS && i != b->current && b->cycles > 0)
+        b->switches++;
+      b->current = i;
+    }
+    step_core(b, i, memory, hier);
+  }
+  total_cycle_counter = b->cycles;
+}
+
+void printBarrelSummary(const Barrel *b) {
+  uint64_t retired = 0;
+
+  printf("%d hardware threads sharing the pipeline, %s\n", b->threads,
+         b->policy == BARREL_ROUND_ROBIN ? "round robin" : "switch on miss");
+  for (int i = 0; i < b->threads; i++) {
+    const HwThread *t = &b->thread[i];
+    retired += t->retired;
+    printf("Thread %d: %llu instructions in %llu fetch cycles%s, stalls: %llu, MEM stalls: %llu, "
+           "memory accesses: %llu, hits: %llu, misses: %llu\n",
+           i, (unsigned long long)t->retired, (unsigned long long)t->issued,
+           b->exited[i] ? "" : " (no ecall)", (unsigned long long)t->stalls,
+           (unsigned long long)t->mem_stalls, (unsigned long long)t->mem_accesses,
+           (unsigned long long)t->hits, (unsigned long long)t->misses);
+  }
+  printf("Core cycles: %llu, idle: %llu (%.1f%%), switches: %llu\n", (unsigned long long)b->cycles,
+         (unsigned long long)b->idle, b->cycles ? 100.0 * b->idle / b->cycles : 0.0,
+         (unsigned long long)b->switches);
+  printf("Throughput: %llu instructions, %.3f IPC\n", (unsigned long long)retired,
+         b->cycles ? (double)retired / b->cycles : 0.0);
+}
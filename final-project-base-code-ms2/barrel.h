@@ -0,0 +1,64 @@
+#ifndef BARREL_H
+#define BARREL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "hierarchy.h"
+#include "riscv.h"
+#include "pipeline.h"
+#include "types.h"
+
+#define BARREL_MAX_THREADS PIPE_MAX_THREADS
+#define BARREL_STACK_BYTES 0x10000 // stack of each thread below the previous one's
+
+enum barrel_policy_enum {
+  BARREL_ROUND_ROBIN = 0,  // a different ready thread every cycle
+  BARREL_SWITCH_ON_MISS = 1 // the same thread until it misses in the L1D
+};
+
+// Per-thread state beside its register file, and its stats
+typedef struct {
+  uint64_t readyAt;  // cycle its fetch or memory access completes
+  // per-thread stats
+  uint64_t issued;   // cycles it fetched
+  uint64_t retired;  // instructions written back, fused pairs count twice
+  uint64_t stalls;
+  uint64_t mem_stalls;
+  uint64_t mem_accesses;
+  uint64_t hits;
+  uint64_t misses;
+} HwThread;
+
+/* Fine-grained hardware multithreading on one core. The thread contexts share
+ * one pipeline: every cycle fetch takes an instruction from one of the
+ * contexts that is not waiting for memory, and each pipeline register carries
+ * the context of its instruction, which selects the register file decode
+ * reads and writeback writes and the scoreboard of the hazard and bypass
+ * checks. A thread waiting for memory has its younger instructions squashed
+ * and fetched again once the access completes, while the other threads' keep
+ * going. The threads run the same program on shared memory and share the
+ * cache hierarchy; a thread finds its id in tp (x4) and has its own stack.
+ */
+typedef struct {
+  int threads;
+  int policy;
+  regfile_t regfile[BARREL_MAX_THREADS]; // indexed by the pipeline registers' thread id
+  bool exited[BARREL_MAX_THREADS];       // reached its ecall
+  HwThread thread[BARREL_MAX_THREADS];
+  pipeline_regs_t pregs;
+  pipeline_wires_t pwires;
+  int current;       // thread fetched for last
+  uint64_t cycles;   // core cycles, memory stalls included
+  uint64_t idle;     // cycles no thread was ready to fetch
+  uint64_t switches; // switch-on-miss thread switches
+  bool untilEcall;
+  uint64_t maxCycles; // issue cycles of each thread without untilEcall
+} Barrel;
+
+int barrelParsePolicy(const char *name);
+int barrelSetUp(Barrel *b, int threads, int policy);
+void barrelReset(Barrel *b, const regfile_t *boot);
+void barrelRun(Barrel *b, Byte *memory, CacheHierarchy *hier, bool untilEcall, uint64_t maxCycles);
+void printBarrelSummary(const Barrel *b);
+
+#endif // BARREL_H
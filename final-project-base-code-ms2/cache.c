@@ -10,6 +10,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <assert.h>
@@ -18,6 +19,9 @@
 #include <unistd.h>
 #include "dogfault.h"
 #include "cache.h"
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 // DO NOT MODIFY THIS FILE. INVOKE AFTER EACH ACCESS FROM runTrace
 void print_result(result r) {
@@ -30,372 +34,733 @@ void print_result(result r) {
     printf(" [status: miss, insert_block: 0x%llx]", r.insert_block_addr);
 }
 
-/* This is the entry point to operate the cache for a given address in the trace file.
- * First, is increments the global lru_clock in the corresponding cache set for the address.
- * Second, it checks if the address is already in the cache using the "probe_cache" function.
- * If yes, it is a cache hit:
- *     1) call the "hit_cacheline" function to update the counters inside the hit cache 
- *        line, including its lru_clock and access_counter.
- *     2) record a hit status in the return "result" struct and update hit_count 
- * Otherwise, it is a cache miss:
- *     1) call the "insert_cacheline" function, trying to find an empty cache line in the
- *        cache set and insert the address into the empty line. 
- *     2) if the "insert_cacheline" function returns true, record a miss status and the
-          inserted block address in the return "result" struct and update miss_count
- *     3) otherwise, if the "insert_cacheline" function returns false:
- *          a) call the "victim_cacheline" function to figure which victim cache line to 
- *             replace based on the cache replacement policy (LRU and LFU).
- *          b) call the "replace_cacheline" function to replace the victim cache line with
- *             the new cache line to insert.
- *          c) record an eviction status, the victim block address, and the inserted block
- *             address in the return "result" struct. Update miss_count and eviction_count.
+/* Tag store layout
+ * All sets live in one arena allocated by cacheSetUp. The hot part of a lookup
+ * is split into parallel arrays (struct of arrays): the tags of a set are
+ * contiguous so they can be compared a vector at a time, the valid bits of a
+ * set are one 64-bit mask, and the LRU stamps and LFU counters are only read
+ * when a victim has to be chosen. Other replacement policies keep their own
+ * compact per-set metadata (replacement.c). Dirty/prefetch state stays in the
+ * cold Line array, which is only touched once the way is known.
  */
+#define ARENA_ALIGN 64 // each array starts on its own cache line
 
- result operateCache(const unsigned long long address, Cache *cache) {
-  // Declaring & initialzing results to store the values searching for 
-  result r = {.status = 0, .victim_block_addr = 0, .insert_block_addr = 0};
+// Outcome of a single pass over a set
+typedef struct {
+  int hit;    // way holding the tag, -1 if none
+  int free;   // first invalid way, -1 if the set is full
+  int victim; // way the replacement policy would evict, -1 unless the set is full and missed
+  unsigned long long set; // set of the way returned (the ways of a skewed cache are in different sets)
+} set_lookup_t;
 
-  unsigned long long setIndex = cache_set(address, cache); // using implemeted functions
-  Set *set = &cache -> sets[setIndex]; // creating a pointer to correct set value within the cache 
-  
-  set -> lru_clock++; // Everytime the set is accessed global clock increases 
-                     // Making sure the the most recently accessed value has the highest clock value attatched to it 
-
-  // Want to check if a certain adress already exist in a set -- CACHE_HIT
-  if (probe_cache(address, cache)){
-    // if we have a hit, the address already exists in the cache, if not it matches the data to the matching line 
-    hit_cacheline(address, cache); 
-    cache -> hit_count++; // if a hit occurs, it increments the hit count 
-    r.status = CACHE_HIT; // if a hit occurs, it stores the result 
-    return r; 
-  }              
-
-  // Checking if the value is inserted in an invalid empty location -- CACHE_MISS
-  if (insert_cacheline(address, cache)){
-    // if cache line is empty, it updates the cache miss count 
-    cache -> miss_count++; 
-    r.status = CACHE_MISS; // stores the values in the cache_miss location 
-    r.insert_block_addr = address_to_block(address, cache); // stores the address of the value 
-    return r; 
-  }
+static const char *index_names[] = {"modulo", "xor", "prime", "skewed"};
 
-  // checking which line is valid, finds vicitm address and replaces it -- CACHE_EVICT
-  // creating a replacement for the victim block 
-  unsigned long long vict_block = victim_cacheline(address, cache); 
-  replace_cacheline(vict_block, address, cache); // replaces the victim block with the new block 
+static inline size_t line_index(const Cache *cache, unsigned long long set, int way) {
+  return (size_t)set * cache->linesPerSet + way;
+}
 
-  // Incrementing the counter satuses 
-  cache -> miss_count++; 
-  cache -> eviction_count++; 
-  
-  // Replacing values to show thay an eviction has occured 
-  r.status = CACHE_EVICT; 
-  r.victim_block_addr = vict_block;// storing the address of the ecvited line 
-  r.insert_block_addr = address_to_block(address, cache); // stores the block address of the inserted line 
-  return r;
+static inline uint64_t all_ways(const Cache *cache) {
+  return cache->linesPerSet == 64 ? ~0ULL : (1ULL << cache->linesPerSet) - 1;
 }
 
-// HELPER FUNCTIONS USEFUL FOR IMPLEMENTING THE CACHE
-// Given an address, return the block (aligned) address,
-// i.e., byte offset bits are cleared to 0
-unsigned long long address_to_block(const unsigned long long address, const Cache *cache) {
+// Ways a new block may be placed in, all of them unless the cache is partitioned
+static inline uint64_t fill_ways(const Cache *cache) {
+  return cache->fillWays ? cache->fillWays & all_ways(cache) : all_ways(cache);
+}
 
-    // create a mask that clears the block offset
-    // 1ULL: Unsigned long long value 1
-     unsigned long long mask = ~((1ULL << cache->blockBits) - 1);
+/* Sectored lines: a line is split into 2^sectorBits sectors with their own valid
+ * and dirty bits, and a miss only fetches the sector it needs. An unsectored
+ * cache is the one-sector case, its single sector always valid.
+ */
+static inline int sector_bytes(const Cache *cache) {
+  return 1 << (cache->blockBits - cache->sectorBits);
+}
 
-     // Apply the mask to zero out the block offset
-     // By bitwise AND operation between the mask and the given input memory adress
-     return address & mask;
+static inline uint64_t sector_bit(const Cache *cache, unsigned long long address) {
+  return 1ULL << ((address >> (cache->blockBits - cache->sectorBits)) & ((1ULL << cache->sectorBits) - 1));
+}
 
+static inline uint64_t all_sectors(const Cache *cache) {
+  return cache->sectorBits == CACHE_MAX_SECTOR_BITS ? ~0ULL : (1ULL << (1 << cache->sectorBits)) - 1;
 }
 
-// Return the cache tag of an address
-unsigned long long cache_tag(const unsigned long long address, const Cache *cache) {
+// Count the bytes of a line a demand access touches for the first time
+static inline void reference_line(Cache *cache, Line *line, unsigned long long address) {
+  unsigned long long offset = address & ((1ULL << cache->blockBits) - 1);
+  uint64_t bit = 1ULL << (offset >> cache->refShift);
+  if (!(line->referenced & bit)) {
+    line->referenced |= bit;
+    cache->bytes_referenced += 1ULL << cache->refShift;
+  }
+}
 
-  // Shift the given input memory adress to the right to remove block offset and set index 
-  unsigned long long tag = address >> ((cache->blockBits + cache->setBits));                    
-  
-  // Return the tag of the given memory address
-  return tag;
+// Bit i of the result is set when tags[i] == tag. Valid bits are applied by the caller.
+static inline uint64_t match_tags(const unsigned long long *tags, int ways, unsigned long long tag) {
+  uint64_t mask = 0;
+  int w = 0;
+#if defined(__AVX2__)
+  __m256i key4 = _mm256_set1_epi64x((long long)tag);
+  for (; w + 4 <= ways; w += 4) {
+    __m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)&tags[w]), key4);
+    mask |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(eq)) << w;
+  }
+#endif
+#if defined(__SSE2__)
+  // SSE2 has no 64-bit compare: both 32-bit halves of a lane have to match
+  __m128i key2 = _mm_set1_epi64x((long long)tag);
+  for (; w + 2 <= ways; w += 2) {
+    __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)&tags[w]), key2);
+    eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+    mask |= (uint64_t)_mm_movemask_pd(_mm_castsi128_pd(eq)) << w;
+  }
+#endif
+  for (; w < ways; w++)
+    mask |= (uint64_t)(tags[w] == tag) << w;
+  return mask;
 }
 
-// Return the cache set index of the address
-unsigned long long cache_set(const unsigned long long address, const Cache *cache) {
+// Ask the replacement policy which way of a full set to evict
+static inline int victim_way(Cache *cache, unsigned long long set) {
+  size_t base = line_index(cache, set, 0);
+  return replacementVictim(&cache->repl, set, &cache->ages[base], &cache->counts[base]);
+}
 
-  // Remove the block offset bits by shifting right
-  unsigned long long shifted = address >> cache->blockBits;
-  
-  // Create a mask to only extract the set index
-  unsigned long long mask = (1ULL << cache->setBits) - 1;
+// True if line a should be evicted before line b (skewed caches and partitions, LRU or LFU)
+static inline bool evicts_before(const Cache *cache, size_t a, size_t b) {
+  if (cache->replacement == REPL_LFU && cache->counts[a] != cache->counts[b])
+    return cache->counts[a] < cache->counts[b];
+  return cache->ages[a] < cache->ages[b];
+}
 
-  // Return the cache set index of the given input memory address
-  return shifted & mask;
+/* Victim among the ways of a partition. The policy's metadata covers the
+ * whole set, so, as in a skewed cache, the partition's lines are ranked by
+ * their LRU stamps (LFU counts).
+ */
+static int partition_victim(Cache *cache, unsigned long long set, uint64_t ways) {
+  size_t base = line_index(cache, set, 0);
+  int victim = __builtin_ctzll(ways), oldest = victim;
+
+  for (uint64_t w = ways & (ways - 1); w != 0; w &= w - 1) {
+    int way = __builtin_ctzll(w);
+    if (evicts_before(cache, base + way, base + victim))
+      victim = way;
+    if (cache->ages[base + way] < cache->ages[base + oldest])
+      oldest = way;
+  }
+  cache->repl.stats.victims++;
+  if (victim == oldest)
+    cache->repl.stats.lru_agree++;
+  return victim;
+}
+
+// One pass over the set: hit way, first free way, and the victim only when both are missing
+static set_lookup_t lookup_set(Cache *cache, unsigned long long set, unsigned long long tag) {
+  set_lookup_t l = {.hit = -1, .free = -1, .victim = -1, .set = set};
+  uint64_t valid = cache->valid[set];
+  uint64_t hits = match_tags(&cache->tags[line_index(cache, set, 0)], cache->linesPerSet, tag) & valid;
+  uint64_t empty = ~valid & fill_ways(cache);
+
+  if (hits != 0)
+    l.hit = __builtin_ctzll(hits);
+  else if (empty != 0)
+    l.free = __builtin_ctzll(empty);
+  else if (cache->fillWays)
+    l.victim = partition_victim(cache, set, fill_ways(cache));
+  else
+    l.victim = victim_way(cache, set);
+  return l;
 }
 
+// Way holding the address, -1 if it is not cached
+static int find_way(const Cache *cache, unsigned long long set, unsigned long long tag) {
+  uint64_t hits = match_tags(&cache->tags[line_index(cache, set, 0)], cache->linesPerSet, tag) &
+                  cache->valid[set];
+  return hits != 0 ? __builtin_ctzll(hits) : -1;
+}
 
-// Check if the address is found in the cache. If so, return true. else return false.
-bool probe_cache(const unsigned long long address, const Cache *cache) {
+/* Set of `way` for a block of a skewed cache. Each way scatters the block numbers
+ * with a different hash, so blocks that collide in one way rarely collide in the others.
+ */
+static inline unsigned long long skew_set(const Cache *cache, unsigned long long block, int way) {
+  unsigned long long h = (block ^ ((unsigned long long)way * 0x9E3779B97F4A7C15ULL)) * 0xBF58476D1CE4E5B9ULL;
+  return (h ^ (h >> 31)) & ((1ULL << cache->setBits) - 1);
+}
 
-  // Use the function we implemented earlier to get the set index of a given memory adress
-  unsigned long long setIndex = cache_set(address, cache);
+// Sets of a skewed cache share one clock so lines of different sets can be ranked
+static inline uint64_t set_clock(const Cache *cache, unsigned long long set) {
+  return cache->clocks[cache->indexing == INDEX_SKEWED ? 0 : set];
+}
 
-  // Use the function we implemented earlier to get the tag of a given memory adress
-  unsigned long long tag = cache_tag(address, cache);
+/* Skewed lookup: the candidate lines of a block are way w of set skew_set(block, w).
+ * The victim is picked among them by the cache-wide LRU stamps (or LFU counts),
+ * the per-set replacement metadata does not apply.
+ */
+static set_lookup_t lookup_skewed(Cache *cache, unsigned long long block) {
+  set_lookup_t l = {.hit = -1, .free = -1, .victim = -1, .set = 0};
+  unsigned long long freeSet = 0, victimSet = 0;
+  size_t victim = 0, oldest = 0;
+  int victimWay = -1, oldestWay = -1;
+
+  uint64_t ways = fill_ways(cache);
+  for (int w = 0; w < cache->linesPerSet; w++) {
+    unsigned long long s = skew_set(cache, block, w);
+    size_t i = line_index(cache, s, w);
+    bool fillable = (ways >> w) & 1;
+    if (!((cache->valid[s] >> w) & 1)) {
+      if (l.free < 0 && fillable) {
+        l.free = w;
+        freeSet = s;
+      }
+      continue;
+    }
+    if (cache->tags[i] == block) {
+      l.hit = w;
+      l.set = s;
+      return l;
+    }
+    if (!fillable)
+      continue;
+    if (victimWay < 0 || evicts_before(cache, i, victim)) {
+      victimWay = w;
+      victim = i;
+      victimSet = s;
+    }
+    if (oldestWay < 0 || cache->ages[i] < cache->ages[oldest]) {
+      oldestWay = w;
+      oldest = i;
+    }
+  }
 
-  // Get a pointer to the correct set in the cache using setIndex
-  Set *targetSet = &cache->sets[setIndex];
+  if (l.free >= 0) {
+    l.set = freeSet;
+  } else {
+    l.victim = victimWay;
+    l.set = victimSet;
+    cache->repl.stats.victims++;
+    if (victim == oldest)
+      cache->repl.stats.lru_agree++;
+  }
+  return l;
+}
 
-  // Loop through all the lines in the set for the selected cache set
-  for (int i = 0; i < cache->linesPerSet; i++) {
-    Line *line = &targetSet->lines[i]; // This line gets a pointer to the i-th cache line in the selected set
+// Advance the clock of the address's set and look the address up in a single pass
+static set_lookup_t lookup(Cache *cache, unsigned long long address) {
+  unsigned long long tag = cache_tag(address, cache);
+  if (cache->indexing == INDEX_SKEWED) {
+    cache->clocks[0]++;
+    return lookup_skewed(cache, tag);
+  }
+  unsigned long long set = cache_set(address, cache);
+  cache->clocks[set]++;
+  return lookup_set(cache, set, tag);
+}
 
-    // Check if the line is valid - Meaning the line containes valid data
-    // Check if the tag stored in cache line matches the tag extracted from current memory address
-    if (line->valid && line->tag == tag) {
-      return true; // If both conditions match - return true since the given input memory address is in the cache
+// Way holding the address and its set, -1 if the address is not cached
+static int locate(const Cache *cache, unsigned long long address, unsigned long long *set) {
+  unsigned long long tag = cache_tag(address, cache);
+  if (cache->indexing == INDEX_SKEWED) {
+    for (int w = 0; w < cache->linesPerSet; w++) {
+      unsigned long long s = skew_set(cache, tag, w);
+      if (((cache->valid[s] >> w) & 1) && cache->tags[line_index(cache, s, w)] == tag) {
+        *set = s;
+        return w;
+      }
     }
+    return -1;
   }
+  *set = cache_set(address, cache);
+  return find_way(cache, *set, tag);
+}
 
-  // Return false since no matching line was found, therfor the address is NOT found in the cache
-  return false;
+// First invalid line the address could go to and its set, -1 if there is none
+static int free_way(const Cache *cache, unsigned long long address, unsigned long long *set) {
+  if (cache->indexing == INDEX_SKEWED) {
+    unsigned long long block = cache_tag(address, cache);
+    for (int w = 0; w < cache->linesPerSet; w++) {
+      *set = skew_set(cache, block, w);
+      if (!((cache->valid[*set] >> w) & 1) && ((fill_ways(cache) >> w) & 1))
+        return w;
+    }
+    return -1;
+  }
+  *set = cache_set(address, cache);
+  uint64_t empty = ~cache->valid[*set] & fill_ways(cache);
+  return empty != 0 ? __builtin_ctzll(empty) : -1;
 }
 
+// Refresh the recency and frequency of a way on a hit
+static inline void touch_way(Cache *cache, unsigned long long set, int way) {
+  size_t i = line_index(cache, set, way);
+  cache->ages[i] = set_clock(cache, set);
+  cache->counts[i]++;
+  replacementHit(&cache->repl, set, way);
+}
 
+/* Account for the line in `way` leaving the cache: count its write-back and,
+ * if it was a prefetch nobody used, charge it to the prefetcher.
+ */
+static void evict_way(Cache *cache, unsigned long long set, int way) {
+  Line *vict = &cache->lines[line_index(cache, set, way)];
+
+  // A dirty victim is written back by the caller
+  if (vict->dirty)
+    cache->writeback_count++;
+
+  // A prefetched line leaving before any demand access was a useless prefetch
+  if (vict->prefetched && cache->prefetcher != NULL) {
+    cache->prefetcher->stats.useless++;
+    if (vict->displaced_demand)
+      cache->prefetcher->stats.pollution++;
+  }
+}
 
+// Fill `way` with the block holding the address as a clean demand line
+static Line *install_way(Cache *cache, unsigned long long set, int way, unsigned long long address) {
+  size_t i = line_index(cache, set, way);
+  Line *line = &cache->lines[i];
+
+  cache->tags[i] = cache_tag(address, cache);
+  cache->ages[i] = set_clock(cache, set);
+  cache->counts[i] = 1; // initial access count
+  cache->valid[set] |= 1ULL << way;
+  replacementFill(&cache->repl, set, way);
+  line->block_addr = address_to_block(address, cache);
+  line->dirty = false; // clean until written
+  line->prefetched = false; // demand fill, prefetch_cacheline marks its own lines
+  line->displaced_demand = false;
+  line->sectorValid = all_sectors(cache); // demand misses of a sectored cache narrow this down
+  line->sectorDirty = 0;
+  line->referenced = 0;
+  return line;
+}
 
+/* Place the block holding the address into its set, evicting if needed, and fill in
+ * the status, insert and victim fields of r. Hit/miss counts are left to the caller.
+ */
+static Line *allocate_block(Cache *cache, unsigned long long set, const set_lookup_t *l,
+                            unsigned long long address, result *r) {
+  int way = l->free;
+
+  r->insert_block_addr = address_to_block(address, cache);
+  if (way >= 0) {
+    r->status = CACHE_MISS;
+  } else {
+    way = l->victim;
+    Line *vict = &cache->lines[line_index(cache, set, way)];
+    r->status = CACHE_EVICT;
+    r->victim_block_addr = vict->block_addr;
+    r->victim_dirty = vict->dirty; // must be written back before it is lost
+    // only the modified sectors travel down; a line dirtied as a whole writes everything
+    r->victim_bytes = vict->sectorDirty ? __builtin_popcountll(vict->sectorDirty) * sector_bytes(cache)
+                                        : 1 << cache->blockBits;
+    evict_way(cache, set, way);
+    cache->eviction_count++;
+  }
+  r->way = way;
+  return install_way(cache, set, way, address);
+}
 
-// Access address in cache. Called only if probe is successful.
-// Update the LRU (least recently used) or LFU (least frequently used) counters.
-void hit_cacheline(const unsigned long long address, Cache *cache){
-    // using implemeted functions
-    unsigned long long setIndex = cache_set(address, cache);
-    unsigned long long tag = cache_tag(address, cache);
-    
-    // creating a target for set 
-    Set *set = &cache ->sets[setIndex];
-    // if a matching one is found, line (empty pointer) points to it 
-    Line *line = NULL; 
-
-    // Looping through the lines to find the matching tag needed + storing the address in line 
-    for (int i= 0; i < cache ->linesPerSet; i++) { 
-      if (set -> lines[i].valid && set -> lines[i].tag == tag){ 
-        line = &set -> lines[i]; 
-        break;
+/* This is the entry point to operate the cache for a given address in the trace file.
+ * It bumps the set's lru_clock and looks the tag up with a single pass over the set
+ * (lookup_set), which returns the hit way, or else a free way, or else the victim
+ * chosen by the cache's replacement policy (replacement.h):
+ *   - hit: refresh the line's lru_clock and access_counter, count a hit.
+ *   - free way: insert the block there, record a miss and the inserted block address.
+ *   - full set: replace the victim, record an eviction with the victim and inserted
+ *     block addresses, count a miss and an eviction.
+ * Stores (is_write) follow the cache's write policy: write-back caches mark the line
+ * dirty, write-through no-write-allocate caches do not insert the block on a store miss
+ * (r.write_around is set). If the victim was dirty, r.victim_dirty is set and the
+ * caller has to write the victim block back to the next level.
+ */
+result operateCache(const unsigned long long address, bool is_write, Cache *cache) {
+  result r = {.status = 0, .victim_block_addr = 0, .insert_block_addr = 0,
+              .victim_dirty = false, .write_around = false, .way = -1};
+  bool write_back = (cache->writePolicy == WRITE_BACK);
+
+  // Every access advances the set's clock, the most recently used line has the highest stamp
+  set_lookup_t l = lookup(cache, address);
+  unsigned long long set = l.set;
+
+  if (l.hit >= 0) {
+    Line *line = &cache->lines[line_index(cache, set, l.hit)];
+    uint64_t sector = sector_bit(cache, address);
+    touch_way(cache, set, l.hit);
+    r.way = l.hit;
+    r.status = CACHE_HIT;
+    if (!(line->sectorValid & sector)) {
+      // The line is here but not this sector: a miss that only moves the sector
+      cache->miss_count++;
+      cache->sector_miss_count++;
+      r.status = CACHE_MISS;
+      r.sector_miss = true;
+      r.insert_block_addr = line->block_addr;
+      if (is_write && !write_back) {
+        r.write_around = true;
+        return r;
       }
+      line->sectorValid |= sector;
+      r.fill_bytes = sector_bytes(cache);
+      cache->bytes_fetched += r.fill_bytes;
+    } else {
+      cache->hit_count++;
     }
-
-    // Case where no matching tags are found, line with be set to NULL 
-    if (line == NULL){
-      fprintf(stderr, "Error - hit_cacheline could not find matching line\n"); 
-      return; 
+    if (is_write && write_back) {
+      line->dirty = true; // the copy in the next level is stale now
+      line->sectorDirty |= sector;
     }
+    reference_line(cache, line, address);
+    return r;
+  }
 
-  line -> lru_clock = set -> lru_clock; // The current timestamp is loads into lru_clock, indicating that it was used most recently
-  line -> access_counter++; // incrementing the counter 
+  cache->miss_count++;
 
+  // No-write-allocate: a store miss goes around the cache to the next level
+  if (is_write && !write_back) {
+    r.status = CACHE_MISS;
+    r.write_around = true;
+    return r;
+  }
 
- }
+  Line *line = allocate_block(cache, set, &l, address, &r);
+  line->sectorValid = sector_bit(cache, address) | (cache->sectorBits ? 0 : all_sectors(cache));
+  r.fill_bytes = sector_bytes(cache);
+  cache->bytes_fetched += r.fill_bytes;
+  if (is_write) {
+    line->dirty = true; // write-allocate then write
+    line->sectorDirty = line->sectorValid;
+  }
+  reference_line(cache, line, address);
+  return r;
+}
 
+// HELPER FUNCTIONS USEFUL FOR IMPLEMENTING THE CACHE
+// Given an address, return the block (aligned) address,
+// i.e., byte offset bits are cleared to 0
+unsigned long long address_to_block(const unsigned long long address, const Cache *cache) {
 
+    // create a mask that clears the block offset
+    // 1ULL: Unsigned long long value 1
+     unsigned long long mask = ~((1ULL << cache->blockBits) - 1);
 
+     // Apply the mask to zero out the block offset
+     // By bitwise AND operation between the mask and the given input memory adress
+     return address & mask;
 
+}
 
-/* This function is only called if probe_cache returns false, i.e., the address is
- * not in the cache. In this function, it will try to find an empty (i.e., invalid)
- * cache line for the address to insert. 
- * If it found an empty one:
- *     1) it inserts the address into that cache line (marking it valid).
- *     2) it updates the cache line's lru_clock based on the global lru_clock 
- *        in the cache set and initiates the cache line's access_counter.
- *     3) it returns true.
- * Otherwise, it returns false.  
- */ 
+// Return the cache tag of an address
+unsigned long long cache_tag(const unsigned long long address, const Cache *cache) {
 
-bool insert_cacheline(const unsigned long long address, Cache *cache) {
+  // A hashed set index does not pin down the low bits, so the tag keeps the whole block number
+  if (cache->indexing != INDEX_MODULO)
+    return address >> cache->blockBits;
 
-  // Compute the set index, tag, and the block offset from the given memory address input
-  // We have already implemnted the logic to extract these info using helper functions
+  // Shift the given input memory adress to the right to remove block offset and set index 
+  unsigned long long tag = address >> ((cache->blockBits + cache->setBits));                    
+  
+  // Return the tag of the given memory address
+  return tag;
+}
 
-  unsigned long long setIndex = cache_set(address, cache);
-  unsigned long long tag = cache_tag(address, cache);
-  unsigned long long block_addr = address_to_block(address, cache);
+// XOR every setBits-wide group of the block number together
+static unsigned long long xor_fold(unsigned long long block, int setBits) {
+  unsigned long long mask = (1ULL << setBits) - 1;
+  unsigned long long set = 0;
+
+  if (setBits == 0)
+    return 0;
+  for (; block != 0; block >>= setBits)
+    set ^= block & mask;
+  return set;
+}
 
-  // Get a pointer to the correct cache set, given we have the set index of the memory address
-  Set *targetSet = &cache->sets[setIndex];
+// Return the cache set index of the address (the set of way 0 for a skewed cache)
+unsigned long long cache_set(const unsigned long long address, const Cache *cache) {
 
-  // Loop through the lines in the set to to find an empty (invalid) line to insert the new cache block
-  for (int i = 0; i < cache->linesPerSet; i++) {
-    Line *line = &targetSet->lines[i]; // Create a pointer to the i-th cache line in the selected set for easier access
+  // Remove the block offset bits by shifting right
+  unsigned long long shifted = address >> cache->blockBits;
 
+  if (cache->indexing == INDEX_XOR)
+    return xor_fold(shifted, cache->setBits);
+  if (cache->indexing == INDEX_PRIME)
+    return shifted % cache->primeSets;
+  if (cache->indexing == INDEX_SKEWED)
+    return skew_set(cache, shifted, 0);
+  
+  // Create a mask to only extract the set index
+  unsigned long long mask = (1ULL << cache->setBits) - 1;
 
+  // Return the cache set index of the given input memory address
+  return shifted & mask;
+}
 
-    // Check to see if the line is invalid (empty line)
-    if (!line->valid) {
 
-      // Insert the new cache block inside the Empty line
 
-      line->valid = true; // Assign the line as valid - since are inserting and it's not empty anymore
-      line->tag = tag; //  Assign the tag we calculated already using the helper function
-      line->block_addr = block_addr; // Assign the aligned block address
-      line->access_counter = 1; // Intial access count
-      line->lru_clock = targetSet->lru_clock; // updating the line's lru_clock based on the global lru_clock in the cache set
+/* The functions below are the original step-by-step interface to the cache.
+ * operateCache no longer goes through them, but they keep their meaning for
+ * callers that drive a cache one step at a time.
+ */
 
-      return true; // Successful insertion
+// Check if the address is found in the cache. If so, return true. else return false.
+bool probe_cache(const unsigned long long address, const Cache *cache) {
+  unsigned long long set;
+  return locate(cache, address, &set) >= 0;
+}
 
-    }
+// Access address in cache. Called only if probe is successful.
+// Update the LRU (least recently used) or LFU (least frequently used) counters.
+void hit_cacheline(const unsigned long long address, Cache *cache) {
+  unsigned long long set;
+  int way = locate(cache, address, &set);
 
+  if (way < 0) {
+    fprintf(stderr, "Error - hit_cacheline could not find matching line\n");
+    return;
   }
-
-  // No empty line found to insert a new cache block
-   return false; 
+  touch_way(cache, set, way);
 }
 
+/* This function is only called if probe_cache returns false, i.e., the address is
+ * not in the cache. If the set has an empty (invalid) line, the block is inserted
+ * there with the set's current lru_clock and an access_counter of 1, and true is
+ * returned. Otherwise, it returns false.
+ */
+bool insert_cacheline(const unsigned long long address, Cache *cache) {
+  unsigned long long set;
+  int way = free_way(cache, address, &set);
 
+  if (way < 0)
+    return false;
+  install_way(cache, set, way, address);
+  return true;
+}
 
 // If there is no empty cacheline, this method figures out which cacheline to replace
-// depending on the cache replacement policy (LRU and LFU). It returns the block address
+// depending on the cache replacement policy (replacement.h). It returns the block address
 // of the victim cacheline; note we no longer have access to the full address of the victim
-unsigned long long victim_cacheline(const unsigned long long address, const Cache *cache) {
-                                
-  unsigned long long setIndex = cache_set(address, cache); // What we are looking for 
-  Set *set = &cache -> sets[setIndex]; // Creating the target for function 
-
-  int victIndex = 0; // Assuming the first line encountered is the vicitim 
-
-  for (int i = 1; i < cache -> linesPerSet; i++){ // looping to find the matching line to the victim pointer 
-    Line *current = &set -> lines[i]; // Pointer to the current value being inspected 
-    Line *vict = &set -> lines[victIndex]; // pointer to the assumed victim value 
-
-    if (cache -> lfu == 0){ 
-      // finding line with the oldest timestamp 
-      if (current -> lru_clock < vict -> lru_clock)
-        victIndex = i; 
-    } else { // if two lines are use frequinlty for oldest accessed, chooses the smaller rlu_clock 
-      if (current -> access_counter < vict -> access_counter || 
-         (current -> access_counter == vict -> access_counter &&
-          current -> lru_clock < vict -> lru_clock ))
-          victIndex = i; 
-    }
+unsigned long long victim_cacheline(const unsigned long long address, Cache *cache) {
+  if (cache->indexing == INDEX_SKEWED) {
+    set_lookup_t l = lookup_skewed(cache, cache_tag(address, cache));
+    return l.victim >= 0 ? cache->lines[line_index(cache, l.set, l.victim)].block_addr : 0;
   }
-   // returns address of the victim found 
-   return set -> lines[victIndex].block_addr; 
+  unsigned long long set = cache_set(address, cache);
+  return cache->lines[line_index(cache, set, victim_way(cache, set))].block_addr;
 }
 
-
-
-
 /* Replace the victim cacheline with the new address to insert. Note for the victim cachline,
  * we only have its block address. For the new address to be inserted, we have its full address.
- * Remember to update the new cache line's lru_clock based on the global lru_clock in the cache
- * set and initiate the cache line's access_counter.
  */
-
-
 void replace_cacheline(const unsigned long long victim_block_addr, const unsigned long long insert_addr, Cache *cache) {
-               
+  // the victim shares a set with the inserted block, or for a skewed cache one of its way's sets
+  unsigned long long set;
+  int way = locate(cache, victim_block_addr, &set);
 
-unsigned long long setIndex = cache_set(insert_addr, cache); // The new address we are looking for 
-Set *set = &cache -> sets[setIndex]; 
-
-// Looping through set to find the victim line 
-Line *vict = NULL;
-
-for (int i = 0; i < cache -> linesPerSet; i++) {
-  // finds the block_addr that matches the vitim line looking for 
-  if (set -> lines[i].valid && set -> lines[i].block_addr == victim_block_addr){
-    vict = &set -> lines[i]; 
-    break;
+  if (way < 0) {
+    fprintf(stderr, "Error - replace_cacheline could not find the victim line");
+    return;
   }
+  evict_way(cache, set, way);
+  install_way(cache, set, way, insert_addr);
 }
 
-// if nothing is found, sets the vict to null (empty)
-if (vict == NULL){ 
-  // if victim line is not found, prints out an error 
-  fprintf(stderr, "Error - replace_cacheline could not find the victim line"); 
-  return;
+/* Remove the block holding the address from the cache, if it is there.
+ * Used by the hierarchy for back-invalidation (inclusive lower level evicted the
+ * block) and for moving a block up out of an exclusive lower level.
+ * Returns true if a valid line was found and invalidated. If was_dirty is not
+ * NULL it tells whether the removed line held modified data.
+ */
+bool invalidate_cacheline(const unsigned long long address, Cache *cache, bool *was_dirty) {
+  unsigned long long set;
+  int way = locate(cache, address, &set);
+
+  if (was_dirty != NULL)
+    *was_dirty = false;
+
+  // Block was not cached at this level
+  if (way < 0)
+    return false;
+
+  size_t i = line_index(cache, set, way);
+  Line *line = &cache->lines[i];
+  if (line->prefetched && cache->prefetcher != NULL) {
+    cache->prefetcher->stats.useless++;
+    if (line->displaced_demand)
+      cache->prefetcher->stats.pollution++;
+  }
+  if (was_dirty != NULL)
+    *was_dirty = line->dirty;
+  cache->valid[set] &= ~(1ULL << way); // the slot becomes free for the next insert
+  cache->counts[i] = 0;
+  line->dirty = false;
+  line->prefetched = false;
+  return true;
 }
 
-// Replacing the vicitm like with a new block 
-vict -> tag = cache_tag(insert_addr, cache); // stores the pieces of the address in the line 
-vict -> block_addr = address_to_block(insert_addr, cache); // stores the aligned block address 
-vict -> valid = true; // line can now be used 
-vict -> access_counter = 1; // setting it to the first access 
-vict -> lru_clock = set -> lru_clock; // sets set to the recently used value 
+/* Place the block holding the address into the cache without counting it as a
+ * demand access. This is how a lower level receives blocks it did not miss on
+ * itself: victims spilled out of an L1 into an exclusive L2, and write-backs of
+ * dirty blocks (dirty = true marks the block modified at this level).
+ * Returns the same result struct as operateCache, but hit/miss counts are untouched;
+ * only eviction_count is updated when a line has to be replaced.
+ */
+result fill_cacheline(const unsigned long long address, bool dirty, Cache *cache) {
+  result r = {.status = CACHE_HIT, .victim_block_addr = 0, .insert_block_addr = 0,
+              .victim_dirty = false, .write_around = false, .way = -1};
+  set_lookup_t l = lookup(cache, address);
+  unsigned long long set = l.set;
+
+  // Already present, just refresh its recency
+  // The block arrives whole, every sector becomes valid
+  if (l.hit >= 0) {
+    Line *line = &cache->lines[line_index(cache, set, l.hit)];
+    touch_way(cache, set, l.hit);
+    line->sectorValid = all_sectors(cache);
+    if (dirty) {
+      line->dirty = true;
+      line->sectorDirty = all_sectors(cache);
+    }
+    return r;
+  }
+
+  Line *line = allocate_block(cache, set, &l, address, &r);
+  line->dirty = dirty;
+  line->sectorDirty = dirty ? all_sectors(cache) : 0;
+  return r;
+}
 
+// Return the valid line holding the address, or NULL if it is not cached
+Line *find_cacheline(const unsigned long long address, Cache *cache) {
+  unsigned long long set;
+  int way = locate(cache, address, &set);
+  return way >= 0 ? &cache->lines[line_index(cache, set, way)] : NULL;
 }
 
+/* Insert a block brought in by the prefetcher. The line is tagged as prefetched
+ * until its first demand hit, so the prefetcher can tell useful prefetches from
+ * useless ones. Blocks already in the cache are left alone (status CACHE_HIT).
+ */
+result prefetch_cacheline(const unsigned long long address, unsigned long long ready_cycle, Cache *cache) {
+  result r = {.status = CACHE_HIT, .victim_block_addr = 0, .insert_block_addr = 0,
+              .victim_dirty = false, .write_around = false, .way = -1};
+  unsigned long long set;
+
+  if (locate(cache, address, &set) >= 0)
+    return r;
+
+  set_lookup_t l = lookup(cache, address);
+  set = l.set;
+
+  // Remember if the victim was a demand line, for the pollution count
+  bool displaced = l.victim >= 0 && !cache->lines[line_index(cache, set, l.victim)].prefetched;
+  Line *line = allocate_block(cache, set, &l, address, &r);
+  cache->bytes_fetched += 1ULL << cache->blockBits;
+  line->prefetched = true;
+  line->displaced_demand = displaced;
+  line->ready_cycle = ready_cycle;
+  return r;
+}
 
+// Largest prime not above n (n itself for 1 and 2)
+static unsigned long long largest_prime(unsigned long long n) {
+  for (; n > 2; n--) {
+    bool prime = true;
+    for (unsigned long long d = 2; d * d <= n && prime; d++)
+      prime = (n % d) != 0;
+    if (prime)
+      return n;
+  }
+  return n;
+}
 
+// Round an arena offset up to the next ARENA_ALIGN boundary
+static size_t arena_round(size_t offset) {
+  return (offset + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
 
 // allocate the memory space for the cache with the given cache parameters
 // and initialize the cache sets and lines.
-// Initialize the cache name to the given name 
+// Initialize the cache name to the given name
 void cacheSetUp(Cache *cache, char *name) {
-  
-  // Calculate the total number of sets
-  // Since setBits represents the number of bits used for the set index
-  // Total number of sets = 2 ^ (setBits)
-  int numSets = 1 << cache->setBits;
-
-  // Dynamically allocate memory for the array of cache sets
-  // Each set will later contain an array of cache lines
-  cache->sets = (Set *)malloc(numSets * sizeof(Set));
-
-
-  // Now we loop through each set to allocate and intialize the lines for each set
-  for (int i = 0; i < numSets; i++) {
-
-    // Dynamically Allocate memory for the array of lines for the current set
-    cache->sets[i].lines = (Line *)malloc(cache->linesPerSet * sizeof(Line));
-
-    // Intialize each line in the current set
-    for (int j = 0; j < cache->linesPerSet; j++) {
-      cache->sets[i].lines[j].valid = false; // The line starts invalid - Meaning initially, does NOT contain data
-      cache->sets[i].lines[j].tag = 0; // Intializing the line as it containes NO tag
-      cache->sets[i].lines[j].lru_clock = 0; // LRU_clock tracks how this recently this line was used - intialzing as 0
-      cache->sets[i].lines[j].access_counter = 0; // Tracks how many times this line has been accessed - intialzing as 0
-      cache->sets[i].lines[j].block_addr = 0; // block_ addr represents the memory block address the line holds - intialzing as 0
-
-    }
-
-    // Intialize the Global LRU clock for the current set
-    // NOTE: this is different than the list lru_clock
-    cache->sets[i].lru_clock = 0;
+  assert(cache->linesPerSet >= 1 && cache->linesPerSet <= CACHE_MAX_WAYS);
+  assert(cache->sectorBits >= 0 && cache->sectorBits <= CACHE_MAX_SECTOR_BITS &&
+         cache->sectorBits <= cache->blockBits);
 
+  // Total number of sets = 2 ^ (setBits)
+  size_t numSets = 1UL << cache->setBits;
+  size_t numLines = numSets * cache->linesPerSet;
+
+  // Lay the arrays out back to back in a single allocation
+  size_t tagsOff = 0;
+  size_t agesOff = arena_round(tagsOff + numLines * sizeof(unsigned long long));
+  size_t countsOff = arena_round(agesOff + numLines * sizeof(uint64_t));
+  size_t validOff = arena_round(countsOff + numLines * sizeof(uint32_t));
+  size_t clocksOff = arena_round(validOff + numSets * sizeof(uint64_t));
+  size_t linesOff = arena_round(clocksOff + numSets * sizeof(uint64_t));
+  size_t size = arena_round(linesOff + numLines * sizeof(Line));
+
+  // Everything starts at zero: no valid lines, clocks and counters at 0
+  char *arena = aligned_alloc(ARENA_ALIGN, size);
+  if (arena == NULL) {
+    fprintf(stderr, "Error - cannot allocate %zu bytes for cache %s\n", size, name);
+    exit(EXIT_FAILURE);
   }
+  memset(arena, 0, size);
+
+  cache->arena = arena;
+  cache->tags = (unsigned long long *)(arena + tagsOff);
+  cache->ages = (uint64_t *)(arena + agesOff);
+  cache->counts = (uint32_t *)(arena + countsOff);
+  cache->valid = (uint64_t *)(arena + validOff);
+  cache->clocks = (uint64_t *)(arena + clocksOff);
+  cache->lines = (Line *)(arena + linesOff);
 
   // Set the cache name to the one given as input parameter of the function
   // For indentification
   cache->name = name;
 
+  // Reset the stats, the cache struct may live on the stack with garbage in it
+  cache->hit_count = 0;
+  cache->miss_count = 0;
+  cache->eviction_count = 0;
+  cache->backinval_count = 0;
+  cache->writeback_count = 0;
+  cache->sector_miss_count = 0;
+  cache->bytes_fetched = 0;
+  cache->bytes_referenced = 0;
+  cache->refShift = cache->blockBits - CACHE_REF_UNIT_BITS > 2 ? cache->blockBits - CACHE_REF_UNIT_BITS : 2;
+  cache->prefetcher = NULL; // attached later by the hierarchy if enabled
+  cache->fillWays = 0; // not partitioned
+  cache->primeSets = largest_prime(numSets);
+
+  replacementSetUp(&cache->repl, cache->replacement, cache->setBits, cache->linesPerSet, cache->replSeed);
 }
 
 // deallocate the memory space for the cache
 void deallocate(Cache *cache) {
-  
-  // Calculate the total number of sets
-  // Since setBits represents the number of bits used for the set index
-  // Total number of sets = 2 ^ (setBits)
-  int numSets = 1 << cache->setBits;
-
-  // Loop through each set
-  for (int i = 0; i < numSets; i++) {
-    
-    // Free the dynamically allocated array of lines in each set
-    // we are using free(), which is std library fucntion to releases  dynamic memory, kind of like a destructor
-    free(cache->sets[i].lines); 
-  }
-
-  // Free the array of sets after free the array of lines
-  free(cache->sets);
+  // The whole tag store is one allocation
+  free(cache->arena);
+  cache->arena = NULL;
+  replacementDeallocate(&cache->repl);
 
   // We don't simply free(cache) because cache is not a dynamically allocated
   // But instead it is decleared as a local stack variable
 }
 
+// Index function from its name, -1 if unknown
+int cacheIndexParse(const char *name) {
+  for (int i = 0; i < (int)(sizeof(index_names) / sizeof(index_names[0])); i++)
+    if (strcasecmp(name, index_names[i]) == 0)
+      return i;
+  return -1;
+}
+
+const char *cacheIndexName(int indexing) {
+  return index_names[indexing];
+}
+
 // print out summary stats for the cache
 void printSummary(const Cache *cache) {
-  printf("%s hits: %d, misses: %d, evictions: %d\n", cache->name, cache->hit_count,
-         cache->miss_count, cache->eviction_count);
-}
\ No newline at end of file
+  printf("%s hits: %llu, misses: %llu, evictions: %llu\n", cache->name, (unsigned long long)cache->hit_count,
+         (unsigned long long)cache->miss_count, (unsigned long long)cache->eviction_count);
+}
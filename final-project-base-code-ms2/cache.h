@@ -6,18 +6,22 @@
 #include <getopt.h>
 #include <math.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <stdio.h>
 #include "utils.h"
 #include "config.h"
+#include "prefetch.h"
+#include "replacement.h"
 enum status_enum {
   CACHE_MISS = 0,
   CACHE_HIT = 1,
   CACHE_EVICT = 2
 };
 
+// Default L1 parameters, they can be changed at runtime with -C/-F (see cache_config.h)
 #define CACHE_HIT_LATENCY 2    // hit latency
 #define CACHE_MISS_LATENCY MEM_LATENCY+CACHE_HIT_LATENCY  // miss latency
 #define CACHE_OTHER_LATENCY MEM_LATENCY+CACHE_HIT_LATENCY // eviction latency
@@ -26,31 +30,75 @@ enum status_enum {
 #define CACHE_BLOCK_BITS 6 // number of blocks (2^CACHE_BLOCK_BITS)
 #define CACHE_DISPLAY_TRACE false
 #define CACHE_LFU 1 // LRU
+#define CACHE_REPLACEMENT (CACHE_LFU ? REPL_LFU : REPL_LRU)
+
+// Write policy of a cache level
+enum write_policy_enum {
+  WRITE_BACK = 0,    // write-back + write-allocate, dirty lines written back on eviction
+  WRITE_THROUGH = 1  // write-through + no-write-allocate, stores always go to the next level
+};
+#define CACHE_WRITE_POLICY WRITE_BACK
+
+// Set index function of a cache level
+enum index_enum {
+  INDEX_MODULO = 0, // low-order bits of the block number
+  INDEX_XOR = 1,    // every higher group of block number bits XOR-folded onto the low ones
+  INDEX_PRIME = 2,  // block number modulo the largest prime not above the number of sets
+  INDEX_SKEWED = 3  // skewed-associative: each way indexes with its own hash
+};
+#define CACHE_INDEXING INDEX_MODULO
+
+#define CACHE_MAX_WAYS 64 // ways of a set are tracked in one 64-bit valid mask
+#define CACHE_MAX_SECTOR_BITS 6 // up to 64 sectors per line, one bit each in a 64-bit mask
+#define CACHE_REF_UNIT_BITS 6 // referenced bytes are counted in units of block / 2^CACHE_REF_UNIT_BITS, at least 4 B
 
 // Struct definitions
+
+// Cold per-line state, only read once the way is known. Tags, valid bits and
+// replacement ages live in the struct-of-arrays tag store of the Cache.
 typedef struct {
-    bool valid;
-    unsigned long long tag;
     unsigned long long block_addr;
-    int lru_clock;
-    int access_counter;
+    bool dirty; // modified since it was filled (write-back only)
+    bool prefetched; // brought in by the prefetcher and not referenced yet
+    bool displaced_demand; // the prefetch fill evicted a demand-fetched line
+    unsigned long long ready_cycle; // cycle the prefetched data arrives
+    uint64_t sectorValid; // sectored caches: sectors holding data
+    uint64_t sectorDirty; // sectored caches: sectors modified since they were filled
+    uint64_t referenced; // units of the line touched by demand accesses
 } Line;
 
 typedef struct {
+    // Tag store, all arrays carved out of one allocation and indexed [set * linesPerSet + way]
+    void *arena;
+    unsigned long long *tags;
+    uint64_t *ages; // per-line lru_clock stamp (LRU, LFU ties)
+    uint32_t *counts; // per-line access_counter (LFU)
+    uint64_t *valid; // per-set bit mask of valid ways
+    uint64_t *clocks; // per-set lru_clock, a skewed cache only uses clocks[0]
     Line *lines;
-    int lru_clock;
-} Set;
-
-typedef struct {
-    Set *sets;
-    int hit_count;
-    int miss_count;
-    int eviction_count;
-    int lfu;
+    uint64_t hit_count;
+    uint64_t miss_count;
+    uint64_t eviction_count;
+    uint64_t backinval_count; // lines removed by an inclusive lower level
+    uint64_t writeback_count; // dirty victims written to the next level
+    int writePolicy; // WRITE_BACK or WRITE_THROUGH
+    int replacement; // REPL_* policy, set together with the geometry before cacheSetUp
+    uint64_t replSeed; // seed of the random and BRRIP policies
+    Replacement repl;
+    int indexing; // INDEX_* function, set together with the geometry before cacheSetUp
+    unsigned long long primeSets; // sets in use with INDEX_PRIME
     bool displayTrace;
     int setBits;
     int linesPerSet;
     int blockBits;
+    int sectorBits; // log2 of the sectors per line, 0 = the whole line is fetched at once
+    int refShift; // log2 of the referenced-bytes unit
+    uint64_t sector_miss_count; // misses on a present line whose sector was not fetched
+    uint64_t bytes_fetched; // bytes brought in from the next level by demand misses and prefetches
+    uint64_t bytes_referenced; // distinct bytes of those lines touched by demand accesses
+    int hitLatency; // cycles to look up this level
+    uint64_t fillWays; // way partitioning: ways new blocks may go to, 0 = all
+    Prefetcher *prefetcher; // NULL when this level does not prefetch
     char *name;
 } Cache;
 
@@ -58,12 +106,18 @@ typedef struct {
     int status;
     unsigned long long insert_block_addr;
     unsigned long long victim_block_addr;
+    bool victim_dirty; // victim must be written back
+    bool write_around; // store miss that was not allocated (write-through)
+    int way; // way hit or filled, -1 if the block was not placed
+    bool sector_miss; // the line was present but the sector had to be fetched
+    int fill_bytes; // bytes to fetch from the next level on a miss
+    int victim_bytes; // bytes of the victim to write back when victim_dirty
 } result;
 
 // Function declarations
 void cacheSetUp(Cache *cache, char *name);
 void deallocate(Cache *cache);
-result operateCache(const unsigned long long address, Cache *cache);
+result operateCache(const unsigned long long address, bool is_write, Cache *cache);
 int processCacheOperation(unsigned long address, Cache *cache);
 unsigned long long address_to_block(const unsigned long long address, const Cache *cache);
 unsigned long long cache_tag(const unsigned long long address, const Cache *cache);
@@ -71,6 +125,14 @@ unsigned long long cache_set(const unsigned long long address, const Cache *cach
 bool probe_cache(const unsigned long long address, const Cache *cache);
 void hit_cacheline(const unsigned long long address, Cache *cache);
 bool insert_cacheline(const unsigned long long address, Cache *cache);
-unsigned long long victim_cacheline(const unsigned long long address, const Cache *cache);
+unsigned long long victim_cacheline(const unsigned long long address, Cache *cache);
 void replace_cacheline(const unsigned long long victim_block_addr, const unsigned long long insert_addr, Cache *cache);
+bool invalidate_cacheline(const unsigned long long address, Cache *cache, bool *was_dirty);
+result fill_cacheline(const unsigned long long address, bool dirty, Cache *cache);
+Line *find_cacheline(const unsigned long long address, Cache *cache);
+result prefetch_cacheline(const unsigned long long address, unsigned long long ready_cycle, Cache *cache);
+int cacheIndexParse(const char *name);
+const char *cacheIndexName(int indexing);
+void printSummary(const Cache *cache);
+void print_result(result r);
 #endif // CACHE_H
@@ -0,0 +1,434 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cache_config.h"
+
+/* Runtime cache configuration.
+ * Every setting is a "key=value" pair, given on the command line with -C or
+ * one per line in a config file given with -F ('#' starts a comment).
+ * Per-level keys are prefixed with the level name: l1i, l1d, l2 or l3.
+ */
+
+// Return log2 of value if it is a power of two, -1 otherwise
+static int log2_exact(unsigned long value) {
+  int bits = 0;
+  if (value == 0 || (value & (value - 1)) != 0)
+    return -1;
+  while ((1UL << bits) < value)
+    bits++;
+  return bits;
+}
+
+// Parse a non-negative number with an optional K or M suffix, -1 on error
+static long parse_size(const char *value) {
+  char *end;
+  long n = strtol(value, &end, 0);
+  if (end == value || n < 0)
+    return -1;
+  if (*end == 'k' || *end == 'K') {
+    n *= 1024;
+    end++;
+  } else if (*end == 'm' || *end == 'M') {
+    n *= 1024 * 1024;
+    end++;
+  }
+  if (*end == 'B' || *end == 'b')
+    end++;
+  return *end == '\0' ? n : -1;
+}
+
+static CacheParams *level_params(HierarchyParams *params, const char *level) {
+  if (strcmp(level, "l1i") == 0)
+    return &params->l1i;
+  if (strcmp(level, "l1d") == 0 || strcmp(level, "l1") == 0)
+    return &params->l1d;
+  if (strcmp(level, "l2") == 0)
+    return &params->l2;
+  if (strcmp(level, "l3") == 0)
+    return &params->l3;
+  return NULL;
+}
+
+/* Set one key of a cache level. A total size is only remembered here and turned
+ * into a number of sets by cacheConfigFinish, once associativity and block
+ * size are known, so the keys can come in any order.
+ */
+static int set_level_key(CacheParams *p, const char *key, const char *value) {
+  long n = parse_size(value);
+
+  if (strcmp(key, "enable") == 0) {
+    if (n != 0 && n != 1)
+      return -1;
+    p->enable = n;
+  } else if (strcmp(key, "size") == 0) {
+    if (n <= 0)
+      return -1;
+    p->sizeBytes = n;
+  } else if (strcmp(key, "sets") == 0) {
+    if (log2_exact(n) < 0)
+      return -1;
+    p->setBits = log2_exact(n);
+    p->sizeBytes = 0; // the last of size and sets wins
+  } else if (strcmp(key, "assoc") == 0 || strcmp(key, "ways") == 0) {
+    if (n <= 0)
+      return -1;
+    p->linesPerSet = n;
+  } else if (strcmp(key, "block") == 0) {
+    if (log2_exact(n) < 0)
+      return -1;
+    p->blockBits = log2_exact(n);
+  } else if (strcmp(key, "sectors") == 0) {
+    if (log2_exact(n) < 0 || log2_exact(n) > CACHE_MAX_SECTOR_BITS)
+      return -1;
+    p->sectorBits = log2_exact(n);
+  } else if (strcmp(key, "latency") == 0) {
+    if (n < 0)
+      return -1;
+    p->hitLatency = n;
+  } else if (strcmp(key, "policy") == 0) {
+    p->replacement = replacementParse(value);
+    if (p->replacement < 0)
+      return -1;
+  } else if (strcmp(key, "index") == 0) {
+    p->indexing = cacheIndexParse(value);
+    if (p->indexing < 0)
+      return -1;
+  } else if (strcmp(key, "write") == 0) {
+    if (strcmp(value, "writeback") == 0)
+      p->writePolicy = WRITE_BACK;
+    else if (strcmp(value, "writethrough") == 0)
+      p->writePolicy = WRITE_THROUGH;
+    else
+      return -1;
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+// One dram.<key> setting, -1 on an unknown key or a bad value
+static int set_dram_key(DramParams *d, const char *key, const char *value) {
+  long n = parse_size(value);
+
+  if (strcmp(key, "channels") == 0)
+    d->channels = n;
+  else if (strcmp(key, "banks") == 0)
+    d->banks = n;
+  else if (strcmp(key, "row") == 0)
+    d->rowBytes = n;
+  else if (strcmp(key, "tcas") == 0)
+    d->tCAS = n;
+  else if (strcmp(key, "trcd") == 0)
+    d->tRCD = n;
+  else if (strcmp(key, "trp") == 0)
+    d->tRP = n;
+  else if (strcmp(key, "bus") == 0)
+    d->busBytes = n;
+  else if (strcmp(key, "ratio") == 0)
+    d->clockRatio = n;
+  else if (strcmp(key, "queue") == 0)
+    d->queueSize = n;
+  else
+    return -1;
+  return n < 1 ? -1 : 0;
+}
+
+static TlbGeometry *tlb_geometry(TlbParams *t, const char *name) {
+  if (strcmp(name, "itlb") == 0)
+    return &t->itlb;
+  if (strcmp(name, "dtlb") == 0)
+    return &t->dtlb;
+  if (strcmp(name, "l2") == 0)
+    return &t->l2;
+  return NULL;
+}
+
+/* One tlb.<key> setting: tlb.<itlb|dtlb|l2>[.assoc], tlb.l2.latency,
+ * tlb.superpages or tlb.pagetable. -1 on an unknown key or a bad value.
+ */
+static int set_tlb_key(TlbParams *t, const char *key, const char *value) {
+  char name[8];
+  const char *dot = strchr(key, '.');
+  size_t len = dot != NULL ? (size_t)(dot - key) : strlen(key);
+  long n = parse_size(value);
+  TlbGeometry *g = NULL;
+
+  if (len < sizeof(name)) {
+    memcpy(name, key, len);
+    name[len] = '\0';
+    g = tlb_geometry(t, name);
+  }
+  if (g != NULL && dot == NULL)
+    g->entries = n;
+  else if (g != NULL && strcmp(dot, ".assoc") == 0)
+    g->ways = n;
+  else if (strcmp(key, "l2.latency") == 0)
+    t->l2Latency = n;
+  else if (strcmp(key, "superpages") == 0 && n <= 1)
+    t->superpages = n;
+  else if (strcmp(key, "pagetable") == 0)
+    t->pageTable = n;
+  else
+    return -1;
+  return n < 0 ? -1 : 0;
+}
+
+/* Apply one setting. Returns 0 on success, -1 (after printing why) on an
+ * unknown key or a bad value.
+ */
+int cacheConfigSet(HierarchyParams *params, const char *key, const char *value) {
+  char level[8];
+  const char *dot = strchr(key, '.');
+  CacheParams *p = NULL;
+  int status = -1;
+
+  if (dot != NULL && (size_t)(dot - key) < sizeof(level)) {
+    memcpy(level, key, dot - key);
+    level[dot - key] = '\0';
+    p = level_params(params, level);
+  }
+
+  if (p != NULL) {
+    status = set_level_key(p, dot + 1, value);
+  } else if (strcmp(key, "inclusion") == 0) {
+    status = 0;
+    if (strcmp(value, "nine") == 0)
+      params->inclusion = INCLUSION_NINE;
+    else if (strcmp(value, "inclusive") == 0)
+      params->inclusion = INCLUSION_INCLUSIVE;
+    else if (strcmp(value, "exclusive") == 0)
+      params->inclusion = INCLUSION_EXCLUSIVE;
+    else
+      status = -1;
+  } else if (strcmp(key, "victim.entries") == 0) {
+    params->victimEntries = parse_size(value);
+    status = (params->victimEntries < 0 || params->victimEntries > CONFIG_MAX_WAYS) ? -1 : 0;
+  } else if (strcmp(key, "victim.latency") == 0) {
+    params->victimLatency = parse_size(value);
+    status = params->victimLatency < 1 ? -1 : 0;
+  } else if (strcmp(key, "waypred") == 0) {
+    params->l1Timing.wayPred = wayPredParse(value);
+    status = params->l1Timing.wayPred < 0 ? -1 : 0;
+  } else if (strcmp(key, "waypred.entries") == 0) {
+    params->l1Timing.pcEntries = parse_size(value);
+    status = params->l1Timing.pcEntries < 1 ? -1 : 0;
+  } else if (strcmp(key, "waypred.fast") == 0) {
+    params->l1Timing.fastLatency = parse_size(value);
+    status = params->l1Timing.fastLatency < 1 ? -1 : 0;
+  } else if (strcmp(key, "waypred.penalty") == 0) {
+    params->l1Timing.penalty = parse_size(value);
+    status = params->l1Timing.penalty < 0 ? -1 : 0;
+  } else if (strcmp(key, "banks") == 0) {
+    params->l1Timing.banks = parse_size(value);
+    status = (params->l1Timing.banks < 1 || params->l1Timing.banks > L1_MAX_BANKS) ? -1 : 0;
+  } else if (strcmp(key, "banks.busy") == 0) {
+    params->l1Timing.bankBusy = parse_size(value);
+    status = params->l1Timing.bankBusy < 1 ? -1 : 0;
+  } else if (strcmp(key, "mem_bus") == 0) {
+    long n = parse_size(value);
+    status = n < 0 ? -1 : 0;
+    params->memBusBytes = n;
+  } else if (strcmp(key, "mem") == 0) {
+    status = 0;
+    if (strcmp(value, "fixed") == 0)
+      params->dram.enable = false;
+    else if (strcmp(value, "dram") == 0)
+      params->dram.enable = true;
+    else
+      status = -1;
+  } else if (strcmp(key, "tlb") == 0) {
+    long n = parse_size(value);
+    status = (n < 0 || n > 1) ? -1 : 0;
+    params->tlb.enable = n;
+  } else if (strncmp(key, "tlb.", 4) == 0) {
+    status = set_tlb_key(&params->tlb, key + 4, value);
+  } else if (strncmp(key, "dram.", 5) == 0) {
+    status = set_dram_key(&params->dram, key + 5, value);
+  } else if (strcmp(key, "mem_latency") == 0) {
+    long n = parse_size(value);
+    status = n < 0 ? -1 : 0;
+    params->memLatency = n;
+  } else if (strcmp(key, "replacement.seed") == 0) {
+    long n = parse_size(value);
+    status = n <= 0 ? -1 : 0;
+    params->replSeed = n;
+  } else if (strcmp(key, "prefetch") == 0) {
+    params->prefetch.kind = prefetchParseKind(value);
+    status = params->prefetch.kind < 0 ? -1 : 0;
+  } else if (strcmp(key, "prefetch.degree") == 0) {
+    params->prefetch.degree = parse_size(value);
+    status = (params->prefetch.degree < 1 || params->prefetch.degree > PREFETCH_MAX_DEPTH) ? -1 : 0;
+  } else if (strcmp(key, "prefetch.rpt") == 0) {
+    params->prefetch.rptEntries = parse_size(value);
+    status = params->prefetch.rptEntries < 1 ? -1 : 0;
+  } else if (strcmp(key, "prefetch.streams") == 0) {
+    params->prefetch.streams = parse_size(value);
+    status = params->prefetch.streams < 1 ? -1 : 0;
+  } else if (strcmp(key, "prefetch.depth") == 0) {
+    params->prefetch.streamDepth = parse_size(value);
+    status = (params->prefetch.streamDepth < 1 || params->prefetch.streamDepth > PREFETCH_MAX_DEPTH) ? -1 : 0;
+  }
+
+  if (status != 0)
+    fprintf(stderr, "Error - bad cache setting %s=%s\n", key, value);
+  return status;
+}
+
+// Apply a "key=value" string from the command line
+int cacheConfigOption(HierarchyParams *params, const char *option) {
+  char key[CACHE_CONFIG_MAX_LINE];
+  const char *eq = strchr(option, '=');
+
+  if (eq == NULL || (size_t)(eq - option) >= sizeof(key)) {
+    fprintf(stderr, "Error - cache setting %s is not key=value\n", option);
+    return -1;
+  }
+  memcpy(key, option, eq - option);
+  key[eq - option] = '\0';
+  return cacheConfigSet(params, key, eq + 1);
+}
+
+// Trim leading and trailing white space in place
+static char *trim(char *s) {
+  while (isspace((unsigned char)*s))
+    s++;
+  char *end = s + strlen(s);
+  while (end > s && isspace((unsigned char)end[-1]))
+    end--;
+  *end = '\0';
+  return s;
+}
+
+// Read "key = value" lines from a config file
+int cacheConfigLoad(HierarchyParams *params, const char *path) {
+  char line[CACHE_CONFIG_MAX_LINE];
+  int lineno = 0;
+  FILE *file = fopen(path, "r");
+
+  if (file == NULL) {
+    fprintf(stderr, "Error - cannot open cache config %s\n", path);
+    return -1;
+  }
+  while (fgets(line, sizeof(line), file) != NULL) {
+    lineno++;
+    char *hash = strchr(line, '#');
+    if (hash != NULL)
+      *hash = '\0';
+    char *text = trim(line);
+    if (*text == '\0')
+      continue;
+
+    char *eq = strchr(text, '=');
+    if (eq == NULL) {
+      fprintf(stderr, "Error - %s:%d: expected key = value\n", path, lineno);
+      fclose(file);
+      return -1;
+    }
+    *eq = '\0';
+    if (cacheConfigSet(params, trim(text), trim(eq + 1)) != 0) {
+      fprintf(stderr, "Error - in %s:%d\n", path, lineno);
+      fclose(file);
+      return -1;
+    }
+  }
+  fclose(file);
+  return 0;
+}
+
+static int finish_tlb(const char *name, const TlbGeometry *g) {
+  if (g->ways < 1 || g->ways > CONFIG_MAX_WAYS || g->entries % g->ways != 0 ||
+      log2_exact(g->entries / g->ways) < 0) {
+    fprintf(stderr, "Error - %s: %d entries are not a power of two number of sets of 1 to %d ways\n",
+            name, g->entries, CONFIG_MAX_WAYS);
+    return -1;
+  }
+  return 0;
+}
+
+static int finish_level(const char *name, CacheParams *p) {
+  if (!p->enable)
+    return 0;
+
+  // total bytes = 2^setBits * ways * 2^blockBits
+  if (p->sizeBytes > 0) {
+    long lineBytes = (long)p->linesPerSet << p->blockBits;
+    if (p->sizeBytes % lineBytes != 0 || log2_exact(p->sizeBytes / lineBytes) < 0) {
+      fprintf(stderr, "Error - %s: size %ld is not a power of two number of %d-way sets of %d bytes\n",
+              name, p->sizeBytes, p->linesPerSet, 1 << p->blockBits);
+      return -1;
+    }
+    p->setBits = log2_exact(p->sizeBytes / lineBytes);
+  }
+
+  if (p->setBits < 0 || p->setBits > CONFIG_MAX_SET_BITS) {
+    fprintf(stderr, "Error - %s: at most %d sets\n", name, 1 << CONFIG_MAX_SET_BITS);
+    return -1;
+  }
+  if (p->linesPerSet < 1 || p->linesPerSet > CONFIG_MAX_WAYS) {
+    fprintf(stderr, "Error - %s: associativity must be 1 to %d\n", name, CONFIG_MAX_WAYS);
+    return -1;
+  }
+  if (p->blockBits < CONFIG_MIN_BLOCK_BITS || p->blockBits > CONFIG_MAX_BLOCK_BITS) {
+    fprintf(stderr, "Error - %s: block size must be %d to %d bytes\n", name,
+            1 << CONFIG_MIN_BLOCK_BITS, 1 << CONFIG_MAX_BLOCK_BITS);
+    return -1;
+  }
+  if (p->blockBits - p->sectorBits < CONFIG_MIN_BLOCK_BITS) {
+    fprintf(stderr, "Error - %s: sectors must be at least %d bytes\n", name, 1 << CONFIG_MIN_BLOCK_BITS);
+    return -1;
+  }
+  if (p->indexing == INDEX_SKEWED && p->replacement != REPL_LRU && p->replacement != REPL_LFU) {
+    fprintf(stderr, "Error - %s: skewed indexing needs lru or lfu replacement\n", name);
+    return -1;
+  }
+  if (p->hitLatency < 1) {
+    fprintf(stderr, "Error - %s: hit latency must be at least 1 cycle\n", name);
+    return -1;
+  }
+  return 0;
+}
+
+/* Resolve sizes into set counts and check every enabled level once all settings
+ * are in; hierarchySetUp then checks how the levels fit together.
+ */
+int cacheConfigFinish(HierarchyParams *params) {
+  if (finish_level("l1i", &params->l1i) || finish_level("l1d", &params->l1d) ||
+      finish_level("l2", &params->l2) || finish_level("l3", &params->l3))
+    return -1;
+  if (params->memLatency < 0) {
+    fprintf(stderr, "Error - memory latency must not be negative\n");
+    return -1;
+  }
+  if (params->tlb.enable && (finish_tlb("itlb", &params->tlb.itlb) || finish_tlb("dtlb", &params->tlb.dtlb) ||
+                             finish_tlb("l2 tlb", &params->tlb.l2)))
+    return -1;
+  if (params->dram.rowBytes < CACHE_WORD_BYTES || params->dram.queueSize > DRAM_MAX_QUEUE) {
+    fprintf(stderr, "Error - dram: rows of at least %d bytes, at most %d queued writes\n",
+            CACHE_WORD_BYTES, DRAM_MAX_QUEUE);
+    return -1;
+  }
+  return 0;
+}
+
+void cacheConfigUsage(void) {
+  fprintf(stderr,
+          "Cache settings (-C key=value, or key = value lines in a -F file):\n"
+          "  <level>.enable=0|1   <level>.size=BYTES   <level>.sets=N   <level>.assoc=N\n"
+          "  <level>.block=BYTES  <level>.sectors=N  <level>.latency=CYCLES\n"
+          "  <level>.policy=lru|lfu|fifo|random|plru|srrip|brrip|drrip\n"
+          "  <level>.index=modulo|xor|prime|skewed   <level>.write=writeback|writethrough\n"
+          "  (level: l1i, l1d, l2, l3)\n"
+          "  inclusion=nine|inclusive|exclusive   mem_latency=CYCLES   mem_bus=BYTES/CYCLE\n"
+          "  replacement.seed=N\n"
+          "  prefetch=none|nextline|stride|stream  prefetch.degree=N  prefetch.rpt=N\n"
+          "  prefetch.streams=N  prefetch.depth=N\n"
+          "  victim.entries=N (0 = none)  victim.latency=CYCLES\n"
+          "  waypred=none|mru|pc  waypred.entries=N  waypred.fast=CYCLES  waypred.penalty=CYCLES\n"
+          "  banks=N  banks.busy=CYCLES   (L1D way prediction and banking)\n"
+          "  mem=fixed|dram  dram.channels=N  dram.banks=N  dram.row=BYTES  dram.tcas=N\n"
+          "  dram.trcd=N  dram.trp=N  dram.bus=BYTES/CYCLE  dram.ratio=N  dram.queue=N\n"
+          "  (dram timings in memory cycles, ratio = core cycles per memory cycle)\n"
+          "  tlb=0|1  tlb.itlb=N  tlb.dtlb=N  tlb.l2=N  tlb.<itlb|dtlb|l2>.assoc=N\n"
+          "  tlb.l2.latency=CYCLES  tlb.superpages=0|1  tlb.pagetable=ADDRESS   (Sv32 translation)\n");
+}
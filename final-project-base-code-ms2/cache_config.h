@@ -0,0 +1,20 @@
+#ifndef CACHE_CONFIG_H
+#define CACHE_CONFIG_H
+
+#include "hierarchy.h"
+
+#define CACHE_CONFIG_MAX_LINE 256
+
+// Limits accepted for runtime cache geometry
+#define CONFIG_MAX_SET_BITS 20
+#define CONFIG_MAX_WAYS 64
+#define CONFIG_MIN_BLOCK_BITS 2
+#define CONFIG_MAX_BLOCK_BITS 12
+
+int cacheConfigSet(HierarchyParams *params, const char *key, const char *value);
+int cacheConfigOption(HierarchyParams *params, const char *option);
+int cacheConfigLoad(HierarchyParams *params, const char *path);
+int cacheConfigFinish(HierarchyParams *params);
+void cacheConfigUsage(void);
+
+#endif // CACHE_CONFIG_H
@@ -0,0 +1,153 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cache.h"
+#include "cache_config.h"
+#include "hierarchy.h"
+#include "stackdist.h"
+#include "trace.h"
+
+/* Trace-driven cache simulator: feeds a memory access trace through the same
+ * cache hierarchy the pipeline uses and prints its statistics.
+ */
+
+#define CACHESIM_WRITE_BUFFER 4096 // accesses buffered before a binary write
+
+static const char type_names[] = {'L', 'S', 'I'};
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "Usage: %s [-v] [-A] [-s <s>] [-E <E>] [-b <b>] [-C key=value] [-F file] [-w out] -t <tracefile>\n"
+          "  -t  trace: valgrind lackey text or the binary format written by -w\n"
+          "  -v  print the result of every access\n"
+          "  -s/-E/-b  L1 set bits, lines per set and block bits\n"
+          "  -A  also print stack distance miss ratios for every size\n"
+          "  -w  write the accesses to a binary trace\n",
+          name);
+  cacheConfigUsage();
+}
+
+int main(int argc, char **argv) {
+  HierarchyParams params;
+  const char *trace_path = NULL, *write_path = NULL;
+  bool verbose = false, stackdist_en = false;
+  int c;
+
+  hierarchyDefaultParams(&params);
+  while ((c = getopt(argc, argv, "vAs:E:b:C:F:w:t:h")) != -1) {
+    switch (c) {
+    case 'v':
+      verbose = true; break;
+    case 'A':
+      stackdist_en = true; break;
+    case 's': {
+      // sets are given as bits here, as in the trace-driven cache lab
+      char sets[32];
+      snprintf(sets, sizeof(sets), "%lu", 1UL << atoi(optarg));
+      if (cacheConfigSet(&params, "l1d.sets", sets) != 0)
+        return -1;
+      break;
+    }
+    case 'E':
+      if (cacheConfigSet(&params, "l1d.assoc", optarg) != 0)
+        return -1;
+      break;
+    case 'b': {
+      char block[32];
+      snprintf(block, sizeof(block), "%lu", 1UL << atoi(optarg));
+      if (cacheConfigSet(&params, "l1d.block", block) != 0)
+        return -1;
+      break;
+    }
+    case 'C':
+      if (cacheConfigOption(&params, optarg) != 0) {
+        cacheConfigUsage();
+        return -1;
+      }
+      break;
+    case 'F':
+      if (cacheConfigLoad(&params, optarg) != 0) {
+        cacheConfigUsage();
+        return -1;
+      }
+      break;
+    case 'w':
+      write_path = optarg; break;
+    case 't':
+      trace_path = optarg; break;
+    default:
+      usage(argv[0]);
+      return -1;
+    }
+  }
+  if (trace_path == NULL) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  CacheHierarchy hierarchy;
+  if (cacheConfigFinish(&params) != 0 || hierarchySetUp(&hierarchy, &params) != 0)
+    return -1;
+
+  StackDist stackdist;
+  if (stackdist_en) {
+    stackDistSetUp(&stackdist, params.l1d.blockBits, SD_MAX_SET_BITS);
+    hierarchy.stackdist = &stackdist;
+  }
+
+  TraceReader reader;
+  if (traceOpen(&reader, trace_path) != 0)
+    return -1;
+
+  FILE *out = NULL;
+  uint64_t buffer[CACHESIM_WRITE_BUFFER];
+  int buffered = 0;
+  if (write_path != NULL) {
+    out = fopen(write_path, "wb");
+    if (out == NULL) {
+      fprintf(stderr, "Error - cannot write trace %s\n", write_path);
+      return -1;
+    }
+    fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_LEN, out);
+  }
+
+  TraceAccess access;
+  while (traceNext(&reader, &access)) {
+    if (out != NULL) {
+      buffer[buffered++] = traceEncode(access.address, access.type);
+      if (buffered == CACHESIM_WRITE_BUFFER) {
+        fwrite(buffer, sizeof(buffer[0]), buffered, out);
+        buffered = 0;
+      }
+    }
+    // without an L1I the pipeline only translates its fetches, as here
+    if (access.type == ACCESS_FETCH && !hierarchy.hasL1I) {
+      if (hierarchy.hasTlb)
+        hierarchyTranslateFetch(&hierarchy, access.address, access.cycle);
+      continue;
+    }
+
+    result r;
+    hierarchyAccess(&hierarchy, access.address, access.pc, access.cycle, access.type, &r);
+    if (verbose) {
+      printf("%c %llx", type_names[access.type], access.address);
+      print_result(r);
+      printf("\n");
+    }
+  }
+  traceClose(&reader);
+  if (out != NULL) {
+    fwrite(buffer, sizeof(buffer[0]), buffered, out);
+    fclose(out);
+  }
+
+  printf("Accesses: %llu\n", (unsigned long long)reader.count);
+  printHierarchySummary(&hierarchy);
+  if (stackdist_en) {
+    printStackDistSummary(&stackdist);
+    stackDistDeallocate(&stackdist);
+  }
+  hierarchyDeallocate(&hierarchy);
+  return 0;
+}
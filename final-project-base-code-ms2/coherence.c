@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "coherence.h"
+
+static void *checked_calloc(size_t count, size_t size) {
+  void *p = calloc(count, size);
+  if (p == NULL) {
+    fprintf(stderr, "Error - out of memory for the coherence directory\n");
+    exit(EXIT_FAILURE);
+  }
+  return p;
+}
+
+static uint64_t hash_slot(unsigned long long key, uint64_t size) {
+  unsigned long long h = key * 0x9E3779B97F4A7C15ULL;
+  return (h ^ (h >> 32)) & (size - 1);
+}
+
+static uint64_t find_slot(const Coherence *c, unsigned long long block) {
+  uint64_t s = hash_slot(block, c->size);
+  while (c->used[s] && c->entries[s].block != block)
+    s = (s + 1) & (c->size - 1);
+  return s;
+}
+
+static void grow(Coherence *c) {
+  DirEntry *oldEntries = c->entries;
+  bool *oldUsed = c->used;
+  uint64_t oldSize = c->size;
+
+  c->size *= 2;
+  c->entries = checked_calloc(c->size, sizeof(DirEntry));
+  c->used = checked_calloc(c->size, sizeof(bool));
+  for (uint64_t i = 0; i < oldSize; i++) {
+    if (!oldUsed[i])
+      continue;
+    uint64_t s = find_slot(c, oldEntries[i].block);
+    c->entries[s] = oldEntries[i];
+    c->used[s] = true;
+  }
+  free(oldEntries);
+  free(oldUsed);
+}
+
+// Entry of a block, created uncached on first use
+static DirEntry *entry(Coherence *c, unsigned long long block) {
+  uint64_t s = find_slot(c, block);
+  if (c->used[s])
+    return &c->entries[s];
+  if ((c->count + 1) * 2 > c->size) {
+    grow(c);
+    s = find_slot(c, block);
+  }
+  c->used[s] = true;
+  c->count++;
+  memset(&c->entries[s], 0, sizeof(DirEntry));
+  c->entries[s].block = block;
+  c->entries[s].owner = -1;
+  return &c->entries[s];
+}
+
+void coherenceSetUp(Coherence *c, int cores, int blockBits, int latency) {
+  memset(c, 0, sizeof(*c));
+  c->cores = cores;
+  c->blockBits = blockBits;
+  c->unitShift = blockBits > 6 + 2 ? blockBits - 6 : 2; // 64 units, at least a word each
+  c->latency = latency;
+  c->size = COHERENCE_HASH_INITIAL;
+  c->entries = checked_calloc(c->size, sizeof(DirEntry));
+  c->used = checked_calloc(c->size, sizeof(bool));
+}
+
+void coherenceDeallocate(Coherence *c) {
+  free(c->entries);
+  free(c->used);
+  c->entries = NULL;
+  c->used = NULL;
+}
+
+/* Data access of `core` to address, asked before its own L1D is accessed.
+ * Removes or downgrades the copies of the other cores as MESI requires and
+ * records the core as a sharer. Dirty data taken from another core is written
+ * to the shared level through writeback. Returns the added latency.
+ */
+int coherenceAccess(Coherence *c, int core, unsigned long long address, bool write,
+                    coherence_writeback_fn writeback, void *ctx) {
+  unsigned long long block = address >> c->blockBits;
+  unsigned long long block_addr = block << c->blockBits;
+  int bytes = 1 << c->blockBits;
+  uint64_t unit = 1ULL << ((address & (bytes - 1)) >> c->unitShift);
+  uint32_t me = 1u << core;
+  bool present = probe_cache(address, c->l1[core]);
+  DirEntry *e = entry(c, block);
+  bool remote = false;
+  int latency = 0;
+
+  if (present && (!write || e->owner == core)) {
+    e->touched[core] |= unit; // S, E or M read, or a store to E/M: silent
+    return 0;
+  }
+  c->stats.requests++;
+  if (!present) {
+    e->touched[core] = 0;
+    if (e->lost & me) {
+      e->lost &= ~me;
+      e->coherence_misses++;
+      c->stats.coherence_misses++;
+    }
+  }
+
+  if (write) {
+    uint32_t others = e->sharers & ~me;
+    if (present && others) {
+      e->upgrades++;
+      c->stats.upgrades++;
+    }
+    for (int d = 0; d < c->cores; d++) {
+      if (!(others & (1u << d)))
+        continue;
+      bool dirty = false;
+      invalidate_cacheline(block_addr, c->l1[d], &dirty);
+      if (dirty) {
+        c->stats.transfers++;
+        c->stats.writebacks++;
+        latency += writeback(ctx, block_addr, bytes);
+      }
+      if (!(e->touched[d] & unit)) {
+        e->false_sharing++;
+        c->stats.false_sharing++;
+      }
+      e->touched[d] = 0;
+      e->lost |= 1u << d;
+      e->invalidations++;
+      c->stats.invalidations++;
+      remote = true;
+    }
+    e->sharers = me;
+    e->owner = core;
+  } else {
+    if (e->owner >= 0 && e->owner != core) {
+      Line *line = find_cacheline(block_addr, c->l1[e->owner]);
+      if (line != NULL && line->dirty) {
+        line->dirty = false;
+        line->sectorDirty = 0;
+        c->stats.transfers++;
+        c->stats.writebacks++;
+        latency += writeback(ctx, block_addr, bytes);
+      }
+      c->stats.downgrades++;
+      remote = true;
+    }
+    e->owner = (e->sharers & ~me) || remote ? -1 : core; // E when nobody else has it
+    e->sharers |= me;
+  }
+  e->touched[core] |= unit;
+  return remote ? latency + c->latency : latency;
+}
+
+// `core` evicted the block from its L1D
+void coherenceEvict(Coherence *c, int core, unsigned long long block_addr) {
+  DirEntry *e = entry(c, block_addr >> c->blockBits);
+  e->sharers &= ~(1u << core);
+  e->touched[core] = 0;
+  if (e->owner == core)
+    e->owner = -1;
+}
+
+static uint64_t line_events(const DirEntry *e) {
+  return (uint64_t)e->invalidations + e->coherence_misses + e->upgrades;
+}
+
+// most coherence events first, then by address
+static int compare_lines(const void *a, const void *b) {
+  const DirEntry *x = *(const DirEntry *const *)a, *y = *(const DirEntry *const *)b;
+  uint64_t ex = line_events(x), ey = line_events(y);
+  if (ex != ey)
+    return ex < ey ? 1 : -1;
+  return x->block < y->block ? -1 : x->block > y->block;
+}
+
+void printCoherenceSummary(const Coherence *c) {
+  const CoherenceStats *s = &c->stats;
+
+  printf("MESI directory (%d cores, %d B blocks, %d cycles per remote action)\n", c->cores,
+         1 << c->blockBits, c->latency);
+  printf("Coherence requests: %llu, invalidations: %llu, downgrades: %llu, dirty transfers: %llu\n",
+         (unsigned long long)s->requests, (unsigned long long)s->invalidations,
+         (unsigned long long)s->downgrades, (unsigned long long)s->transfers);
+  printf("Upgrade misses: %llu, coherence misses: %llu, false sharing invalidations: %llu\n",
+         (unsigned long long)s->upgrades, (unsigned long long)s->coherence_misses,
+         (unsigned long long)s->false_sharing);
+
+  const DirEntry **order = checked_calloc(c->count ? c->count : 1, sizeof(DirEntry *));
+  uint64_t n = 0;
+  for (uint64_t i = 0; i < c->size; i++)
+    if (c->used[i] && line_events(&c->entries[i]) > 0)
+      order[n++] = &c->entries[i];
+  qsort(order, n, sizeof(order[0]), compare_lines);
+
+  if (n > 0)
+    printf("%-10s %8s %8s %8s %8s  false sharing\n", "line", "inval", "fs", "upgrade", "coh-miss");
+  for (uint64_t i = 0; i < n && i < COHERENCE_REPORT_LINES; i++) {
+    const DirEntry *e = order[i];
+    printf("%08llx   %8u %8u %8u %8u  %s\n", e->block << c->blockBits, e->invalidations,
+           e->false_sharing, e->upgrades, e->coherence_misses,
+           e->false_sharing * 2 > e->invalidations ? "likely" : "");
+  }
+  free(order);
+}
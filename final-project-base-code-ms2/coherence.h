@@ -0,0 +1,74 @@
+#ifndef COHERENCE_H
+#define COHERENCE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "cache.h"
+
+#define MC_MAX_CORES 16
+#define COHERENCE_LATENCY 10  // cycles of a directory transaction that involves another core
+#define COHERENCE_HASH_INITIAL 1024
+#define COHERENCE_REPORT_LINES 10 // lines listed in the summary
+
+// MESI state of a block in one core's L1D, as the directory sees it
+enum mesi_enum {
+  MESI_I = 0,
+  MESI_S = 1,
+  MESI_E = 2,
+  MESI_M = 3
+};
+
+// Directory entry of one block
+typedef struct {
+  unsigned long long block;
+  uint32_t sharers;  // cores holding the block
+  int8_t owner;      // core holding it in E or M, -1 if shared or uncached
+  uint32_t lost;     // cores that lost the block to an invalidation and have not missed on it yet
+  uint64_t touched[MC_MAX_CORES]; // units of the block each core accessed since it got it
+  // per-line stats
+  uint32_t invalidations;
+  uint32_t false_sharing; // invalidations of a core that never touched the unit being written
+  uint32_t upgrades;      // stores to a shared copy
+  uint32_t coherence_misses;
+} DirEntry;
+
+typedef struct {
+  uint64_t requests;      // accesses that needed the directory
+  uint64_t invalidations; // copies removed from other L1Ds
+  uint64_t downgrades;    // E/M copies turned into S by another core's read
+  uint64_t transfers;     // dirty data supplied by another L1D
+  uint64_t upgrades;      // stores that hit a shared copy
+  uint64_t coherence_misses; // misses on blocks lost to invalidations
+  uint64_t false_sharing;
+  uint64_t writebacks;    // dirty data written to the shared level by downgrades and invalidations
+} CoherenceStats;
+
+// Writes a block a coherence action made clean to the shared level, returns its latency
+typedef int (*coherence_writeback_fn)(void *ctx, unsigned long long block_addr, int bytes);
+
+/* MESI directory over the private L1Ds of the cores of a multicore run. Every
+ * data access of a core asks it first: a read miss downgrades an E/M owner to
+ * S, a store invalidates every other copy. Evictions are reported so the
+ * directory knows the sharers exactly. Blocks are tracked at the L1D block size.
+ */
+typedef struct {
+  int cores;
+  int blockBits;
+  int unitShift; // log2 of the bytes per bit of DirEntry.touched
+  int latency;
+  Cache *l1[MC_MAX_CORES];
+  DirEntry *entries;
+  bool *used;
+  uint64_t size;
+  uint64_t count;
+  CoherenceStats stats;
+} Coherence;
+
+void coherenceSetUp(Coherence *c, int cores, int blockBits, int latency);
+void coherenceDeallocate(Coherence *c);
+int coherenceAccess(Coherence *c, int core, unsigned long long address, bool write,
+                    coherence_writeback_fn writeback, void *ctx);
+void coherenceEvict(Coherence *c, int core, unsigned long long block_addr);
+void printCoherenceSummary(const Coherence *c);
+
+#endif // COHERENCE_H
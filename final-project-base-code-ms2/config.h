@@ -2,6 +2,8 @@
 #define __CONFIG_H__
 
 // For each test, uncomment all its macros, and disable all other macros.
+// The output macros (DEBUG_*, PRINT_*) are only the default of -D, which picks
+// regs, cycle, stats, cachetrace and cachestats at run time.
 
 // required for MS1 (test_simulator_ms1.sh)
 // #define DEBUG_REG_TRACE	// prints the register trace
@@ -23,8 +25,21 @@
 // #define DEBUG_CYCLE
 // #define PRINT_STATS
 // #define MEM_LATENCY 100
-// #define CACHE_ENABLE 		// enable cache simulation
+// #define CACHE_ENABLE 		// enable cache simulation (-c at run time)
 // #define PRINT_CACHE_TRACES      // prints cache trace for each memory access 
 // #define PRINT_CACHE_STATS	// prints the cache stats at the end of program
 
+// optional cache hierarchy levels (used together with -c, see hierarchy.h)
+// #define CACHE_L1I_ENABLE	// separate L1 instruction cache for fetches
+// #define CACHE_L2_ENABLE	// unified L2 behind the L1s
+// #define CACHE_L3_ENABLE	// L3 behind the L2
+// #define CACHE_VICTIM_ENTRIES 8	// fully associative victim cache next to the L1D
+// #define CACHE_INCLUSION INCLUSION_INCLUSIVE	// INCLUSION_NINE (default), _INCLUSIVE or _EXCLUSIVE
+// #define TLB_ENABLE		// Sv32 TLBs and page walks in front of the L1s (see tlb.h)
+// #define MEM_DRAM		// banked DRAM behind the caches instead of the fixed MEM_LATENCY (see dram.h)
+
+// multi-cycle RV32M units (see pipeline.h), also settable with -U mul,div
+// #define MUL_LATENCY 3	// pipelined multiplier
+// #define DIV_LATENCY 32	// iterative divider with early out
+
 #endif // __CONFIG_H__
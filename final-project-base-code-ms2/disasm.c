@@ -25,6 +25,7 @@ void write_itype_except_load(Instruction);
 void write_load(Instruction);
 void write_store(Instruction);
 void write_branch(Instruction);
+void write_amo(Instruction);
 
 
 
@@ -66,6 +67,9 @@ void decode_instruction(uint32_t instruction_bits) {
         case 0x73:
             print_ecall(instruction);
             break;
+        case 0x2F:
+            write_amo(instruction);
+            break;
         default: // undefined opcode
             handle_invalid_instruction(instruction);
             break;
@@ -113,6 +117,9 @@ void write_rtype(Instruction instruction) {
                 case 0x00:
                     print_rtype("slt", instruction);
                     break;
+                case 0x01:
+                    print_rtype("mulhsu", instruction);
+                    break;
                 default:
                     handle_invalid_instruction(instruction);
                     break;
@@ -120,6 +127,20 @@ void write_rtype(Instruction instruction) {
             }
             break;
 
+        case 0x3:
+            switch (instruction.rtype.funct7){
+                case 0x00:
+                    print_rtype("sltu", instruction);
+                    break;
+                case 0x01:
+                    print_rtype("mulhu", instruction);
+                    break;
+                default:
+                    handle_invalid_instruction(instruction);
+                    break;
+            }
+            break;
+
         case 0x4:
             switch(instruction.rtype.funct7){
                 case 0x00:
@@ -142,6 +163,9 @@ void write_rtype(Instruction instruction) {
                 case 0x20:
                     print_rtype("sra", instruction);
                     break;
+                case 0x01:
+                    print_rtype("divu", instruction);
+                    break;
                 default:
                     handle_invalid_instruction(instruction);
                     break;
@@ -167,6 +191,9 @@ void write_rtype(Instruction instruction) {
                 case 0x00:
                     print_rtype("and", instruction);
                     break;
+                case 0x01:
+                    print_rtype("remu", instruction);
+                    break;
                 default:
                 handle_invalid_instruction(instruction);
                 break;
@@ -294,6 +321,35 @@ void write_branch(Instruction instruction) {
 }
 
 
+// RV32A, the aq/rl bits are not printed
+void write_amo(Instruction instruction) {
+    char *name;
+
+    if (instruction.rtype.funct3 != 0x2) {
+        handle_invalid_instruction(instruction);
+        return;
+    }
+    switch (instruction.rtype.funct7 >> 2) {
+        case 0x02:
+            printf(LR_FORMAT, instruction.rtype.rd, instruction.rtype.rs1);
+            return;
+        case 0x03: name = "sc.w"; break;
+        case 0x01: name = "amoswap.w"; break;
+        case 0x00: name = "amoadd.w"; break;
+        case 0x04: name = "amoxor.w"; break;
+        case 0x0C: name = "amoand.w"; break;
+        case 0x08: name = "amoor.w"; break;
+        case 0x10: name = "amomin.w"; break;
+        case 0x14: name = "amomax.w"; break;
+        case 0x18: name = "amominu.w"; break;
+        case 0x1C: name = "amomaxu.w"; break;
+        default:
+            handle_invalid_instruction(instruction);
+            return;
+    }
+    printf(AMO_FORMAT, name, instruction.rtype.rd, instruction.rtype.rs2, instruction.rtype.rs1);
+}
+
 void print_rtype(char *name, Instruction instruction) {
   printf(RTYPE_FORMAT, name, instruction.rtype.rd, instruction.rtype.rs1,
          instruction.rtype.rs2);
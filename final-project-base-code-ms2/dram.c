@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dram.h"
+
+/* Address mapping, from the low bits up: column within a row, channel, bank,
+ * row. A sequential stream stays in one open row for rowBytes bytes before it
+ * moves to the next channel or bank.
+ */
+typedef struct {
+  DramChannel *channel;
+  DramBank *bank;
+  long long row;
+} dram_location_t;
+
+void dramDefaultParams(DramParams *params) {
+  params->enable = false;
+  params->channels = DRAM_CHANNELS;
+  params->banks = DRAM_BANKS;
+  params->rowBytes = DRAM_ROW_BYTES;
+  params->tCAS = DRAM_TCAS;
+  params->tRCD = DRAM_TRCD;
+  params->tRP = DRAM_TRP;
+  params->busBytes = DRAM_BUS_BYTES;
+  params->clockRatio = DRAM_CLOCK_RATIO;
+  params->queueSize = DRAM_QUEUE;
+}
+
+void dramSetUp(Dram *d, const DramParams *params) {
+  memset(d, 0, sizeof(*d));
+  d->params = *params;
+  if (d->params.queueSize > DRAM_MAX_QUEUE)
+    d->params.queueSize = DRAM_MAX_QUEUE;
+  d->channels = calloc(params->channels, sizeof(DramChannel));
+  for (int c = 0; c < params->channels; c++) {
+    d->channels[c].banks = calloc(params->banks, sizeof(DramBank));
+    for (int b = 0; b < params->banks; b++)
+      d->channels[c].banks[b].openRow = -1;
+  }
+}
+
+void dramDeallocate(Dram *d) {
+  for (int c = 0; c < d->params.channels; c++)
+    free(d->channels[c].banks);
+  free(d->channels);
+  d->channels = NULL;
+}
+
+static dram_location_t locate(Dram *d, unsigned long long address) {
+  unsigned long long rest = address / d->params.rowBytes;
+  dram_location_t loc;
+  loc.channel = &d->channels[rest % d->params.channels];
+  rest /= d->params.channels;
+  loc.bank = &loc.channel->banks[rest % d->params.banks];
+  loc.row = (long long)(rest / d->params.banks);
+  return loc;
+}
+
+// Memory cycle a request could start its row commands
+static uint64_t start_cycle(const dram_location_t *loc, uint64_t arrival) {
+  return loc->bank->ready > arrival ? loc->bank->ready : arrival;
+}
+
+/* Issue one request to its bank: row commands by the state of the row buffer,
+ * then the burst on the channel's data bus. The row is left open (open page).
+ * Returns the memory cycle the last byte is transferred.
+ */
+static uint64_t issue(Dram *d, unsigned long long address, int bytes, uint64_t arrival) {
+  dram_location_t loc = locate(d, address);
+  uint64_t start = start_cycle(&loc, arrival);
+  int commands;
+
+  if (loc.bank->openRow == loc.row) {
+    commands = d->params.tCAS;
+    d->stats.row_hits++;
+  } else if (loc.bank->openRow < 0) {
+    commands = d->params.tRCD + d->params.tCAS;
+    d->stats.row_misses++;
+  } else {
+    commands = d->params.tRP + d->params.tRCD + d->params.tCAS;
+    d->stats.row_conflicts++;
+  }
+  loc.bank->openRow = loc.row;
+
+  uint64_t burst = (bytes + d->params.busBytes - 1) / d->params.busBytes;
+  uint64_t data = start + commands;
+  if (loc.channel->busReady > data)
+    data = loc.channel->busReady;
+  loc.channel->busReady = data + burst;
+  loc.bank->ready = data + burst;
+  d->stats.bus_busy += burst;
+  if (data + burst > d->stats.last_cycle)
+    d->stats.last_cycle = data + burst;
+  return data + burst;
+}
+
+// FR-FCFS pick among the queued writes: the oldest row hit, else the oldest
+static int pick(Dram *d) {
+  for (int i = 0; i < d->queued; i++) {
+    dram_location_t loc = locate(d, d->queue[i].address);
+    if (loc.bank->openRow == loc.row)
+      return i;
+  }
+  return d->queued > 0 ? 0 : -1;
+}
+
+static uint64_t issue_queued(Dram *d, int i) {
+  DramRequest req = d->queue[i];
+  memmove(&d->queue[i], &d->queue[i + 1], (d->queued - i - 1) * sizeof(DramRequest));
+  d->queued--;
+  return issue(d, req.address, req.bytes, req.arrival);
+}
+
+/* Issue the queued writes that would have started before `now`, in FR-FCFS
+ * order. Writes are batched: the queue only drains while more than half full,
+ * so reads rarely find a bank busy with a write and recent writes can forward.
+ */
+static void drain_idle(Dram *d, uint64_t now) {
+  while (d->queued > d->params.queueSize / 2) {
+    int i = pick(d);
+    if (i < 0)
+      return;
+    dram_location_t loc = locate(d, d->queue[i].address);
+    if (start_cycle(&loc, d->queue[i].arrival) >= now)
+      return;
+    issue_queued(d, i);
+  }
+}
+
+// Read of `bytes` at core cycle `now`, returns its latency in core cycles
+int dramRead(Dram *d, unsigned long long address, int bytes, uint64_t now) {
+  uint64_t mem_now = now / d->params.clockRatio;
+  uint64_t done;
+
+  drain_idle(d, mem_now);
+  d->stats.reads++;
+
+  // The newest data may still sit in the write queue; reads are whole blocks or sectors
+  address &= ~(unsigned long long)(bytes - 1);
+  for (int i = d->queued - 1; i >= 0; i--) {
+    const DramRequest *w = &d->queue[i];
+    if (w->address <= address && address + bytes <= w->address + w->bytes) {
+      d->stats.forwarded++;
+      d->stats.read_latency += d->params.clockRatio;
+      return d->params.clockRatio;
+    }
+  }
+
+  done = issue(d, address, bytes, mem_now);
+  int latency = (int)(done - mem_now) * d->params.clockRatio;
+  d->stats.read_latency += latency;
+  return latency;
+}
+
+/* Post a write at core cycle `now`. It costs nothing unless the queue is full;
+ * then the oldest-first pick is issued right away and the write waits for it.
+ */
+int dramWrite(Dram *d, unsigned long long address, int bytes, uint64_t now) {
+  uint64_t mem_now = now / d->params.clockRatio;
+  int latency = 0;
+
+  drain_idle(d, mem_now);
+  d->stats.writes++;
+  if (d->queued == d->params.queueSize) {
+    uint64_t done = issue_queued(d, pick(d));
+    d->stats.queue_full++;
+    if (done > mem_now)
+      latency = (int)(done - mem_now) * d->params.clockRatio;
+  }
+  d->queue[d->queued++] = (DramRequest){.address = address, .bytes = bytes, .arrival = mem_now};
+  return latency;
+}
+
+void printDramSummary(const Dram *d) {
+  const DramStats *s = &d->stats;
+  uint64_t accesses = s->row_hits + s->row_misses + s->row_conflicts;
+
+  printf("DRAM %d channel(s) x %d banks, %d B rows, tCAS-tRCD-tRP %d-%d-%d, %d B/cycle, %d:1 clock\n",
+         d->params.channels, d->params.banks, d->params.rowBytes, d->params.tCAS, d->params.tRCD,
+         d->params.tRP, d->params.busBytes, d->params.clockRatio);
+  printf("DRAM reads: %llu, writes: %llu, forwarded: %llu, write queue full: %llu, queued: %d\n",
+         (unsigned long long)s->reads, (unsigned long long)s->writes, (unsigned long long)s->forwarded,
+         (unsigned long long)s->queue_full, d->queued);
+  printf("DRAM row hits: %llu, misses: %llu, conflicts: %llu, hit rate: %.4f\n",
+         (unsigned long long)s->row_hits, (unsigned long long)s->row_misses,
+         (unsigned long long)s->row_conflicts, accesses ? (double)s->row_hits / accesses : 0.0);
+  printf("DRAM avg read latency: %.2f cycles, bus utilisation: %.4f\n",
+         s->reads ? (double)s->read_latency / s->reads : 0.0,
+         s->last_cycle ? (double)s->bus_busy / s->last_cycle / d->params.channels : 0.0);
+}
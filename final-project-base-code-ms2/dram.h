@@ -0,0 +1,83 @@
+#ifndef DRAM_H
+#define DRAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Default DRAM organisation and timing, timings in memory clock cycles
+#define DRAM_CHANNELS 1
+#define DRAM_BANKS 8
+#define DRAM_ROW_BYTES 2048  // row buffer size of one bank
+#define DRAM_TCAS 14         // column access, row already open
+#define DRAM_TRCD 14         // row activation
+#define DRAM_TRP 14          // precharge, closing the open row
+#define DRAM_BUS_BYTES 8     // data bus bytes per memory cycle
+#define DRAM_CLOCK_RATIO 2   // core cycles per memory cycle
+#define DRAM_QUEUE 16        // posted write queue entries per controller
+#define DRAM_MAX_QUEUE 256
+
+typedef struct {
+  bool enable; // false = fixed memory latency (mem_latency)
+  int channels;
+  int banks;   // per channel
+  int rowBytes;
+  int tCAS;
+  int tRCD;
+  int tRP;
+  int busBytes;
+  int clockRatio;
+  int queueSize;
+} DramParams;
+
+typedef struct {
+  long long openRow; // -1 = precharged
+  uint64_t ready;    // memory cycle the bank takes its next command
+} DramBank;
+
+typedef struct {
+  DramBank *banks;
+  uint64_t busReady; // memory cycle the data bus is free
+} DramChannel;
+
+// A write waiting in the queue
+typedef struct {
+  unsigned long long address;
+  int bytes;
+  uint64_t arrival; // memory cycle it was queued
+} DramRequest;
+
+typedef struct {
+  uint64_t reads;
+  uint64_t writes;
+  uint64_t row_hits;
+  uint64_t row_misses;    // bank precharged, row activated
+  uint64_t row_conflicts; // another row open, precharge then activate
+  uint64_t forwarded;     // reads served from a queued write
+  uint64_t queue_full;    // writes that had to wait for a queue slot
+  uint64_t read_latency;  // core cycles summed over the reads
+  uint64_t bus_busy;      // memory cycles of data transfer
+  uint64_t last_cycle;    // latest memory cycle seen, for the bus utilisation
+} DramStats;
+
+/* Main memory with channels of banks, each holding one open row. Reads are
+ * served as they arrive (the core is blocked on them); writes are posted into
+ * a queue and, once it is more than half full, issued in the idle time between
+ * reads in FR-FCFS order: writes to an open row first, then the oldest. A full
+ * queue stalls the write that needs a slot until one queued write has been issued.
+ */
+typedef struct {
+  DramParams params;
+  DramChannel *channels;
+  DramRequest queue[DRAM_MAX_QUEUE]; // oldest first
+  int queued;
+  DramStats stats;
+} Dram;
+
+void dramDefaultParams(DramParams *params);
+void dramSetUp(Dram *d, const DramParams *params);
+void dramDeallocate(Dram *d);
+int dramRead(Dram *d, unsigned long long address, int bytes, uint64_t now);
+int dramWrite(Dram *d, unsigned long long address, int bytes, uint64_t now);
+void printDramSummary(const Dram *d);
+
+#endif // DRAM_H
@@ -21,6 +21,16 @@ void execute_load(Instruction, Processor *, Byte *);
 void execute_store(Instruction, Processor *, Byte *);
 void execute_ecall(Processor *, Byte *);
 void execute_lui(Instruction, Processor *);
+void execute_amo(Instruction, Processor *, Byte *);
+
+/* Hart whose instructions this thread executes. A single hart emulation has
+ * none, and its exit ecall ends the program.
+ */
+static _Thread_local hart_state_t *current_hart;
+
+void set_current_hart(hart_state_t *hart) {
+    current_hart = hart;
+}
 
 void execute_instruction(uint32_t instruction_bits, Processor *processor,Byte *memory) {    
     Instruction instruction = parse_instruction(instruction_bits);
@@ -49,6 +59,9 @@ void execute_instruction(uint32_t instruction_bits, Processor *processor,Byte *m
         case 0x37:
             execute_lui(instruction, processor);
             break;
+        case 0x2F:
+            execute_amo(instruction, processor, memory);
+            break;
         default: // undefined opcode
             handle_invalid_instruction(instruction);
             exit(-1);
@@ -56,6 +69,18 @@ void execute_instruction(uint32_t instruction_bits, Processor *processor,Byte *m
     }
 }
 
+/* Signed division and remainder as RV32M defines them: dividing by zero gives
+ * all ones (the dividend for rem), and the overflowing -2^31 / -1 gives -2^31
+ * (0 for rem) instead of trapping on the host.
+ */
+static sWord divide(sWord a, sWord b, bool remainder) {
+    if (b == 0)
+        return remainder ? a : -1;
+    if (a == INT32_MIN && b == -1)
+        return remainder ? 0 : INT32_MIN;
+    return remainder ? a % b : a / b;
+}
+
 void execute_rtype(Instruction instruction, Processor *processor) {
     switch (instruction.rtype.funct3){
         case 0x0:
@@ -111,6 +136,29 @@ void execute_rtype(Instruction instruction, Processor *processor) {
                     processor->R[instruction.rtype.rd] =
                         ((sWord)processor->R[instruction.rtype.rs1] < (sWord)processor->R[instruction.rtype.rs2]) ? 1 : 0;
                     break;
+                case 0x01: // Multiply High Signed-Unsigned (mulhsu) - upper 32 bits of signed rs1 times unsigned rs2
+                    processor->R[instruction.rtype.rd] =
+                        ((int64_t)(sWord)processor->R[instruction.rtype.rs1] *
+                        (int64_t)(uint64_t)processor->R[instruction.rtype.rs2]) >> 32;
+                    break;
+                default:
+                    handle_invalid_instruction(instruction);
+                    exit(-1);
+                    break;
+            }
+            break;
+
+        case 0x3:
+            switch(instruction.rtype.funct7) {
+                case 0x00: // Set less than unsigned (SLTU)
+                    processor->R[instruction.rtype.rd] =
+                        (processor->R[instruction.rtype.rs1] < processor->R[instruction.rtype.rs2]) ? 1 : 0;
+                    break;
+                case 0x01: // Multiply High Unsigned (mulhu) - upper 32 bits of the unsigned product
+                    processor->R[instruction.rtype.rd] =
+                        ((uint64_t)processor->R[instruction.rtype.rs1] *
+                        (uint64_t)processor->R[instruction.rtype.rs2]) >> 32;
+                    break;
                 default:
                     handle_invalid_instruction(instruction);
                     exit(-1);
@@ -125,9 +173,9 @@ void execute_rtype(Instruction instruction, Processor *processor) {
                         processor->R[instruction.rtype.rs1] ^ processor->R[instruction.rtype.rs2];
                     break;
                 case 0x01: // Div
-                    processor->R[instruction.rtype.rd] = 
-                        ((sWord)processor->R[instruction.rtype.rs1]) /
-                        ((sWord)processor->R[instruction.rtype.rs2]);
+                    processor->R[instruction.rtype.rd] =
+                        divide((sWord)processor->R[instruction.rtype.rs1],
+                               (sWord)processor->R[instruction.rtype.rs2], false);
                     break;
 
                 default:
@@ -148,6 +196,10 @@ void execute_rtype(Instruction instruction, Processor *processor) {
                     processor->R[instruction.rtype.rd] =
                         ((sWord)processor->R[instruction.rtype.rs1]) >> (processor->R[instruction.rtype.rs2] & 0x1F);
                     break;
+                case 0x01: // Divide unsigned (DIVU), all ones when dividing by zero
+                    processor->R[instruction.rtype.rd] = processor->R[instruction.rtype.rs2] == 0 ? 0xFFFFFFFF :
+                        processor->R[instruction.rtype.rs1] / processor->R[instruction.rtype.rs2];
+                    break;
                 default:
                     handle_invalid_instruction(instruction);
                     exit(-1);
@@ -165,7 +217,8 @@ void execute_rtype(Instruction instruction, Processor *processor) {
 
                 case 0x01: // Remainder (REM) - calculates the remainder of rs1 / rs2
                     processor->R[instruction.rtype.rd] =
-                         ((sWord)processor->R[instruction.rtype.rs1]) % ((sWord)processor->R[instruction.rtype.rs2]);
+                        divide((sWord)processor->R[instruction.rtype.rs1],
+                               (sWord)processor->R[instruction.rtype.rs2], true);
                     break;
                     
                 default:
@@ -182,6 +235,11 @@ void execute_rtype(Instruction instruction, Processor *processor) {
                     processor->R[instruction.rtype.rd] =
                         processor->R[instruction.rtype.rs1] & processor->R[instruction.rtype.rs2];
                     break;
+                case 0x01: // Remainder unsigned (REMU), the dividend when dividing by zero
+                    processor->R[instruction.rtype.rd] = processor->R[instruction.rtype.rs2] == 0 ?
+                        processor->R[instruction.rtype.rs1] :
+                        processor->R[instruction.rtype.rs1] % processor->R[instruction.rtype.rs2];
+                    break;
                 default:
                     handle_invalid_instruction(instruction);
                     exit(-1);
@@ -283,6 +341,11 @@ void execute_ecall(Processor *p, Byte *memory) {
             p->PC += 4;
             break;
         case 10: // exit
+            if (current_hart != NULL) { // only this hart stops, the PC stays on the ecall
+                printf("hart %d exiting\n", current_hart->id);
+                current_hart->exited = true;
+                break;
+            }
             printf("exiting the simulator\n");
             exit(0);
             break;
@@ -301,14 +364,7 @@ void execute_branch(Instruction instruction, Processor *processor) {
     // Declearing some variables so I don't have to repeat
     Register rs1 = instruction.sbtype.rs1;
     Register rs2 = instruction.sbtype.rs2;
-    uint32_t imm_sum = ((instruction.sbtype.imm7 & 0x40) << 6)     // imm[12]
-            | ((instruction.sbtype.imm7 & 0x3F) << 5)     // imm[10:5]
-            | ((instruction.sbtype.imm5 & 0x1E) >> 1)     // imm[4:1]
-            | ((instruction.sbtype.imm5 & 0x01) << 11);   // imm[11]
-
-
-    sWord imm = sign_extend_number(imm_sum, 13); // offset = 13 bits
-    imm = imm << 1;
+    sWord imm = get_branch_offset(instruction); // offset = 13 bits, as the disassembler decodes it
     
     switch (instruction.sbtype.funct3) {
         case 0x0: // Branch If equal (BEQ) - if rs1 == rs2, branches to PC + (offset << 1), otherwise keeps executing from pc + 4
@@ -420,6 +476,97 @@ void execute_lui(Instruction instruction, Processor *processor) {
     processor->PC += 4;                                              
 }
 
+/* RV32A on word aligned guest memory, with host atomics so that harts on
+ * other threads see every AMO whole. The guest memory is little endian like
+ * the host. sc.w succeeds when the word still holds the value lr.w read: a
+ * compare and swap, which misses an A-B-A change of the word in between.
+ */
+void execute_amo(Instruction instruction, Processor *processor, Byte *memory) {
+    Register rd = instruction.rtype.rd;
+    Address addr = processor->R[instruction.rtype.rs1];
+    Word src = processor->R[instruction.rtype.rs2];
+    unsigned funct5 = instruction.rtype.funct7 >> 2;
+    Word old;
+
+    if (instruction.rtype.funct3 != 0x2) {
+        handle_invalid_instruction(instruction);
+        exit(-1);
+    }
+    if ((addr & 3) || addr > MEMORY_SPACE - 4) {
+        if (funct5 == 0x02)
+            handle_invalid_read(addr);
+        handle_invalid_write(addr);
+    }
+
+    uint32_t *word = (uint32_t *)(memory + addr);
+    static hart_state_t single; // reservation of a single hart emulation
+    hart_state_t *hart = current_hart != NULL ? current_hart : &single;
+
+    switch (funct5) {
+        case 0x02: // Load Reserved (LR.W) - loads the word and reserves it
+            old = __atomic_load_n(word, __ATOMIC_SEQ_CST);
+            hart->reserved = true;
+            hart->reservation = addr;
+            hart->reservedValue = old;
+            hart->lr++;
+            processor->R[rd] = old;
+            break;
+        case 0x03: { // Store Conditional (SC.W) - stores if the reservation holds, rd = 0 on success
+            Word expected = hart->reservedValue;
+            bool ok = hart->reserved && hart->reservation == addr &&
+                      __atomic_compare_exchange_n(word, &expected, src, false,
+                                                  __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+            hart->reserved = false;
+            hart->sc++;
+            if (!ok)
+                hart->sc_failed++;
+            processor->R[rd] = ok ? 0 : 1;
+            break;
+        }
+        case 0x01: // AMOSWAP.W
+            old = __atomic_exchange_n(word, src, __ATOMIC_SEQ_CST);
+            break;
+        case 0x00: // AMOADD.W
+            old = __atomic_fetch_add(word, src, __ATOMIC_SEQ_CST);
+            break;
+        case 0x04: // AMOXOR.W
+            old = __atomic_fetch_xor(word, src, __ATOMIC_SEQ_CST);
+            break;
+        case 0x0C: // AMOAND.W
+            old = __atomic_fetch_and(word, src, __ATOMIC_SEQ_CST);
+            break;
+        case 0x08: // AMOOR.W
+            old = __atomic_fetch_or(word, src, __ATOMIC_SEQ_CST);
+            break;
+        case 0x10:   // AMOMIN.W
+        case 0x14:   // AMOMAX.W
+        case 0x18:   // AMOMINU.W
+        case 0x1C: { // AMOMAXU.W - no fetch-min on the host, retry a compare and swap
+            old = __atomic_load_n(word, __ATOMIC_SEQ_CST);
+            Word val;
+            do {
+                switch (funct5) {
+                    case 0x10: val = (sWord)old < (sWord)src ? old : src; break;
+                    case 0x14: val = (sWord)old > (sWord)src ? old : src; break;
+                    case 0x18: val = old < src ? old : src; break;
+                    default:   val = old > src ? old : src; break;
+                }
+            } while (!__atomic_compare_exchange_n(word, &old, val, false,
+                                                  __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+            break;
+        }
+        default:
+            handle_invalid_instruction(instruction);
+            exit(-1);
+            break;
+    }
+    if (funct5 != 0x02 && funct5 != 0x03) {
+        hart->amo++;
+        processor->R[rd] = old;
+    }
+    processor->PC += 4;
+}
+
 void store(Byte *memory, Address address, Alignment alignment, Word value) {
     switch (alignment) { 
         case 1: // Sb - store byte (1 byte)
@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <string.h>
+#include "harts.h"
+
+int hartsSetUp(Harts *h, int count, int quantum) {
+  if (count < 1 || count > HARTS_MAX) {
+    fprintf(stderr, "Error - 1 to %d harts\n", HARTS_MAX);
+    return -1;
+  }
+  if (quantum < 0) {
+    fprintf(stderr, "Error - the quantum must be at least 1 instruction, or 0 for parallel harts\n");
+    return -1;
+  }
+  memset(h, 0, sizeof(*h));
+  h->count = count;
+  h->quantum = quantum;
+  for (int i = 0; i < count; i++) {
+    h->hart[i].state.id = i;
+    h->hart[i].harts = h;
+  }
+  return 0;
+}
+
+// Start every hart from the boot register state, with its id and stack
+void hartsReset(Harts *h, const regfile_t *boot) {
+  for (int i = 0; i < h->count; i++) {
+    Hart *hart = &h->hart[i];
+    hart->regfile = *boot;
+    hart->regfile.R[2] = boot->R[2] - i * HARTS_STACK_BYTES;
+    hart->regfile.R[4] = i;
+    hart->instructions = 0;
+    memset(&hart->state, 0, sizeof(hart->state));
+    hart->state.id = i;
+  }
+}
+
+static bool hart_done(const Hart *hart) {
+  const Harts *h = hart->harts;
+  return hart->state.exited || (!h->untilEcall && hart->instructions >= h->maxInstructions);
+}
+
+// Run the hart for up to n instructions, or until it is done
+static void run_hart(Hart *hart, uint64_t n) {
+  Byte *memory = hart->harts->memory;
+
+  set_current_hart(&hart->state);
+  for (uint64_t i = 0; i < n && !hart_done(hart); i++) {
+    execute_instruction(load(memory, hart->regfile.PC, LENGTH_WORD), &hart->regfile, memory);
+    hart->regfile.R[0] = 0;
+    hart->instructions++;
+  }
+}
+
+static void *hart_main(void *arg) {
+  run_hart((Hart *)arg, UINT64_MAX);
+  return NULL;
+}
+
+// Run every hart until its exit ecall (untilEcall) or for maxInstructions instructions
+void hartsRun(Harts *h, Byte *memory, bool untilEcall, uint64_t maxInstructions) {
+  h->memory = memory;
+  h->untilEcall = untilEcall;
+  h->maxInstructions = maxInstructions;
+
+  if (h->quantum == 0) {
+    for (int i = 0; i < h->count; i++)
+      pthread_create(&h->hart[i].thread, NULL, hart_main, &h->hart[i]);
+    for (int i = 0; i < h->count; i++)
+      pthread_join(h->hart[i].thread, NULL);
+  } else {
+    bool running = true;
+    while (running) {
+      running = false;
+      for (int i = 0; i < h->count; i++) {
+        run_hart(&h->hart[i], h->quantum);
+        running |= !hart_done(&h->hart[i]);
+      }
+    }
+  }
+  set_current_hart(NULL);
+}
+
+void printHartsSummary(const Harts *h) {
+  if (h->quantum == 0)
+    printf("%d harts on parallel threads\n", h->count);
+  else
+    printf("%d harts in turn, %d instruction quantum\n", h->count, h->quantum);
+  for (int i = 0; i < h->count; i++) {
+    const Hart *hart = &h->hart[i];
+    printf("Hart %d: %llu instructions%s, lr.w: %llu, sc.w: %llu (%llu failed), AMOs: %llu\n", i,
+           (unsigned long long)hart->instructions, hart->state.exited ? "" : " (no ecall)",
+           (unsigned long long)hart->state.lr, (unsigned long long)hart->state.sc,
+           (unsigned long long)hart->state.sc_failed, (unsigned long long)hart->state.amo);
+  }
+}
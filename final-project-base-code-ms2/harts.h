@@ -0,0 +1,43 @@
+#ifndef HARTS_H
+#define HARTS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "riscv.h"
+#include "types.h"
+
+#define HARTS_MAX 16            // harts of a functional run
+#define HARTS_STACK_BYTES 0x10000 // stack of each hart below the previous one's
+
+// One hart of the functional emulator
+typedef struct {
+  regfile_t regfile;
+  hart_state_t state;
+  uint64_t instructions;
+  pthread_t thread;
+  struct Harts *harts;
+} Hart;
+
+/* N harts running the same program on shared guest memory in the functional
+ * emulator. A hart tells itself apart by its id in tp (x4) and has its own
+ * stack. With a quantum of 0 every hart runs freely on its own host thread and
+ * the RV32A instructions synchronise them through host atomics. Otherwise one
+ * thread runs the harts in turn for quantum instructions each, so a run is
+ * reproducible.
+ */
+typedef struct Harts {
+  int count;
+  int quantum;
+  Hart hart[HARTS_MAX];
+  Byte *memory;
+  bool untilEcall;
+  uint64_t maxInstructions;
+} Harts;
+
+int hartsSetUp(Harts *h, int count, int quantum);
+void hartsReset(Harts *h, const regfile_t *boot);
+void hartsRun(Harts *h, Byte *memory, bool untilEcall, uint64_t maxInstructions);
+void printHartsSummary(const Harts *h);
+
+#endif // HARTS_H
@@ -0,0 +1,668 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "hierarchy.h"
+
+static const int index_data = 0;
+static const int index_instr = 1;
+
+static void setup_level(Cache *cache, const CacheParams *p, uint64_t seed, char *name) {
+  cache->setBits = p->setBits;
+  cache->linesPerSet = p->linesPerSet;
+  cache->blockBits = p->blockBits;
+  cache->sectorBits = p->sectorBits;
+  cache->replacement = p->replacement;
+  cache->replSeed = seed;
+  cache->indexing = p->indexing;
+  cache->hitLatency = p->hitLatency;
+  cache->writePolicy = p->writePolicy;
+  cache->displayTrace = CACHE_DISPLAY_TRACE;
+  cacheSetUp(cache, name);
+}
+
+// Fill the parameters with the compile time defaults from cache.h, hierarchy.h and config.h
+void hierarchyDefaultParams(HierarchyParams *params) {
+  CacheParams l1 = {.enable = true, .setBits = CACHE_SET_BITS, .linesPerSet = CACHE_LINES_PER_SET,
+                    .blockBits = CACHE_BLOCK_BITS, .hitLatency = CACHE_HIT_LATENCY, .replacement = CACHE_REPLACEMENT,
+                    .indexing = CACHE_INDEXING, .writePolicy = CACHE_WRITE_POLICY};
+  CacheParams l2 = {.enable = false, .setBits = L2_SET_BITS, .linesPerSet = L2_LINES_PER_SET,
+                    .blockBits = L2_BLOCK_BITS, .hitLatency = L2_HIT_LATENCY, .replacement = L2_REPLACEMENT,
+                    .indexing = CACHE_INDEXING, .writePolicy = CACHE_WRITE_POLICY};
+  CacheParams l3 = {.enable = false, .setBits = L3_SET_BITS, .linesPerSet = L3_LINES_PER_SET,
+                    .blockBits = L3_BLOCK_BITS, .hitLatency = L3_HIT_LATENCY, .replacement = L3_REPLACEMENT,
+                    .indexing = CACHE_INDEXING, .writePolicy = CACHE_WRITE_POLICY};
+
+  params->l1d = l1;
+  params->l1i = l1;
+  params->l1i.enable = false;
+  params->l2 = l2;
+  params->l3 = l3;
+#ifdef CACHE_L1I_ENABLE
+  params->l1i.enable = true;
+#endif
+#ifdef CACHE_L2_ENABLE
+  params->l2.enable = true;
+#endif
+#ifdef CACHE_L3_ENABLE
+  params->l3.enable = true;
+#endif
+  prefetchDefaultParams(&params->prefetch);
+  l1TimingDefaultParams(&params->l1Timing);
+  params->victimEntries = CACHE_VICTIM_ENTRIES;
+  params->victimLatency = VICTIM_HIT_LATENCY;
+  params->inclusion = CACHE_INCLUSION;
+  params->memLatency = MEM_LATENCY;
+  params->memBusBytes = 0;
+  dramDefaultParams(&params->dram);
+#ifdef MEM_DRAM
+  params->dram.enable = true;
+#endif
+  tlbDefaultParams(&params->tlb);
+#ifdef TLB_ENABLE
+  params->tlb.enable = true;
+#endif
+  params->replSeed = REPL_SEED;
+}
+
+/* Build the hierarchy. L1D always exists, L1I, L2 and L3 are optional.
+ * An L3 without an L2 is not allowed, and the exclusive policy needs
+ * the same block size at every level so blocks can move between them, and
+ * write-back caches so a block is never duplicated by a write-through.
+ * Returns 0 on success, -1 on a bad configuration.
+ */
+int hierarchySetUp(CacheHierarchy *h, const HierarchyParams *params) {
+  if (params->l3.enable && !params->l2.enable) {
+    fprintf(stderr, "Error - an L3 cache needs an L2 cache\n");
+    return -1;
+  }
+  if (params->inclusion == INCLUSION_EXCLUSIVE) {
+    int bits = params->l1d.blockBits;
+    if ((params->l1i.enable && params->l1i.blockBits != bits) ||
+        (params->l2.enable && params->l2.blockBits != bits) ||
+        (params->l3.enable && params->l3.blockBits != bits)) {
+      fprintf(stderr, "Error - exclusive hierarchy needs the same block size at every level\n");
+      return -1;
+    }
+    if ((params->l1i.enable && params->l1i.writePolicy != WRITE_BACK) ||
+        params->l1d.writePolicy != WRITE_BACK ||
+        (params->l2.enable && params->l2.writePolicy != WRITE_BACK) ||
+        (params->l3.enable && params->l3.writePolicy != WRITE_BACK)) {
+      fprintf(stderr, "Error - exclusive hierarchy needs write-back caches\n");
+      return -1;
+    }
+    // blocks move between levels whole, a partly fetched line cannot
+    if (params->l1i.sectorBits || params->l1d.sectorBits || params->l2.sectorBits || params->l3.sectorBits) {
+      fprintf(stderr, "Error - exclusive hierarchy needs unsectored lines\n");
+      return -1;
+    }
+  }
+
+  h->hasL1I = params->l1i.enable;
+  h->hasVictim = params->victimEntries > 0;
+  h->numLower = 0;
+  h->inclusion = params->inclusion;
+  h->memLatency = params->memLatency;
+  h->memBusBytes = params->memBusBytes;
+  h->hasDram = params->dram.enable;
+  h->now = 0;
+  h->stall_cycles = 0;
+  h->regionBase = 0;
+  h->shared = NULL;
+  h->coherence = NULL;
+  h->core = 0;
+  h->cores = 0;
+  h->lock = NULL;
+  h->accesses[index_data] = h->accesses[index_instr] = 0;
+  h->total_latency[index_data] = h->total_latency[index_instr] = 0;
+  h->mem_accesses = 0;
+  h->mem_writes = 0;
+  h->mem_bytes_read = 0;
+  h->mem_bytes_written = 0;
+  h->stackdist = NULL;
+  h->capture = NULL;
+  h->attrib = NULL;
+
+  // Keep the old "L1" name when there is a single L1 for data only
+  // Each level gets its own random stream so they do not evict in lockstep
+  setup_level(&h->l1d, &params->l1d, params->replSeed, h->hasL1I ? "L1D" : "L1");
+  if (h->hasL1I)
+    setup_level(&h->l1i, &params->l1i, params->replSeed + 1, "L1I");
+  if (params->l2.enable)
+    setup_level(&h->lower[h->numLower++], &params->l2, params->replSeed + 2, "L2");
+  if (params->l3.enable)
+    setup_level(&h->lower[h->numLower++], &params->l3, params->replSeed + 3, "L3");
+  if (h->hasVictim) {
+    // same blocks as the L1D, so lines move between the two unchanged
+    CacheParams victim = {.enable = true, .setBits = 0, .linesPerSet = params->victimEntries,
+                          .blockBits = params->l1d.blockBits, .hitLatency = params->victimLatency,
+                          .replacement = REPL_LRU, .writePolicy = params->l1d.writePolicy};
+    setup_level(&h->victim, &victim, params->replSeed + 4, "VC");
+  }
+
+  if (h->hasDram)
+    dramSetUp(&h->dram, &params->dram);
+  h->hasTlb = params->tlb.enable;
+  if (h->hasTlb)
+    tlbSetUp(&h->tlb, &params->tlb);
+  h->hasL1Timing = l1TimingEnabled(&params->l1Timing);
+  if (h->hasL1Timing)
+    l1TimingSetUp(&h->l1timing, &params->l1Timing, params->l1d.setBits);
+  prefetchSetUp(&h->prefetcher, &params->prefetch);
+  if (params->prefetch.kind != PREFETCH_NONE)
+    h->l1d.prefetcher = &h->prefetcher;
+  return 0;
+}
+
+void hierarchyDeallocate(CacheHierarchy *h) {
+  deallocate(&h->l1d);
+  if (h->hasL1I)
+    deallocate(&h->l1i);
+  for (int i = 0; i < h->numLower; i++)
+    deallocate(&h->lower[i]);
+  if (h->hasVictim)
+    deallocate(&h->victim);
+  if (h->hasL1Timing)
+    l1TimingDeallocate(&h->l1timing);
+  if (h->hasDram)
+    dramDeallocate(&h->dram);
+  if (h->hasTlb)
+    tlbDeallocate(&h->tlb);
+  prefetchDeallocate(&h->prefetcher);
+}
+
+// Hierarchy holding the levels below the L1s, the shared one of a multicore run
+static CacheHierarchy *below(CacheHierarchy *h) {
+  if (h->shared == NULL)
+    return h;
+  h->shared->now = h->now;
+  return h->shared;
+}
+
+// Access latency plus, with a bus width set, the cycles to move the bytes
+static int memory_latency(const CacheHierarchy *h, int bytes) {
+  if (h->memBusBytes <= 0)
+    return h->memLatency;
+  return h->memLatency + (bytes + h->memBusBytes - 1) / h->memBusBytes;
+}
+
+// Main memory read of one block or sector, returns its latency
+static int memory_read(CacheHierarchy *h, unsigned long long address, int bytes) {
+  h->mem_accesses++;
+  h->mem_bytes_read += bytes;
+  if (h->hasDram)
+    return dramRead(&h->dram, address, bytes, h->now);
+  return memory_latency(h, bytes);
+}
+
+/* Main memory write (write-back of a block or a write-through store), returns
+ * its latency. The DRAM posts writes, they only cost time when its queue is full.
+ */
+static int memory_write(CacheHierarchy *h, unsigned long long address, int bytes) {
+  h->mem_writes++;
+  h->mem_bytes_written += bytes;
+  if (h->hasDram)
+    return dramWrite(&h->dram, address, bytes, h->now);
+  return memory_latency(h, bytes);
+}
+
+/* Invalidate every block of an upper cache that lies inside the evicted lower block.
+ * Returns true if one of them was dirty, its data then travels down with the victim.
+ */
+static bool back_invalidate_cache(Cache *upper, unsigned long long block_addr, int lowerBlockBits) {
+  unsigned long long step = 1ULL << upper->blockBits;
+  unsigned long long end = block_addr + (1ULL << lowerBlockBits);
+  bool dirty = false;
+  // an upper block larger than the lower one still covers the victim, start from its base
+  for (unsigned long long a = address_to_block(block_addr, upper); a < end; a += step) {
+    bool was_dirty;
+    if (invalidate_cacheline(a, upper, &was_dirty)) {
+      upper->backinval_count++;
+      dirty = dirty || was_dirty;
+    }
+  }
+  return dirty;
+}
+
+// Lower level `level` evicted a block; remove it from every level above it
+static bool back_invalidate(CacheHierarchy *h, int level, unsigned long long block_addr) {
+  int bits = h->lower[level].blockBits;
+  bool dirty = false;
+  for (int i = 0; i < level; i++)
+    dirty = back_invalidate_cache(&h->lower[i], block_addr, bits) || dirty;
+  dirty = back_invalidate_cache(&h->l1d, block_addr, bits) || dirty;
+  if (h->hasVictim)
+    dirty = back_invalidate_cache(&h->victim, block_addr, bits) || dirty;
+  if (h->hasL1I)
+    dirty = back_invalidate_cache(&h->l1i, block_addr, bits) || dirty;
+  return dirty;
+}
+
+/* Exclusive hierarchy: a block evicted from the level above is moved into `level`,
+ * keeping its dirty state. Returns the latency of a dirty block reaching memory.
+ */
+static int spill_victim(CacheHierarchy *h, int level, unsigned long long block_addr, bool dirty, int bytes) {
+  if (level >= h->numLower)
+    return dirty ? memory_write(h, block_addr, bytes) : 0; // clean blocks are simply dropped
+  result r = fill_cacheline(block_addr, dirty, &h->lower[level]);
+  if (r.status == CACHE_EVICT)
+    return spill_victim(h, level + 1, r.victim_block_addr, r.victim_dirty, bytes);
+  return 0;
+}
+
+static int victim_lower(CacheHierarchy *h, int level, result r);
+
+/* Write a dirty block evicted from the level above into lower[level].
+ * Write-back levels take the whole block and mark it dirty, write-through
+ * levels pass it on. Returns the write-back latency.
+ */
+static int writeback_lower(CacheHierarchy *h, int level, unsigned long long block_addr, int bytes) {
+  if (level >= h->numLower)
+    return memory_write(h, block_addr, bytes);
+
+  Cache *cache = &h->lower[level];
+  int latency = cache->hitLatency;
+
+  if (cache->writePolicy == WRITE_THROUGH)
+    return latency + writeback_lower(h, level + 1, block_addr, bytes);
+
+  // A full block is written, so no fetch from below is needed even on a miss
+  result r = fill_cacheline(block_addr, true, cache);
+  return latency + victim_lower(h, level, r);
+}
+
+/* Deal with the victim of a fill in lower[level]: back-invalidate the levels above
+ * for an inclusive hierarchy and write it further down if it was dirty.
+ * Returns the write-back latency.
+ */
+static int victim_lower(CacheHierarchy *h, int level, result r) {
+  if (r.status != CACHE_EVICT)
+    return 0;
+
+  bool dirty = r.victim_dirty;
+  if (h->inclusion == INCLUSION_INCLUSIVE)
+    dirty = back_invalidate(h, level, r.victim_block_addr) || dirty;
+  if (dirty)
+    return writeback_lower(h, level + 1, r.victim_block_addr, r.victim_bytes);
+  return 0;
+}
+
+/* Service a read miss (block fill) from the level above, starting at lower[level].
+ * bytes is the block size the level above asks for. In an exclusive hierarchy a
+ * hit moves the block up, dirty_up (if not NULL) then tells whether it was modified.
+ * Returns the added latency.
+ */
+static int access_lower(CacheHierarchy *h, int level, unsigned long long address, int bytes, bool *dirty_up) {
+  if (level >= h->numLower)
+    return memory_read(h, address, bytes);
+
+  Cache *cache = &h->lower[level];
+  int latency = cache->hitLatency;
+
+  if (h->inclusion == INCLUSION_EXCLUSIVE) {
+    // On a hit the block moves up, so it leaves this level; on a miss it is not filled here
+    if (probe_cache(address, cache)) {
+      cache->hit_count++;
+      invalidate_cacheline(address, cache, dirty_up);
+      return latency;
+    }
+    cache->miss_count++;
+    return latency + access_lower(h, level + 1, address, bytes, dirty_up);
+  }
+
+  result r = operateCache(address, false, cache);
+  if (r.status == CACHE_HIT)
+    return latency;
+
+  latency += access_lower(h, level + 1, address, r.fill_bytes, NULL);
+  return latency + victim_lower(h, level, r);
+}
+
+/* A store written through by the level above. A write-through level updates its
+ * copy if it has one and passes the store on; a write-back level absorbs it,
+ * fetching the block first on a miss (write-allocate).
+ */
+static void write_lower(CacheHierarchy *h, int level, unsigned long long address) {
+  if (level >= h->numLower) {
+    memory_write(h, address, CACHE_WORD_BYTES);
+    return;
+  }
+
+  Cache *cache = &h->lower[level];
+  result r = operateCache(address, true, cache);
+
+  if (cache->writePolicy == WRITE_THROUGH) {
+    write_lower(h, level + 1, address);
+    return;
+  }
+  if (r.status != CACHE_HIT) {
+    access_lower(h, level + 1, address, r.fill_bytes, NULL);
+    victim_lower(h, level, r);
+  }
+}
+
+/* Handle the victim of an L1 fill. An L1D victim goes to the victim cache when
+ * there is one, and it is that cache's own victim that travels further down.
+ * Returns the write-back latency.
+ */
+static int victim_l1(CacheHierarchy *h, Cache *l1, result r) {
+  if (r.status != CACHE_EVICT)
+    return 0;
+  if (h->coherence != NULL && l1 == &h->l1d)
+    coherenceEvict(h->coherence, h->core, r.victim_block_addr);
+  if (h->hasVictim && l1 == &h->l1d) {
+    r = fill_cacheline(r.victim_block_addr, r.victim_dirty, &h->victim);
+    if (r.status != CACHE_EVICT)
+      return 0;
+  }
+  if (h->inclusion == INCLUSION_EXCLUSIVE)
+    return spill_victim(below(h), 0, r.victim_block_addr, r.victim_dirty, r.victim_bytes);
+  if (r.victim_dirty)
+    return writeback_lower(below(h), 0, r.victim_block_addr, r.victim_bytes);
+  return 0;
+}
+
+/* Probe the victim cache on an L1D miss. On a hit the block leaves it for the L1D,
+ * which already made room for it, and the L1D victim takes its place (victim_l1),
+ * so the two lines are swapped. *dirty tells whether the block was modified.
+ * A miss is assumed to be overlapped with the request to the next level.
+ */
+static bool victim_probe(CacheHierarchy *h, unsigned long long address, bool *dirty) {
+  Cache *vc = &h->victim;
+  if (!invalidate_cacheline(address, vc, dirty)) {
+    vc->miss_count++;
+    return false;
+  }
+  vc->hit_count++;
+  return true;
+}
+
+// Stream buffers fetch their blocks from the first level below the L1
+static int stream_fetch(void *ctx, unsigned long long block_addr) {
+  CacheHierarchy *h = (CacheHierarchy *)ctx;
+  return access_lower(below(h), 0, block_addr, 1 << h->l1d.blockBits, NULL);
+}
+
+// Issue the next-line or stride prefetches triggered by a demand access to the L1D
+static void issue_prefetches(CacheHierarchy *h, unsigned long long address, unsigned long long pc,
+                             uint64_t cycle, bool trigger) {
+  Cache *l1 = &h->l1d;
+  unsigned long long candidates[PREFETCH_MAX_DEPTH];
+  int n = prefetchCandidates(&h->prefetcher, pc, address, trigger, l1->blockBits,
+                             candidates, PREFETCH_MAX_DEPTH);
+
+  for (int i = 0; i < n; i++) {
+    if (probe_cache(candidates[i], l1)) {
+      h->prefetcher.stats.redundant++;
+      continue;
+    }
+    int latency = access_lower(below(h), 0, candidates[i], 1 << l1->blockBits, NULL);
+    result r = prefetch_cacheline(candidates[i], cycle + latency, l1);
+    h->prefetcher.stats.issued++;
+    // the fill writes its bank when the data arrives
+    if (h->hasL1Timing)
+      l1TimingBank(&h->l1timing, candidates[i] >> l1->blockBits, h->now + latency, false);
+    victim_l1(h, l1, r);
+  }
+}
+
+// Dirty data another core's access took from an L1D goes to the shared level
+static int coherence_writeback(void *ctx, unsigned long long block_addr, int bytes) {
+  CacheHierarchy *h = (CacheHierarchy *)ctx;
+  return writeback_lower(below(h), 0, block_addr, bytes);
+}
+
+// MESI actions of an L1D access, before the L1D itself is accessed
+static int coherence_access(CacheHierarchy *h, unsigned long long address, bool write) {
+  if (h->coherence == NULL)
+    return 0;
+  return coherenceAccess(h->coherence, h->core, address, write, coherence_writeback, h);
+}
+
+/* The page walker reads PTEs through the L1D like a load, without training
+ * the prefetcher or showing up in the access statistics of the hierarchy.
+ */
+static int walk_read(void *ctx, unsigned long long pte_addr) {
+  CacheHierarchy *h = (CacheHierarchy *)ctx;
+  Cache *l1 = &h->l1d;
+  int latency = coherence_access(h, pte_addr, false);
+  result r = operateCache(pte_addr, false, l1);
+  latency += l1->hitLatency;
+
+  if (r.status != CACHE_HIT) {
+    latency += access_lower(below(h), 0, pte_addr, r.fill_bytes, NULL);
+    latency += victim_l1(h, l1, r);
+  }
+  return latency;
+}
+
+/* Access the hierarchy for one instruction fetch, load or store (type).
+ * Fetches use the L1I when it exists; without one the pipeline only
+ * translates them (hierarchyTranslateFetch).
+ * pc is the address of the instruction doing the access and cycle the current
+ * cycle, both are used by the data prefetcher.
+ * Write-through stores are assumed to drain through a write buffer, so they add
+ * memory traffic but no latency; dirty evictions add their write-back latency.
+ * The L1 result is copied to l1_result (if not NULL) for cache traces.
+ * With the TLBs enabled the address is virtual and translated first.
+ * Main memory sees the cycle plus the stalls of the accesses so far, as the
+ * pipeline does not count its memory stalls into the cycle.
+ * Returns the total latency of the access in cycles.
+ */
+static int access_hierarchy(CacheHierarchy *h, unsigned long long address, unsigned long long pc, uint64_t cycle,
+                            int type, result *l1_result) {
+  bool isInstr = (type == ACCESS_FETCH);
+  bool isWrite = (type == ACCESS_STORE);
+  Cache *l1 = (isInstr && h->hasL1I) ? &h->l1i : &h->l1d;
+  int side = isInstr ? index_instr : index_data;
+  Prefetcher *pf = l1->prefetcher;
+  bool trigger = false;
+  L1Timing *timing = (h->hasL1Timing && l1 == &h->l1d) ? &h->l1timing : NULL;
+
+  address += h->regionBase;
+  if (h->capture != NULL)
+    traceAppend(h->capture, address, pc, cycle, type);
+  h->now = cycle + h->stall_cycles;
+  int translation = h->hasTlb ? tlbTranslate(&h->tlb, address, isInstr, walk_read, h) : 0;
+  int coherence = l1 == &h->l1d ? coherence_access(h, address, isWrite) : 0;
+
+  result r = operateCache(address, isWrite, l1);
+  if (h->stackdist != NULL && l1 == &h->l1d)
+    stackDistAccess(h->stackdist, address);
+  if (h->attrib != NULL && l1 == &h->l1d)
+    missAttribAccess(h->attrib, address, pc, type, r.status != CACHE_HIT);
+  int latency = l1->hitLatency;
+  if (timing != NULL) {
+    unsigned long long set = cache_set(address, l1);
+    latency = l1TimingBank(timing, address >> l1->blockBits, h->now, true);
+    if (r.status == CACHE_HIT) {
+      latency += l1TimingHit(timing, set, pc, r.way, l1->hitLatency);
+    } else {
+      latency += l1->hitLatency;
+      l1TimingFill(timing, set, pc, r.way); // way is -1 for a write-around
+    }
+  }
+
+  if (r.status == CACHE_HIT) {
+    // First demand hit on a prefetched line: the prefetch was useful, maybe late
+    if (pf != NULL) {
+      Line *line = find_cacheline(address, l1);
+      if (line->prefetched) {
+        pf->stats.useful++;
+        if (line->ready_cycle > cycle) {
+          pf->stats.late++;
+          latency += line->ready_cycle - cycle;
+        }
+        line->prefetched = false;
+        trigger = true;
+      }
+    }
+  } else if (!r.write_around) {
+    uint64_t ready;
+    bool dirty_up = false;
+    trigger = true;
+    // a sector miss leaves the line in place, only its missing sector is fetched
+    if (!r.sector_miss && h->hasVictim && l1 == &h->l1d && victim_probe(h, address, &dirty_up)) {
+      latency += h->victim.hitLatency;
+    } else if (!r.sector_miss && pf != NULL && pf->params.kind == PREFETCH_STREAM &&
+        streamAccess(pf, r.insert_block_addr, l1->blockBits, cycle, &ready, stream_fetch, h)) {
+      // served by a stream buffer, only wait for data still in flight
+      if (ready > cycle)
+        latency += ready - cycle;
+    } else {
+      latency += access_lower(below(h), 0, address, r.fill_bytes, &dirty_up);
+    }
+    if (dirty_up)
+      find_cacheline(address, l1)->dirty = true;
+    latency += victim_l1(h, l1, r);
+  }
+
+  // Write-through: every store also goes to the next level
+  if (isWrite && l1->writePolicy == WRITE_THROUGH)
+    write_lower(below(h), 0, address);
+
+  if (pf != NULL && pf->params.kind != PREFETCH_STREAM)
+    issue_prefetches(h, address, pc, cycle, trigger);
+
+  latency += translation + coherence;
+  h->accesses[side]++;
+  h->total_latency[side] += latency;
+  if (latency > 1)
+    h->stall_cycles += latency - 1;
+
+  if (l1_result != NULL)
+    *l1_result = r;
+  return latency;
+}
+
+// Write back and invalidate every line of an L1 or of the victim cache
+static int flush_l1(CacheHierarchy *h, Cache *l1) {
+  int sectorBytes = 1 << (l1->blockBits - l1->sectorBits);
+  int latency = 0;
+
+  for (unsigned long long set = 0; set < (1ULL << l1->setBits); set++) {
+    for (uint64_t valid = l1->valid[set]; valid != 0; valid &= valid - 1) {
+      Line *line = &l1->lines[set * l1->linesPerSet + __builtin_ctzll(valid)];
+      result r = {.status = CACHE_EVICT, .victim_block_addr = line->block_addr, .victim_dirty = line->dirty};
+      r.victim_bytes = line->sectorDirty ? __builtin_popcountll(line->sectorDirty) * sectorBytes
+                                         : 1 << l1->blockBits;
+      invalidate_cacheline(line->block_addr, l1, NULL);
+      latency += victim_l1(h, l1, r);
+    }
+  }
+  return latency;
+}
+
+/* Empty the L1s as a context switch that flushes them does: dirty lines are
+ * written back (exclusive hierarchies spill every line) and the victim cache
+ * is emptied after them. Returns the cycles the write-backs take.
+ */
+int hierarchyFlushL1(CacheHierarchy *h) {
+  int latency = flush_l1(h, &h->l1d);
+  if (h->hasL1I)
+    latency += flush_l1(h, &h->l1i);
+  if (h->hasVictim)
+    latency += flush_l1(h, &h->victim);
+  return latency;
+}
+
+/* Access the hierarchy for one instruction fetch, load or store, see
+ * access_hierarchy. The cores of a multicore run share the levels below their
+ * L1s and each other's L1Ds through the directory, so they take turns.
+ */
+int hierarchyAccess(CacheHierarchy *h, unsigned long long address, unsigned long long pc, uint64_t cycle,
+                    int type, result *l1_result) {
+  if (h->lock == NULL)
+    return access_hierarchy(h, address, pc, cycle, type, l1_result);
+
+  pthread_mutex_lock(h->lock);
+  int latency = access_hierarchy(h, address, pc, cycle, type, l1_result);
+  pthread_mutex_unlock(h->lock);
+  return latency;
+}
+
+/* Without an L1I the pipeline fetches outside the caches, but with the TLBs
+ * enabled a fetch is still translated through the ITLB. Page walks read
+ * through the L1D. Returns the cycles translation adds to the fetch.
+ */
+int hierarchyTranslateFetch(CacheHierarchy *h, unsigned long long address, uint64_t cycle) {
+  if (h->lock != NULL)
+    pthread_mutex_lock(h->lock);
+  h->now = cycle + h->stall_cycles;
+  int latency = tlbTranslate(&h->tlb, address + h->regionBase, true, walk_read, h);
+  h->stall_cycles += latency;
+  if (h->lock != NULL)
+    pthread_mutex_unlock(h->lock);
+  return latency;
+}
+
+static void print_level(const Cache *cache) {
+  static const char *write_policy[] = {"write-back", "write-through"};
+  int sets = 1 << cache->setBits;
+  int block = 1 << cache->blockBits;
+  printf("%-3s %d B: %d sets x %d ways x %d B, %s, %s, %d cycles", cache->name,
+         sets * cache->linesPerSet * block, sets, cache->linesPerSet, block,
+         replacementName(cache->replacement), write_policy[cache->writePolicy], cache->hitLatency);
+  if (cache->sectorBits > 0)
+    printf(", %d sectors of %d B", 1 << cache->sectorBits, block >> cache->sectorBits);
+  if (cache->indexing == INDEX_PRIME)
+    printf(", prime index (%llu sets used)", cache->primeSets);
+  else if (cache->indexing != INDEX_MODULO)
+    printf(", %s index", cacheIndexName(cache->indexing));
+  printf("\n");
+  uint64_t accesses = cache->hit_count + cache->miss_count;
+  double missRate = accesses ? (double)cache->miss_count / accesses : 0.0;
+  printf("%-3s hits: %llu, misses: %llu, evictions: %llu, writebacks: %llu, back-invalidations: %llu, miss rate: %.4f\n",
+         cache->name, (unsigned long long)cache->hit_count, (unsigned long long)cache->miss_count,
+         (unsigned long long)cache->eviction_count, (unsigned long long)cache->writeback_count,
+         (unsigned long long)cache->backinval_count, missRate);
+  printf("%-3s bytes fetched: %llu, referenced: %llu (%.4f)", cache->name,
+         (unsigned long long)cache->bytes_fetched, (unsigned long long)cache->bytes_referenced,
+         cache->bytes_fetched ? (double)cache->bytes_referenced / cache->bytes_fetched : 0.0);
+  if (cache->sectorBits > 0)
+    printf(", sector misses: %llu", (unsigned long long)cache->sector_miss_count);
+  printf("\n");
+  printReplacementSummary(&cache->repl, cache->name);
+}
+
+// print out per-level stats and the average memory access time of each side
+void printHierarchySummary(const CacheHierarchy *h) {
+  static const char *policy[] = {"non-inclusive", "inclusive", "exclusive"};
+  static const char *write_policy[] = {"write-back", "write-through"};
+
+  if (h->cores > 0) {
+    printf("Shared levels of %d cores (%s)\n", h->cores, policy[h->inclusion]);
+  } else {
+    printf("Cache hierarchy (%s, L1D %s)\n", policy[h->inclusion], write_policy[h->l1d.writePolicy]);
+    if (h->hasL1I)
+      print_level(&h->l1i);
+    print_level(&h->l1d);
+  }
+  for (int i = 0; i < h->numLower; i++)
+    print_level(&h->lower[i]);
+  if (h->hasVictim) {
+    const Cache *vc = &h->victim;
+    printf("VC  %d entries x %d B, LRU, %d cycles\n", vc->linesPerSet, 1 << vc->blockBits, vc->hitLatency);
+    printf("VC  hits: %llu, misses: %llu, evictions: %llu, writebacks: %llu, L1D misses recovered: %.4f\n",
+           (unsigned long long)vc->hit_count, (unsigned long long)vc->miss_count,
+           (unsigned long long)vc->eviction_count, (unsigned long long)vc->writeback_count,
+           h->l1d.miss_count ? (double)vc->hit_count / h->l1d.miss_count : 0.0);
+  }
+  if (h->hasL1Timing)
+    printL1TimingSummary(&h->l1timing);
+  if (h->l1d.prefetcher != NULL)
+    printPrefetchSummary(h->l1d.prefetcher, h->l1d.miss_count);
+  if (h->hasTlb)
+    printTlbSummary(&h->tlb);
+  if (h->hasDram)
+    printDramSummary(&h->dram);
+  if (h->shared == NULL)
+    printf("Memory reads: %llu, writes: %llu, bytes read: %llu, bytes written: %llu\n",
+           (unsigned long long)h->mem_accesses, (unsigned long long)h->mem_writes,
+           (unsigned long long)h->mem_bytes_read, (unsigned long long)h->mem_bytes_written);
+
+  if (h->accesses[index_data])
+    printf("AMAT (data)       : %.2f cycles\n",
+           (double)h->total_latency[index_data] / h->accesses[index_data]);
+  if (h->accesses[index_instr])
+    printf("AMAT (instruction): %.2f cycles\n",
+           (double)h->total_latency[index_instr] / h->accesses[index_instr]);
+}
@@ -0,0 +1,141 @@
+#ifndef HIERARCHY_H
+#define HIERARCHY_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "config.h"
+#include "cache.h"
+#include "coherence.h"
+#include "dram.h"
+#include "l1timing.h"
+#include "missattr.h"
+#include "prefetch.h"
+#include "stackdist.h"
+#include "tlb.h"
+#include "trace.h"
+
+// Inclusion policy of the lower levels (L2/L3) with respect to the levels above
+enum inclusion_enum {
+  INCLUSION_NINE = 0,      // non-inclusive non-exclusive: fill everywhere, no back-invalidation
+  INCLUSION_INCLUSIVE = 1, // lower level is a superset, its evictions back-invalidate upper levels
+  INCLUSION_EXCLUSIVE = 2  // a block lives in exactly one level, L1 victims spill downwards
+};
+
+// Kind of access made by the pipeline
+enum access_enum {
+  ACCESS_LOAD = 0,
+  ACCESS_STORE = 1,
+  ACCESS_FETCH = 2
+};
+
+#define HIER_MAX_LOWER 2 // L2 and L3
+#define CACHE_WORD_BYTES 4 // size of a store written through to the next level
+
+// Default geometry of the lower levels (L1 uses the CACHE_* values in cache.h),
+// all of them can be changed at runtime, see cache_config.h
+#define L2_SET_BITS 7
+#define L2_LINES_PER_SET 8
+#define L2_BLOCK_BITS 6
+#define L2_HIT_LATENCY 10
+#define L2_REPLACEMENT REPL_LRU
+
+#define L3_SET_BITS 10
+#define L3_LINES_PER_SET 16
+#define L3_BLOCK_BITS 6
+#define L3_HIT_LATENCY 30
+#define L3_REPLACEMENT REPL_LRU
+
+// Optional fully associative victim cache next to the L1D, 0 entries = none
+#ifndef CACHE_VICTIM_ENTRIES
+#define CACHE_VICTIM_ENTRIES 0
+#endif
+#define VICTIM_HIT_LATENCY 1 // cycles added to the L1D lookup when the victim cache hits
+
+#ifndef CACHE_INCLUSION
+#define CACHE_INCLUSION INCLUSION_NINE
+#endif
+
+// Geometry, latency and replacement of one cache level
+typedef struct {
+  bool enable;
+  int setBits;
+  int linesPerSet;
+  int blockBits;
+  int sectorBits; // log2 of the sectors per line
+  int hitLatency;
+  int replacement; // REPL_* policy
+  int indexing; // INDEX_* set index function
+  int writePolicy;
+  long sizeBytes; // requested total size, 0 = use setBits
+} CacheParams;
+
+// Everything needed to build a hierarchy
+typedef struct {
+  CacheParams l1i;
+  CacheParams l1d;
+  CacheParams l2;
+  CacheParams l3;
+  PrefetchParams prefetch; // data cache prefetcher
+  L1TimingParams l1Timing; // way prediction and banking of the L1D
+  int victimEntries; // 0 = no victim cache
+  int victimLatency;
+  int inclusion;
+  int memLatency;
+  int memBusBytes; // bytes main memory moves per cycle, 0 = transfer time not modelled
+  DramParams dram; // banked DRAM instead of the fixed memory latency when enabled
+  TlbParams tlb; // Sv32 translation in front of the L1s when enabled
+  uint64_t replSeed; // seed of the random replacement policies, mixed with the level
+} HierarchyParams;
+
+typedef struct CacheHierarchy {
+  Cache l1i;
+  Cache l1d;
+  Cache lower[HIER_MAX_LOWER]; // [0] = L2, [1] = L3
+  Cache victim; // one fully associative LRU set holding recent L1D victims
+  bool hasL1I;
+  bool hasVictim;
+  int numLower;
+  Prefetcher prefetcher; // attached to the L1D when enabled
+  L1Timing l1timing;
+  bool hasL1Timing;
+  Tlb tlb;
+  bool hasTlb;
+  StackDist *stackdist; // records the L1D demand stream when not NULL
+  AccessTrace *capture; // records every access for a later sweep when not NULL
+  MissAttrib *attrib; // classifies the L1D misses per instruction and region when not NULL
+  int inclusion;
+  int memLatency;
+  int memBusBytes;
+  Dram dram;
+  bool hasDram;
+  uint64_t now; // cycle of the current access as seen by main memory
+  uint64_t stall_cycles; // latency beyond one cycle per access so far, the core's memory stalls
+  unsigned long long regionBase; // added to every address: guest region of the running program
+
+  // Multicore runs: each core has private L1s and shares the levels below them
+  struct CacheHierarchy *shared; // levels below the L1s when not NULL, its own L1s are unused
+  Coherence *coherence; // MESI directory over the L1Ds of the cores when not NULL
+  int core; // index of this core in the directory
+  int cores; // > 0 for the shared hierarchy of that many cores
+  pthread_mutex_t *lock; // held for every access when not NULL
+
+  // Stats for AMAT, split by instruction and data side
+  uint64_t accesses[2];
+  uint64_t total_latency[2];
+  uint64_t mem_accesses; // block reads that reached main memory
+  uint64_t mem_writes; // write-backs and write-through stores that reached main memory
+  uint64_t mem_bytes_read;
+  uint64_t mem_bytes_written;
+} CacheHierarchy;
+
+void hierarchyDefaultParams(HierarchyParams *params);
+int hierarchySetUp(CacheHierarchy *h, const HierarchyParams *params);
+void hierarchyDeallocate(CacheHierarchy *h);
+int hierarchyAccess(CacheHierarchy *h, unsigned long long address, unsigned long long pc, uint64_t cycle,
+                    int type, result *l1_result);
+int hierarchyTranslateFetch(CacheHierarchy *h, unsigned long long address, uint64_t cycle);
+int hierarchyFlushL1(CacheHierarchy *h);
+void printHierarchySummary(const CacheHierarchy *h);
+
+#endif // HIERARCHY_H
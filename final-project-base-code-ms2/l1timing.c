@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "l1timing.h"
+
+static const char *waypred_names[] = {"none", "mru", "pc"};
+
+void l1TimingDefaultParams(L1TimingParams *params) {
+  params->wayPred = WAYPRED_NONE;
+  params->pcEntries = WAYPRED_PC_ENTRIES;
+  params->fastLatency = WAYPRED_FAST_LATENCY;
+  params->penalty = WAYPRED_PENALTY;
+  params->banks = L1_BANKS;
+  params->bankBusy = L1_BANK_BUSY;
+}
+
+// Map a way predictor name to its enum, -1 if unknown
+int wayPredParse(const char *name) {
+  for (int i = 0; i < (int)(sizeof(waypred_names) / sizeof(waypred_names[0])); i++) {
+    if (strcmp(name, waypred_names[i]) == 0)
+      return i;
+  }
+  return -1;
+}
+
+const char *wayPredName(int kind) {
+  return waypred_names[kind];
+}
+
+// True when the L1D needs more than its fixed hit latency
+bool l1TimingEnabled(const L1TimingParams *params) {
+  return params->wayPred != WAYPRED_NONE || params->banks > 1;
+}
+
+void l1TimingSetUp(L1Timing *t, const L1TimingParams *params, int setBits) {
+  memset(t, 0, sizeof(*t));
+  t->params = *params;
+  t->numSets = 1ULL << setBits;
+  if (params->wayPred == WAYPRED_MRU)
+    t->mru = calloc(t->numSets, sizeof(uint8_t));
+  if (params->wayPred == WAYPRED_PC)
+    t->pcWays = calloc(params->pcEntries, sizeof(uint8_t));
+  t->bankFree = calloc(params->banks, sizeof(uint64_t));
+}
+
+void l1TimingDeallocate(L1Timing *t) {
+  free(t->mru);
+  free(t->pcWays);
+  free(t->bankFree);
+  t->mru = NULL;
+  t->pcWays = NULL;
+  t->bankFree = NULL;
+}
+
+static uint8_t *predicted_way(L1Timing *t, unsigned long long set, unsigned long long pc) {
+  if (t->params.wayPred == WAYPRED_MRU)
+    return &t->mru[set];
+  return &t->pcWays[(pc >> 2) % t->params.pcEntries];
+}
+
+/* Latency of a hit in `way`: the fast latency when the predictor picked that
+ * way, otherwise the full hit latency plus the misprediction penalty. The
+ * predictor then learns the way.
+ */
+int l1TimingHit(L1Timing *t, unsigned long long set, unsigned long long pc, int way, int hitLatency) {
+  if (t->params.wayPred == WAYPRED_NONE)
+    return hitLatency;
+
+  uint8_t *pred = predicted_way(t, set, pc);
+  int latency = t->params.fastLatency;
+  t->stats.predictions++;
+  if (*pred == way) {
+    t->stats.correct++;
+  } else {
+    latency = hitLatency + t->params.penalty;
+    t->stats.penalty_cycles += latency - t->params.fastLatency;
+    *pred = way;
+  }
+  return latency;
+}
+
+// A demand miss filled `way`, the next access is likely to hit it
+void l1TimingFill(L1Timing *t, unsigned long long set, unsigned long long pc, int way) {
+  if (t->params.wayPred != WAYPRED_NONE && way >= 0)
+    *predicted_way(t, set, pc) = way;
+}
+
+/* Reserve the bank of a block at `cycle`. A demand access waits until the bank
+ * is free and returns the stall cycles; a prefetch fill (demand = false) is
+ * queued behind whatever holds the bank and never stalls the pipeline itself.
+ */
+int l1TimingBank(L1Timing *t, unsigned long long block, uint64_t cycle, bool demand) {
+  if (t->params.banks <= 1)
+    return 0;
+
+  uint64_t *free_at = &t->bankFree[block % t->params.banks];
+  uint64_t start = *free_at > cycle ? *free_at : cycle;
+  int stall = 0;
+
+  t->stats.bank_accesses++;
+  if (demand && start > cycle) {
+    stall = start - cycle;
+    t->stats.bank_conflicts++;
+    t->stats.bank_stall_cycles += stall;
+  }
+  *free_at = start + t->params.bankBusy;
+  return stall;
+}
+
+void printL1TimingSummary(const L1Timing *t) {
+  const L1TimingStats *s = &t->stats;
+
+  if (t->params.wayPred != WAYPRED_NONE) {
+    printf("Way prediction (%s): %llu predicted hits, %llu correct, accuracy: %.4f, penalty cycles: %llu\n",
+           wayPredName(t->params.wayPred), (unsigned long long)s->predictions, (unsigned long long)s->correct,
+           s->predictions ? (double)s->correct / s->predictions : 0.0, (unsigned long long)s->penalty_cycles);
+  }
+  if (t->params.banks > 1) {
+    printf("L1D banks (%d, %d cycle busy): %llu accesses, %llu conflicts, stall cycles: %llu\n",
+           t->params.banks, t->params.bankBusy, (unsigned long long)s->bank_accesses,
+           (unsigned long long)s->bank_conflicts, (unsigned long long)s->bank_stall_cycles);
+  }
+}
@@ -0,0 +1,66 @@
+#ifndef L1TIMING_H
+#define L1TIMING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Way predictors of the L1D
+enum waypred_enum {
+  WAYPRED_NONE = 0, // every hit takes the full hit latency
+  WAYPRED_MRU = 1,  // predict the most recently used way of the set
+  WAYPRED_PC = 2    // predict the way the same load/store hit last time
+};
+
+#define WAYPRED_PC_ENTRIES 256   // PC-indexed way table size
+#define WAYPRED_FAST_LATENCY 1   // hit latency when only the predicted way is read
+#define WAYPRED_PENALTY 1        // cycles added to the hit latency on a misprediction
+#define L1_BANKS 1               // L1D banks, interleaved by block
+#define L1_BANK_BUSY 1           // cycles a bank is occupied by one access
+#define L1_MAX_BANKS 64
+
+typedef struct {
+  int wayPred;
+  int pcEntries;
+  int fastLatency;
+  int penalty;
+  int banks;
+  int bankBusy;
+} L1TimingParams;
+
+typedef struct {
+  uint64_t predictions;    // hits that used a prediction
+  uint64_t correct;        // predicted way held the block
+  uint64_t penalty_cycles; // cycles added by mispredictions
+  uint64_t bank_accesses;  // demand accesses and prefetch fills that used a bank
+  uint64_t bank_conflicts; // demand accesses that found their bank busy
+  uint64_t bank_stall_cycles;
+} L1TimingStats;
+
+/* Timing of the L1D beyond a fixed hit latency. A way-predicted cache reads
+ * only the predicted way first: a correct prediction is a fast hit, a wrong
+ * one reads the other ways afterwards and pays a penalty. A banked cache
+ * serves one access per bank at a time, so a demand access can collide with
+ * a prefetch fill or with a demand access still holding its bank. Fetches
+ * never reach these banks: they use the L1I or stay out of the hierarchy.
+ */
+typedef struct {
+  L1TimingParams params;
+  uint8_t *mru;        // MRU way per set
+  uint8_t *pcWays;     // last hit way per PC table entry
+  unsigned long long numSets;
+  uint64_t *bankFree;  // first cycle each bank is free again
+  L1TimingStats stats;
+} L1Timing;
+
+void l1TimingDefaultParams(L1TimingParams *params);
+int wayPredParse(const char *name);
+const char *wayPredName(int kind);
+void l1TimingSetUp(L1Timing *t, const L1TimingParams *params, int setBits);
+void l1TimingDeallocate(L1Timing *t);
+bool l1TimingEnabled(const L1TimingParams *params);
+int l1TimingHit(L1Timing *t, unsigned long long set, unsigned long long pc, int way, int hitLatency);
+void l1TimingFill(L1Timing *t, unsigned long long set, unsigned long long pc, int way);
+int l1TimingBank(L1Timing *t, unsigned long long block, uint64_t cycle, bool demand);
+void printL1TimingSummary(const L1Timing *t);
+
+#endif // L1TIMING_H
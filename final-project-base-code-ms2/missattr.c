@@ -0,0 +1,263 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hierarchy.h"
+#include "missattr.h"
+
+static const char *region_names[REGIONS] = {"code", "stack", "globals", "data"};
+
+static void *checked_calloc(size_t count, size_t size) {
+  void *p = calloc(count, size);
+  if (p == NULL) {
+    fprintf(stderr, "Error - out of memory for the miss attribution\n");
+    exit(EXIT_FAILURE);
+  }
+  return p;
+}
+
+static uint64_t hash_slot(unsigned long long key, uint64_t size) {
+  unsigned long long h = key * 0x9E3779B97F4A7C15ULL;
+  return (h ^ (h >> 32)) & (size - 1);
+}
+
+static uint64_t block_slot(const MissAttrib *ma, unsigned long long block) {
+  uint64_t s = hash_slot(block, ma->blockSize);
+  while (ma->blockLines[s] != ATTR_EMPTY && ma->blockKeys[s] != block)
+    s = (s + 1) & (ma->blockSize - 1);
+  return s;
+}
+
+static void block_grow(MissAttrib *ma) {
+  unsigned long long *oldKeys = ma->blockKeys;
+  int32_t *oldLines = ma->blockLines;
+  uint64_t oldSize = ma->blockSize;
+
+  ma->blockSize *= 2;
+  ma->blockKeys = checked_calloc(ma->blockSize, sizeof(unsigned long long));
+  ma->blockLines = checked_calloc(ma->blockSize, sizeof(int32_t));
+  for (uint64_t i = 0; i < ma->blockSize; i++)
+    ma->blockLines[i] = ATTR_EMPTY;
+  for (uint64_t i = 0; i < oldSize; i++) {
+    if (oldLines[i] == ATTR_EMPTY)
+      continue;
+    uint64_t s = block_slot(ma, oldKeys[i]);
+    ma->blockKeys[s] = oldKeys[i];
+    ma->blockLines[s] = oldLines[i];
+  }
+  free(oldKeys);
+  free(oldLines);
+}
+
+static AttrPc *pc_entry(MissAttrib *ma, unsigned long long pc) {
+  uint64_t s = hash_slot(pc, ma->pcSize);
+  while (ma->pcValid[s] && ma->pcs[s].pc != pc)
+    s = (s + 1) & (ma->pcSize - 1);
+  if (ma->pcValid[s])
+    return &ma->pcs[s];
+
+  if ((ma->pcUsed + 1) * 2 > ma->pcSize) {
+    AttrPc *oldPcs = ma->pcs;
+    bool *oldValid = ma->pcValid;
+    uint64_t oldSize = ma->pcSize;
+    ma->pcSize *= 2;
+    ma->pcs = checked_calloc(ma->pcSize, sizeof(AttrPc));
+    ma->pcValid = checked_calloc(ma->pcSize, sizeof(bool));
+    for (uint64_t i = 0; i < oldSize; i++) {
+      if (!oldValid[i])
+        continue;
+      uint64_t t = hash_slot(oldPcs[i].pc, ma->pcSize);
+      while (ma->pcValid[t])
+        t = (t + 1) & (ma->pcSize - 1);
+      ma->pcs[t] = oldPcs[i];
+      ma->pcValid[t] = true;
+    }
+    free(oldPcs);
+    free(oldValid);
+    return pc_entry(ma, pc);
+  }
+  ma->pcValid[s] = true;
+  ma->pcUsed++;
+  memset(&ma->pcs[s], 0, sizeof(AttrPc));
+  ma->pcs[s].pc = pc;
+  return &ma->pcs[s];
+}
+
+static void shadow_unlink(MissAttrib *ma, int32_t line) {
+  if (ma->prev[line] >= 0)
+    ma->next[ma->prev[line]] = ma->next[line];
+  else
+    ma->head = ma->next[line];
+  if (ma->next[line] >= 0)
+    ma->prev[ma->next[line]] = ma->prev[line];
+  else
+    ma->tail = ma->prev[line];
+}
+
+static void shadow_push(MissAttrib *ma, int32_t line) {
+  ma->prev[line] = -1;
+  ma->next[line] = ma->head;
+  if (ma->head >= 0)
+    ma->prev[ma->head] = line;
+  ma->head = line;
+  if (ma->tail < 0)
+    ma->tail = line;
+}
+
+/* Bring the block to the top of the shadow cache, evicting the least recently
+ * used line when it is full. slot is the block's entry in the block table.
+ */
+static void shadow_access(MissAttrib *ma, uint64_t slot) {
+  int32_t line = ma->blockLines[slot];
+  if (line >= 0) {
+    shadow_unlink(ma, line);
+  } else if (ma->used < ma->lines) {
+    line = ma->used++;
+  } else {
+    line = ma->tail;
+    shadow_unlink(ma, line);
+    ma->blockLines[block_slot(ma, ma->shadowBlocks[line])] = -1;
+  }
+  ma->shadowBlocks[line] = ma->blockKeys[slot];
+  ma->blockLines[slot] = line;
+  shadow_push(ma, line);
+}
+
+void missAttribSetUp(MissAttrib *ma, int blockBits, int lines, unsigned long long textStart,
+                     unsigned long long textEnd, unsigned long long stackPointer,
+                     unsigned long long globalPointer) {
+  memset(ma, 0, sizeof(*ma));
+  ma->blockBits = blockBits;
+  ma->lines = lines;
+  ma->blockSize = ATTR_HASH_INITIAL;
+  ma->blockKeys = checked_calloc(ma->blockSize, sizeof(unsigned long long));
+  ma->blockLines = checked_calloc(ma->blockSize, sizeof(int32_t));
+  for (uint64_t i = 0; i < ma->blockSize; i++)
+    ma->blockLines[i] = ATTR_EMPTY;
+  ma->shadowBlocks = checked_calloc(lines, sizeof(unsigned long long));
+  ma->prev = checked_calloc(lines, sizeof(int32_t));
+  ma->next = checked_calloc(lines, sizeof(int32_t));
+  ma->head = ma->tail = -1;
+  ma->pcSize = ATTR_HASH_INITIAL;
+  ma->pcs = checked_calloc(ma->pcSize, sizeof(AttrPc));
+  ma->pcValid = checked_calloc(ma->pcSize, sizeof(bool));
+  ma->textStart = textStart;
+  ma->textEnd = textEnd;
+  ma->stackPointer = stackPointer;
+  ma->globalPointer = globalPointer;
+}
+
+void missAttribDeallocate(MissAttrib *ma) {
+  free(ma->blockKeys);
+  free(ma->blockLines);
+  free(ma->shadowBlocks);
+  free(ma->prev);
+  free(ma->next);
+  free(ma->pcs);
+  free(ma->pcValid);
+  memset(ma, 0, sizeof(*ma));
+}
+
+int missAttribRegion(const MissAttrib *ma, unsigned long long address) {
+  if (address >= ma->textStart && address < ma->textEnd)
+    return REGION_CODE;
+  if (address + ATTR_GLOBAL_BYTES >= ma->globalPointer && address < ma->globalPointer + ATTR_GLOBAL_BYTES)
+    return REGION_GLOBALS;
+  if (address + ATTR_STACK_BYTES > ma->stackPointer && address <= ma->stackPointer)
+    return REGION_STACK;
+  return REGION_DATA;
+}
+
+static void count(AttrCounts *c, int type, int miss_class) {
+  if (type == ACCESS_LOAD)
+    c->loads++;
+  else if (type == ACCESS_STORE)
+    c->stores++;
+  else
+    c->fetches++;
+  if (miss_class >= 0)
+    c->misses[miss_class]++;
+}
+
+/* Record one L1D access and whether it missed. Fetches only reach the L1D when
+ * there is no L1I; they shape its contents but are charged to the code region
+ * only, not to an instruction.
+ */
+void missAttribAccess(MissAttrib *ma, unsigned long long address, unsigned long long pc, int type, bool miss) {
+  unsigned long long block = address >> ma->blockBits;
+  uint64_t slot = block_slot(ma, block);
+  int miss_class = -1;
+
+  if (ma->blockLines[slot] == ATTR_EMPTY) {
+    ma->blockKeys[slot] = block;
+    ma->blockLines[slot] = -1;
+    ma->blockUsed++;
+    if (miss)
+      miss_class = MISS_COMPULSORY;
+  } else if (miss) {
+    miss_class = ma->blockLines[slot] < 0 ? MISS_CAPACITY : MISS_CONFLICT;
+  }
+  shadow_access(ma, slot);
+  if (ma->blockUsed * 2 > ma->blockSize)
+    block_grow(ma);
+
+  int region = missAttribRegion(ma, address);
+  count(&ma->regions[region], type, miss_class);
+  if (type != ACCESS_FETCH) {
+    AttrPc *entry = pc_entry(ma, pc);
+    entry->region = region;
+    count(&entry->counts, type, miss_class);
+  }
+}
+
+static uint64_t total_misses(const AttrCounts *c) {
+  return c->misses[MISS_COMPULSORY] + c->misses[MISS_CAPACITY] + c->misses[MISS_CONFLICT];
+}
+
+static void print_counts(const AttrCounts *c) {
+  printf("%8llu %8llu %8llu %8llu %8llu %8llu %8llu",
+         (unsigned long long)c->loads, (unsigned long long)c->stores, (unsigned long long)c->fetches,
+         (unsigned long long)total_misses(c), (unsigned long long)c->misses[MISS_COMPULSORY],
+         (unsigned long long)c->misses[MISS_CAPACITY], (unsigned long long)c->misses[MISS_CONFLICT]);
+}
+
+// most misses first, then by address
+static int compare_pcs(const void *a, const void *b) {
+  const AttrPc *x = *(const AttrPc *const *)a, *y = *(const AttrPc *const *)b;
+  uint64_t mx = total_misses(&x->counts), my = total_misses(&y->counts);
+  if (mx != my)
+    return mx < my ? 1 : -1;
+  return x->pc < y->pc ? -1 : x->pc > y->pc;
+}
+
+// Per-region and per-instruction access and miss counts, instructions with the most misses first
+void printMissAttribSummary(const MissAttrib *ma, attr_disasm_fn disasm) {
+  static const char *header = "   loads   stores  fetches   misses     comp      cap     conf";
+
+  printf("Miss attribution (L1D, %d lines of %d B, shadow fully associative LRU)\n",
+         ma->lines, 1 << ma->blockBits);
+  printf("%-10s%s\n", "region", header);
+  for (int r = 0; r < REGIONS; r++) {
+    printf("%-10s", region_names[r]);
+    print_counts(&ma->regions[r]);
+    printf("\n");
+  }
+
+  const AttrPc **order = checked_calloc(ma->pcUsed ? ma->pcUsed : 1, sizeof(AttrPc *));
+  uint64_t n = 0;
+  for (uint64_t i = 0; i < ma->pcSize; i++)
+    if (ma->pcValid[i])
+      order[n++] = &ma->pcs[i];
+  qsort(order, n, sizeof(order[0]), compare_pcs);
+
+  printf("%-10s%s %-8s instruction\n", "pc", header, "region");
+  for (uint64_t i = 0; i < n; i++) {
+    printf("%08llx  ", order[i]->pc);
+    print_counts(&order[i]->counts);
+    printf(" %-8s ", region_names[order[i]->region]);
+    if (disasm != NULL)
+      disasm(order[i]->pc);
+    else
+      printf("\n");
+  }
+  free(order);
+}
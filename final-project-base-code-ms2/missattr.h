@@ -0,0 +1,88 @@
+#ifndef MISSATTR_H
+#define MISSATTR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Three C classification of a miss
+enum miss_class_enum {
+  MISS_COMPULSORY = 0, // first touch of the block
+  MISS_CAPACITY = 1,   // also misses in a fully associative LRU cache of the same size
+  MISS_CONFLICT = 2,   // hits in that fully associative cache, lost to the mapping or the policy
+  MISS_CLASSES = 3
+};
+
+// Address regions of the simulated program
+enum region_enum {
+  REGION_CODE = 0,    // program text
+  REGION_STACK = 1,   // below the initial stack pointer (R[2])
+  REGION_GLOBALS = 2, // reachable with a 12-bit offset from the global pointer (R[3])
+  REGION_DATA = 3,    // anything else: user arrays
+  REGIONS = 4
+};
+
+#define ATTR_STACK_BYTES 0x10000 // stack region below the initial stack pointer
+#define ATTR_GLOBAL_BYTES 0x800  // signed 12-bit offset range around the global pointer
+#define ATTR_HASH_INITIAL 1024
+#define ATTR_EMPTY INT32_MIN // free slot of the block table
+
+// Accesses and misses of one instruction or one region
+typedef struct {
+  uint64_t loads;
+  uint64_t stores;
+  uint64_t fetches;
+  uint64_t misses[MISS_CLASSES];
+} AttrCounts;
+
+typedef struct {
+  unsigned long long pc;
+  int region; // region of the last address this instruction touched
+  AttrCounts counts;
+} AttrPc;
+
+/* Miss attribution of the L1D. Every access is classified against a shadow fully
+ * associative LRU cache with as many lines as the L1D, and its counts are charged
+ * to the region of its address and, for loads and stores, to the instruction
+ * that issued it.
+ */
+typedef struct {
+  int blockBits;
+  int lines;
+  // block number -> shadow line holding it, -1 once evicted; blocks are never
+  // removed so the table also records which blocks were ever touched
+  unsigned long long *blockKeys;
+  int32_t *blockLines;
+  uint64_t blockSize;
+  uint64_t blockUsed;
+  // shadow cache, doubly linked from most to least recently used
+  unsigned long long *shadowBlocks;
+  int32_t *prev;
+  int32_t *next;
+  int32_t head;
+  int32_t tail;
+  int used;
+  // instruction address -> AttrPc, open addressing
+  AttrPc *pcs;
+  bool *pcValid;
+  uint64_t pcSize;
+  uint64_t pcUsed;
+  // region bounds
+  unsigned long long textStart;
+  unsigned long long textEnd;
+  unsigned long long stackPointer;
+  unsigned long long globalPointer;
+  AttrCounts regions[REGIONS];
+} MissAttrib;
+
+// Prints the disassembly of the instruction at pc, ending the line
+typedef void (*attr_disasm_fn)(unsigned long long pc);
+
+void missAttribSetUp(MissAttrib *ma, int blockBits, int lines, unsigned long long textStart,
+                     unsigned long long textEnd, unsigned long long stackPointer,
+                     unsigned long long globalPointer);
+void missAttribDeallocate(MissAttrib *ma);
+void missAttribAccess(MissAttrib *ma, unsigned long long address, unsigned long long pc, int type, bool miss);
+int missAttribRegion(const MissAttrib *ma, unsigned long long address);
+void printMissAttribSummary(const MissAttrib *ma, attr_disasm_fn disasm);
+
+#endif // MISSATTR_H
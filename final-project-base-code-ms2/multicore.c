@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "multicore.h"
+
+/* Build the shared levels and the private L1s of every core. The directory
+ * only follows the L1Ds, so the hierarchy must be non-inclusive with write-back
+ * L1Ds and without the victim cache or a prefetcher, which would move blocks
+ * into an L1D behind its back. Returns 0 on success, -1 on a bad configuration.
+ */
+int multicoreSetUp(MultiCore *mc, int cores, int quantum, const HierarchyParams *params) {
+  if (cores < 1 || cores > MC_MAX_CORES) {
+    fprintf(stderr, "Error - 1 to %d cores\n", MC_MAX_CORES);
+    return -1;
+  }
+  if (quantum < 1) {
+    fprintf(stderr, "Error - the quantum must be at least 1 cycle\n");
+    return -1;
+  }
+  if (params->inclusion != INCLUSION_NINE || params->l1d.writePolicy != WRITE_BACK ||
+      params->victimEntries > 0 || params->prefetch.kind != PREFETCH_NONE) {
+    fprintf(stderr, "Error - multicore runs need a non-inclusive hierarchy with write-back L1Ds, "
+                    "no victim cache and no prefetcher\n");
+    return -1;
+  }
+
+  HierarchyParams shared = *params;
+  shared.l1i.enable = false;
+  HierarchyParams local = *params;
+  local.l2.enable = local.l3.enable = false;
+  local.dram.enable = false;
+
+  memset(mc, 0, sizeof(*mc));
+  mc->cores = cores;
+  mc->quantum = quantum;
+  if (hierarchySetUp(&mc->shared, &shared) != 0)
+    return -1;
+  mc->shared.cores = cores;
+  coherenceSetUp(&mc->coherence, cores, params->l1d.blockBits, COHERENCE_LATENCY);
+  pthread_mutex_init(&mc->lock, NULL);
+  pthread_mutex_init(&mc->sync, NULL);
+  pthread_cond_init(&mc->cond, NULL);
+
+  for (int i = 0; i < cores; i++) {
+    Core *core = &mc->core[i];
+    core->id = i;
+    core->mc = mc;
+    // every core gets its own random streams
+    local.replSeed = params->replSeed + 16 * (i + 1);
+    if (hierarchySetUp(&core->hier, &local) != 0)
+      return -1;
+    core->hier.shared = &mc->shared;
+    core->hier.coherence = &mc->coherence;
+    core->hier.core = i;
+    core->hier.lock = &mc->lock;
+    mc->coherence.l1[i] = &core->hier.l1d;
+  }
+  return 0;
+}
+
+// Start every core from the boot register state, with its hart id and stack
+void multicoreReset(MultiCore *mc, const regfile_t *boot) {
+  for (int i = 0; i < mc->cores; i++) {
+    Core *core = &mc->core[i];
+    core->regfile = *boot;
+    core->regfile.R[2] = boot->R[2] - i * MC_STACK_BYTES;
+    core->regfile.R[4] = i;
+    memset(&core->pregs, 0, sizeof(core->pregs));
+    memset(&core->pwires, 0, sizeof(core->pwires));
+    bootstrap(&core->pwires, &core->pregs, &core->regfile);
+  }
+}
+
+/* Wait until every running core finished the quantum. A core that stops
+ * (leaving) no longer counts, and may be the last one the others waited for.
+ */
+static void quantum_barrier(MultiCore *mc, bool leaving) {
+  pthread_mutex_lock(&mc->sync);
+  if (leaving)
+    mc->running--;
+  else
+    mc->arrived++;
+  if (mc->arrived >= mc->running) {
+    mc->arrived = 0;
+    mc->epoch++;
+    pthread_cond_broadcast(&mc->cond);
+  } else if (!leaving) {
+    uint64_t epoch = mc->epoch;
+    while (epoch == mc->epoch)
+      pthread_cond_wait(&mc->cond, &mc->sync);
+  }
+  pthread_mutex_unlock(&mc->sync);
+}
+
+static void *core_main(void *arg) {
+  Core *core = (Core *)arg;
+  MultiCore *mc = core->mc;
+  bool ecall_exit = false;
+  uint64_t next_sync = mc->quantum;
+
+  // the pipeline counters are per thread and start from zero
+  while (!ecall_exit && (mc->untilEcall || total_cycle_counter < mc->maxCycles)) {
+    cycle_pipeline(&core->regfile, mc->memory, &core->hier, &core->pregs, &core->pwires, &ecall_exit);
+    // the skew is bounded on the clock memory sees, memory stalls included;
+    // a long stall may cross several quanta, each one waits for the others
+    while (total_cycle_counter + mem_stall_counter >= next_sync) {
+      quantum_barrier(mc, false);
+      next_sync += mc->quantum;
+    }
+  }
+
+  core->cycles = total_cycle_counter;
+  core->stalls = stall_counter;
+  core->mem_stalls = mem_stall_counter;
+  core->branches = branch_counter;
+  core->mem_accesses = mem_access_counter;
+  core->hits = hit_count;
+  core->misses = miss_count;
+  core->exited = ecall_exit;
+  quantum_barrier(mc, true);
+  return NULL;
+}
+
+// Run every core until its ecall (untilEcall) or for maxCycles cycles
+void multicoreRun(MultiCore *mc, Byte *memory, bool untilEcall, uint64_t maxCycles) {
+  mc->memory = memory;
+  mc->untilEcall = untilEcall;
+  mc->maxCycles = maxCycles;
+  mc->running = mc->cores;
+  mc->arrived = 0;
+
+  for (int i = 0; i < mc->cores; i++)
+    pthread_create(&mc->core[i].thread, NULL, core_main, &mc->core[i]);
+  for (int i = 0; i < mc->cores; i++)
+    pthread_join(mc->core[i].thread, NULL);
+}
+
+void printMulticoreSummary(const MultiCore *mc) {
+  uint64_t cycles = 0;
+
+  printf("%d cores, %d cycle quantum\n", mc->cores, mc->quantum);
+  for (int i = 0; i < mc->cores; i++) {
+    const Core *core = &mc->core[i];
+    if (core->cycles > cycles)
+      cycles = core->cycles;
+    printf("Core %d: %llu cycles%s, stalls: %llu, MEM stalls: %llu, branches taken: %llu, "
+           "memory accesses: %llu, L1D hits: %llu, misses: %llu\n",
+           i, (unsigned long long)core->cycles, core->exited ? "" : " (no ecall)",
+           (unsigned long long)core->stalls, (unsigned long long)core->mem_stalls,
+           (unsigned long long)core->branches, (unsigned long long)core->mem_accesses,
+           (unsigned long long)core->hits, (unsigned long long)core->misses);
+  }
+  printf("Slowest core: %llu cycles\n", (unsigned long long)cycles);
+  for (int i = 0; i < mc->cores; i++) {
+    printf("-- core %d\n", i);
+    printHierarchySummary(&mc->core[i].hier);
+  }
+  printf("--\n");
+  printHierarchySummary(&mc->shared);
+  printCoherenceSummary(&mc->coherence);
+}
+
+void multicoreDeallocate(MultiCore *mc) {
+  for (int i = 0; i < mc->cores; i++)
+    hierarchyDeallocate(&mc->core[i].hier);
+  hierarchyDeallocate(&mc->shared);
+  coherenceDeallocate(&mc->coherence);
+  pthread_mutex_destroy(&mc->lock);
+  pthread_mutex_destroy(&mc->sync);
+  pthread_cond_destroy(&mc->cond);
+}
@@ -0,0 +1,67 @@
+#ifndef MULTICORE_H
+#define MULTICORE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "coherence.h"
+#include "hierarchy.h"
+#include "riscv.h"
+#include "pipeline.h"
+#include "types.h"
+
+#define MC_QUANTUM 100         // cycles a core may run ahead of the slowest one
+#define MC_STACK_BYTES 0x10000 // stack of each core below the previous one's
+
+// One core: its own pipeline, register file and private L1s
+typedef struct {
+  int id;
+  regfile_t regfile;
+  pipeline_regs_t pregs;
+  pipeline_wires_t pwires;
+  CacheHierarchy hier;
+  pthread_t thread;
+  struct MultiCore *mc;
+  // pipeline counters of the core's thread, copied when it stops
+  uint64_t cycles;
+  uint64_t stalls;
+  uint64_t mem_stalls;
+  uint64_t branches;
+  uint64_t mem_accesses;
+  uint64_t hits;
+  uint64_t misses;
+  bool exited; // reached its ecall
+} Core;
+
+/* N cores running the same program on shared guest memory, one host thread
+ * each. A core tells itself apart by its hart id in tp (x4) and has its own
+ * stack. The cores run freely for a quantum of cycles and then wait for each
+ * other, which bounds how far their clocks (memory stalls included) drift
+ * apart. Their L1s stay coherent through a MESI directory; the levels below
+ * are shared.
+ */
+typedef struct MultiCore {
+  int cores;
+  int quantum;
+  Core core[MC_MAX_CORES];
+  CacheHierarchy shared;
+  Coherence coherence;
+  pthread_mutex_t lock; // serialises the hierarchy accesses of the cores
+  // quantum barrier
+  pthread_mutex_t sync;
+  pthread_cond_t cond;
+  int running;
+  int arrived;
+  uint64_t epoch;
+  Byte *memory;
+  bool untilEcall;
+  uint64_t maxCycles;
+} MultiCore;
+
+int multicoreSetUp(MultiCore *mc, int cores, int quantum, const HierarchyParams *params);
+void multicoreReset(MultiCore *mc, const regfile_t *boot);
+void multicoreRun(MultiCore *mc, Byte *memory, bool untilEcall, uint64_t maxCycles);
+void printMulticoreSummary(const MultiCore *mc);
+void multicoreDeallocate(MultiCore *mc);
+
+#endif // MULTICORE_H
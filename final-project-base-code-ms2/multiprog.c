@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "multiprog.h"
+
+void multiprogSetUp(MultiProg *mp, uint64_t slice, int switchCycles, bool flush) {
+  memset(mp, 0, sizeof(*mp));
+  mp->slice = slice;
+  mp->switchCycles = switchCycles;
+  mp->flush = flush;
+}
+
+// Add a loaded program, returns 0 on success, -1 when there are too many
+int multiprogAdd(MultiProg *mp, const char *path, Byte *memory, int numins) {
+  if (mp->count == MP_MAX_PROGRAMS) {
+    fprintf(stderr, "Error - at most %d programs\n", MP_MAX_PROGRAMS);
+    return -1;
+  }
+  Program *p = &mp->program[mp->count++];
+  memset(p, 0, sizeof(*p));
+  p->path = path;
+  p->memory = memory;
+  p->numins = numins;
+  p->share = 1;
+  return 0;
+}
+
+// Cache level i of the hierarchy (L1I, L1D, L2, L3), NULL if it has none
+static const Cache *level(const CacheHierarchy *h, int i) {
+  if (i == 0)
+    return h->hasL1I ? &h->l1i : NULL;
+  if (i == 1)
+    return &h->l1d;
+  return i - 2 < h->numLower ? &h->lower[i - 2] : NULL;
+}
+
+/* Split the ways of every level between the programs in proportion to the
+ * comma separated shares, one per program. Each program gets a contiguous
+ * range of ways. Returns 0 on success, -1 on bad shares or too few ways.
+ */
+int multiprogPartition(MultiProg *mp, const char *shares, const CacheHierarchy *h) {
+  const char *s = shares;
+  int total = 0;
+
+  for (int p = 0; p < mp->count; p++) {
+    char *end;
+    long v = strtol(s, &end, 10);
+    if (end == s || v < 1 || (*end != ',' && *end != '\0') || (*end == '\0') != (p == mp->count - 1)) {
+      fprintf(stderr, "Error - give one way share of at least 1 per program, e.g. 1,3 (got %s)\n", shares);
+      return -1;
+    }
+    mp->program[p].share = (int)v;
+    total += (int)v;
+    s = end + 1;
+  }
+
+  for (int i = 0; i < MP_LEVELS; i++) {
+    const Cache *c = level(h, i);
+    if (c == NULL)
+      continue;
+    int sum = 0;
+    for (int p = 0; p < mp->count; p++) {
+      int first = c->linesPerSet * sum / total;
+      sum += mp->program[p].share;
+      int last = c->linesPerSet * sum / total;
+      if (last <= first) {
+        fprintf(stderr, "Error - %s has too few ways (%d) for the shares %s\n", c->name,
+                c->linesPerSet, shares);
+        return -1;
+      }
+      mp->program[p].wayMask[i] = (last - first == 64 ? ~0ULL : (1ULL << (last - first)) - 1) << first;
+    }
+  }
+  mp->partitioned = true;
+  return 0;
+}
+
+// Start every program from the boot register state in its own region
+void multiprogReset(MultiProg *mp, const regfile_t *boot) {
+  for (int i = 0; i < mp->count; i++) {
+    Program *p = &mp->program[i];
+    p->regfile = *boot;
+    memset(&p->pregs, 0, sizeof(p->pregs));
+    memset(&p->pwires, 0, sizeof(p->pwires));
+    bootstrap(&p->pwires, &p->pregs, &p->regfile);
+    p->exited = false;
+    p->steps = 0;
+  }
+  mp->cycles = mp->switches = mp->switch_cycles = 0;
+}
+
+static bool program_done(const Program *p, bool untilEcall) {
+  return p->exited || (!untilEcall && p->steps >= (uint64_t)p->numins);
+}
+
+// Give the caches the region and the ways of program i
+static void switch_to(MultiProg *mp, CacheHierarchy *h, int i) {
+  h->regionBase = (unsigned long long)i * MEMORY_SPACE;
+  for (int l = 0; l < MP_LEVELS; l++) {
+    Cache *c = (Cache *)level(h, l);
+    if (c != NULL)
+      c->fillWays = mp->program[i].wayMask[l];
+  }
+}
+
+// One pipeline cycle of the program at the core's clock, which holds the memory stalls
+static void step_program(MultiProg *mp, Program *p, CacheHierarchy *h) {
+  uint64_t mem_stalls = mem_stall_counter;
+  Word wb = p->pregs.memwb_preg.out.instr.bits;
+
+  total_cycle_counter = mp->cycles;
+  h->stall_cycles = 0;
+  cycle_pipeline(&p->regfile, p->memory, h, &p->pregs, &p->pwires, &p->exited);
+
+  uint64_t cycles = 1 + (mem_stall_counter - mem_stalls);
+  p->steps++;
+  p->cycles += cycles;
+  p->mem_stalls += mem_stall_counter - mem_stalls;
+  if (wb != 0 && wb != 0x00000013)
+    p->retired++;
+  mp->cycles += cycles;
+}
+
+// Run a slice of program i and charge it the cache accesses it made
+static void run_slice(MultiProg *mp, CacheHierarchy *h, int i, bool untilEcall) {
+  Program *p = &mp->program[i];
+  uint64_t hits[MP_LEVELS] = {0}, misses[MP_LEVELS] = {0};
+  uint64_t start = mp->cycles;
+
+  for (int l = 0; l < MP_LEVELS; l++) {
+    const Cache *c = level(h, l);
+    if (c != NULL) {
+      hits[l] = c->hit_count;
+      misses[l] = c->miss_count;
+    }
+  }
+  p->slices++;
+  while (!program_done(p, untilEcall) && mp->cycles - start < mp->slice)
+    step_program(mp, p, h);
+  for (int l = 0; l < MP_LEVELS; l++) {
+    const Cache *c = level(h, l);
+    if (c != NULL) {
+      p->hits[l] += c->hit_count - hits[l];
+      p->misses[l] += c->miss_count - misses[l];
+    }
+  }
+}
+
+/* Time-slice the programs round robin until each reached its ecall
+ * (untilEcall) or ran its own number of instructions in cycles.
+ */
+void multiprogRun(MultiProg *mp, CacheHierarchy *h, bool untilEcall) {
+  int current = -1;
+
+  while (true) {
+    int next = -1;
+    for (int n = 1; n <= mp->count && next < 0; n++) {
+      int i = (current + n + mp->count) % mp->count;
+      if (!program_done(&mp->program[i], untilEcall))
+        next = i;
+    }
+    if (next < 0)
+      break;
+    if (current >= 0 && next != current) {
+      uint64_t cost = mp->switchCycles;
+      if (mp->flush) {
+        h->now = mp->cycles;
+        cost += hierarchyFlushL1(h);
+      }
+      mp->switches++;
+      mp->switch_cycles += cost;
+      mp->cycles += cost;
+    }
+    if (next != current)
+      switch_to(mp, h, next);
+    current = next;
+    run_slice(mp, h, current, untilEcall);
+  }
+
+  // the caches go back to the whole address space and all their ways
+  h->regionBase = 0;
+  for (int l = 0; l < MP_LEVELS; l++) {
+    Cache *c = (Cache *)level(h, l);
+    if (c != NULL)
+      c->fillWays = 0;
+  }
+  total_cycle_counter = mp->cycles;
+}
+
+void printMultiprogSummary(const MultiProg *mp, const CacheHierarchy *h) {
+  printf("%d programs, %llu cycle slices, %d cycles per switch%s%s\n", mp->count,
+         (unsigned long long)mp->slice, mp->switchCycles, mp->flush ? ", L1s flushed" : "",
+         mp->partitioned ? ", ways partitioned" : "");
+  for (int i = 0; i < mp->count; i++) {
+    const Program *p = &mp->program[i];
+    printf("Program %d (%s): %llu instructions in %llu cycles%s, %llu slices, IPC %.3f, MEM stalls: %llu\n",
+           i, p->path, (unsigned long long)p->retired, (unsigned long long)p->cycles,
+           p->exited ? "" : " (no ecall)", (unsigned long long)p->slices,
+           p->cycles ? (double)p->retired / p->cycles : 0.0, (unsigned long long)p->mem_stalls);
+    for (int l = 0; l < MP_LEVELS; l++) {
+      const Cache *c = level(h, l);
+      if (c == NULL)
+        continue;
+      uint64_t accesses = p->hits[l] + p->misses[l];
+      printf("  %-3s hits: %llu, misses: %llu, miss rate: %.2f%%", c->name,
+             (unsigned long long)p->hits[l], (unsigned long long)p->misses[l],
+             accesses ? 100.0 * p->misses[l] / accesses : 0.0);
+      if (p->wayMask[l])
+        printf(", ways %d-%d", __builtin_ctzll(p->wayMask[l]),
+               63 - __builtin_clzll(p->wayMask[l]));
+      printf("\n");
+    }
+  }
+  printf("Core cycles: %llu, switches: %llu, switch and flush cycles: %llu\n",
+         (unsigned long long)mp->cycles, (unsigned long long)mp->switches,
+         (unsigned long long)mp->switch_cycles);
+}
@@ -0,0 +1,64 @@
+#ifndef MULTIPROG_H
+#define MULTIPROG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "hierarchy.h"
+#include "riscv.h"
+#include "pipeline.h"
+#include "types.h"
+
+#define MP_MAX_PROGRAMS 8
+#define MP_SLICE 10000       // default cycles a program runs before the next one gets the core
+#define MP_LEVELS (2 + HIER_MAX_LOWER) // L1I, L1D, L2, L3
+
+// One program of a multiprogrammed run and what it saw of the shared caches
+typedef struct {
+  const char *path;
+  Byte *memory;        // its own guest region
+  int numins;
+  int share;           // ways of every level it may fill, relative to the other programs
+  uint64_t wayMask[MP_LEVELS]; // ways it fills at each level, 0 = all
+  regfile_t regfile;
+  pipeline_regs_t pregs;
+  pipeline_wires_t pwires;
+  bool exited;
+  uint64_t steps;      // pipeline cycles it ran
+  // per-program stats
+  uint64_t cycles;     // core cycles it had, memory stalls included
+  uint64_t slices;
+  uint64_t retired;    // instructions written back, not counting nops
+  uint64_t mem_stalls;
+  uint64_t hits[MP_LEVELS];
+  uint64_t misses[MP_LEVELS];
+} Program;
+
+/* Several programs time-sliced on one core. Each runs in its own guest
+ * region, which the caches see at region i * MEMORY_SPACE, and keeps its
+ * pipeline state while it is switched out. Every slice cycles the core
+ * switches to the next program that has not finished, paying switchCycles
+ * and, with flush, the write-backs of emptying the L1s. With way shares the
+ * ways of every cache level are split between the programs in proportion;
+ * a program still hits on any way but only fills its own.
+ */
+typedef struct {
+  int count;
+  Program program[MP_MAX_PROGRAMS];
+  uint64_t slice;
+  int switchCycles;
+  bool flush;
+  bool partitioned;
+  // totals
+  uint64_t cycles;
+  uint64_t switches;
+  uint64_t switch_cycles; // switch costs and flush write-backs
+} MultiProg;
+
+void multiprogSetUp(MultiProg *mp, uint64_t slice, int switchCycles, bool flush);
+int multiprogAdd(MultiProg *mp, const char *path, Byte *memory, int numins);
+int multiprogPartition(MultiProg *mp, const char *shares, const CacheHierarchy *h);
+void multiprogReset(MultiProg *mp, const regfile_t *boot);
+void multiprogRun(MultiProg *mp, CacheHierarchy *h, bool untilEcall);
+void printMultiprogSummary(const MultiProg *mp, const CacheHierarchy *h);
+
+#endif // MULTIPROG_H
@@ -8,21 +8,32 @@
 
 
 #include <stdbool.h>
+#include <string.h>
 #include "cache.h"
+#include "hierarchy.h"
 #include "riscv.h"
 #include "types.h"
 #include "utils.h"
 #include "pipeline.h"
 #include "stage_helpers.h"
 
-uint64_t total_cycle_counter = 0;
-uint64_t miss_count = 0;
-uint64_t hit_count = 0;
-uint64_t stall_counter = 0;
-uint64_t branch_counter = 0;
-uint64_t fwd_exex_counter = 0;
-uint64_t fwd_exmem_counter = 0;
-uint64_t mem_access_counter = 0;
+// Per thread, so every core of a multicore run counts its own pipeline
+_Thread_local uint64_t total_cycle_counter = 0;
+_Thread_local uint64_t miss_count = 0;
+_Thread_local uint64_t hit_count = 0;
+_Thread_local uint64_t stall_counter = 0;
+_Thread_local uint64_t branch_counter = 0;
+_Thread_local uint64_t fwd_exex_counter = 0;
+_Thread_local uint64_t fwd_exmem_counter = 0;
+_Thread_local uint64_t fwd_memmem_counter = 0;
+_Thread_local uint64_t mem_access_counter = 0;
+_Thread_local uint64_t mem_stall_counter = 0;
+_Thread_local uint64_t mul_counter = 0;
+_Thread_local uint64_t div_counter = 0;
+_Thread_local uint64_t div_busy_counter = 0;
+_Thread_local uint64_t mext_stall_counter = 0;
+_Thread_local uint64_t retired_counter = 0;
+_Thread_local uint64_t fused_counter = 0;
 
 simulator_config_t sim_config = {0};
 
@@ -34,85 +45,178 @@ void bootstrap(pipeline_wires_t* pwires_p, pipeline_regs_t* pregs_p, regfile_t*
   pwires_p->pc_src0 = regfile_p->PC;
 }
 
+/* Turn the instructions of thread context tid in IFID into bubbles, and with
+ * behind_mem the ones in IDEX and EXMEM too, everything younger than the
+ * instruction now in WB. barrel.c takes a context out this way while its
+ * fetch or memory access completes, and fetches the instructions again.
+ */
+void pipelineSquash(pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p, int tid, bool behind_mem)
+{
+  if (pregs_p->ifid_preg.out.tid == tid) {
+    pregs_p->ifid_preg.out = pregs_p->ifid_preg.inp = (ifid_reg_t){0};
+    pregs_p->ifid_preg.out.instr.bits = pregs_p->ifid_preg.inp.instr.bits = 0x00000013;
+  }
+  if (!behind_mem) {
+    return;
+  }
+  if (pregs_p->idex_preg.out.tid == tid) {
+    // a held instruction gives up the divider and EX
+    if (pwires_p->ex_held) {
+      pwires_p->div_busy = false;
+      pwires_p->ex_held = false;
+    }
+    pregs_p->idex_preg.out = pregs_p->idex_preg.inp = (idex_reg_t){0};
+    pregs_p->idex_preg.out.instr.bits = pregs_p->idex_preg.inp.instr.bits = 0x00000013;
+  }
+  if (pregs_p->exmem_preg.out.tid == tid) {
+    pregs_p->exmem_preg.out = pregs_p->exmem_preg.inp = (exmem_reg_t){0};
+    pregs_p->exmem_preg.out.instr.bits = pregs_p->exmem_preg.inp.instr.bits = 0x00000013;
+  }
+}
+
+// FUSE_* mask of a comma separated list of shadd, luiaddi, ldpair or all, -1 if unknown
+int fusionParse(const char *list)
+{
+  int mask = 0;
+  char name[16];
+  while (*list != '\0') {
+    size_t len = strcspn(list, ",");
+    if (len >= sizeof(name)) {
+      return -1;
+    }
+    memcpy(name, list, len);
+    name[len] = '\0';
+    if (strcmp(name, "shadd") == 0) mask |= FUSE_SHIFT_ADD;
+    else if (strcmp(name, "luiaddi") == 0) mask |= FUSE_LUI_ADDI;
+    else if (strcmp(name, "ldpair") == 0) mask |= FUSE_LOAD_PAIR;
+    else if (strcmp(name, "all") == 0) mask |= FUSE_ALL;
+    else return -1;
+    list += len;
+    if (*list == ',') list++;
+  }
+  return mask;
+}
+
 ///////////////////////////
 /// STAGE FUNCTIONALITY ///
 ///////////////////////////
 
 /**
  * STAGE  : stage_fetch
- * output : ifid_reg_t
+ * output : ifid_reg_t, written in place
  **/ 
-ifid_reg_t stage_fetch(pipeline_wires_t* pwires_p, regfile_t* regfile_p, Byte* memory_p)
+static inline __attribute__((always_inline))
+void stage_fetch(ifid_reg_t* ifid_reg, pipeline_wires_t* pwires_p, regfile_t* regfiles_p, Byte* memory_p, CacheHierarchy* hier_p, const int out)
 {
-  ifid_reg_t ifid_reg = {0};
+  *ifid_reg = (ifid_reg_t){0};
+
+  // No context to fetch for, a bubble enters the pipeline
+  if (pwires_p->fetch_tid < 0) {
+    ifid_reg->instr.bits = 0x00000013;
+    return;
+  }
+  regfile_t* regfile_p = &regfiles_p[pwires_p->fetch_tid];
+  ifid_reg->tid = pwires_p->fetch_tid;
   
   // Fetch instruction from memory at current PC
   uint32_t instruction_bits = *(uint32_t*)(memory_p + regfile_p->PC);
+
+  // Instruction fetches only go through the cache model when there is an L1I
+  if ((out & STEP_CACHE) && hier_p->hasL1I) {
+    pwires_p->fetch_stall = hierarchyAccess(hier_p, regfile_p->PC, regfile_p->PC, total_cycle_counter, ACCESS_FETCH, NULL) - 1;
+    mem_stall_counter += pwires_p->fetch_stall;
+  } else if (out & STEP_CACHE) {
+    if (hier_p->capture != NULL) {
+      // still record the fetch, a swept configuration may have an L1I
+      traceAppend(hier_p->capture, regfile_p->PC, regfile_p->PC, total_cycle_counter, ACCESS_FETCH);
+    }
+    if (hier_p->hasTlb) {
+      pwires_p->fetch_stall = hierarchyTranslateFetch(hier_p, regfile_p->PC, total_cycle_counter);
+      mem_stall_counter += pwires_p->fetch_stall;
+    }
+  }
   
-  ifid_reg.instr = parse_instruction(instruction_bits);
-  
-  ifid_reg.instr_addr = regfile_p->PC;
-  ifid_reg.next_pc = regfile_p->PC + 4;
+  ifid_reg->instr = parse_instruction(instruction_bits);
+  if (sim_config.fusion) {
+    // fetch groups are two instructions wide, the second one is fetched again on its own unless fused
+    ifid_reg->next_instr.bits = *(uint32_t*)(memory_p + regfile_p->PC + 4);
+  }
   
-  return ifid_reg;
+  ifid_reg->instr_addr = regfile_p->PC;
+  ifid_reg->next_pc = regfile_p->PC + 4;
 }
 
 /**
  * STAGE  : stage_decode
- * output : idex_reg_t
+ * output : idex_reg_t, written in place
  **/ 
-idex_reg_t stage_decode(ifid_reg_t ifid_reg, pipeline_wires_t* pwires_p, regfile_t* regfile_p)
+static inline __attribute__((always_inline))
+void stage_decode(const ifid_reg_t* ifid_reg, idex_reg_t* idex_reg, pipeline_wires_t* pwires_p, regfile_t* regfile_p, const int out)
 {
-  idex_reg_t idex_reg = {0};
+  *idex_reg = (idex_reg_t){0};
   
   // Copy instruction and address
-  idex_reg.instr = ifid_reg.instr;
-  idex_reg.instr_addr = ifid_reg.instr_addr;
+  idex_reg->instr = ifid_reg->instr;
+  idex_reg->instr_addr = ifid_reg->instr_addr;
+  idex_reg->tid = ifid_reg->tid;
   
-  // Generate control signals
-  idex_reg_t control = gen_control(ifid_reg.instr);
-  idex_reg.memRead = control.memRead;
-  idex_reg.memWrite = control.memWrite;
-  idex_reg.regWrite = control.regWrite;
-  idex_reg.branch = control.branch;
-  idex_reg.use_imm = control.use_imm;
-  
-  // Extract register numbers
-  idex_reg.rs1 = control.rs1;
-  idex_reg.rs2 = control.rs2;
-  idex_reg.rd = control.rd;
+  // Generate control signals and extract register numbers
+  gen_control(ifid_reg->instr, idex_reg);
   
   // Read register values
-  idex_reg.reg_val1 = regfile_p->R[idex_reg.rs1];
-  idex_reg.reg_val2 = regfile_p->R[idex_reg.rs2];
+  idex_reg->reg_val1 = regfile_p->R[idex_reg->rs1];
+  idex_reg->reg_val2 = regfile_p->R[idex_reg->rs2];
   
   // Generate immediate value
-  idex_reg.imm = gen_imm(ifid_reg.instr);
-  
-  return idex_reg;
+  idex_reg->imm = gen_imm(ifid_reg->instr);
+
+  // Fold the next instruction in when the pair fuses and fetch can skip it
+  if (sim_config.fusion && pwires_p->fuse_ok) {
+    Instruction second = ifid_reg->next_instr;
+    idex_reg->fused = gen_fusion(ifid_reg->instr, second, sim_config.fusion);
+    switch (idex_reg->fused) {
+      case FUSE_SHIFT_ADD: // rd = (rs1 << imm) + the other add operand
+        idex_reg->rs2 = second.rtype.rs1 == idex_reg->rd ? second.rtype.rs2 : second.rtype.rs1;
+        idex_reg->reg_val2 = regfile_p->R[idex_reg->rs2];
+        break;
+      case FUSE_LUI_ADDI: // one immediate load
+        idex_reg->imm += sign_extend_number(second.itype.imm, 12);
+        break;
+      case FUSE_LOAD_PAIR: // the second word goes to rd2
+        idex_reg->rd2 = second.itype.rd;
+        break;
+    }
+    if ((out & STEP_STATS) && idex_reg->fused) {
+      fused_counter++;
+    }
+  }
 }
 
 /**
  * STAGE  : stage_execute
- * output : exmem_reg_t
+ * output : exmem_reg_t, written in place
  **/ 
-exmem_reg_t stage_execute(idex_reg_t idex_reg, pipeline_wires_t* pwires_p)
+static inline __attribute__((always_inline))
+void stage_execute(const idex_reg_t* idex_reg, exmem_reg_t* exmem_reg, pipeline_wires_t* pwires_p, const int fwd)
 {
-  exmem_reg_t exmem_reg = {0};
+  *exmem_reg = (exmem_reg_t){0};
   
   // Copy instruction and address
-  exmem_reg.instr = idex_reg.instr;
-  exmem_reg.instr_addr = idex_reg.instr_addr;
+  exmem_reg->instr = idex_reg->instr;
+  exmem_reg->instr_addr = idex_reg->instr_addr;
   
   // Copy control signals
-  exmem_reg.memRead = idex_reg.memRead;
-  exmem_reg.memWrite = idex_reg.memWrite;
-  exmem_reg.regWrite = idex_reg.regWrite;
-  exmem_reg.rd = idex_reg.rd;
+  exmem_reg->memRead = idex_reg->memRead;
+  exmem_reg->memWrite = idex_reg->memWrite;
+  exmem_reg->regWrite = idex_reg->regWrite;
+  exmem_reg->rd = idex_reg->rd;
+  exmem_reg->fused = idex_reg->fused;
+  exmem_reg->rd2 = idex_reg->rd2;
+  exmem_reg->tid = idex_reg->tid;
   
   // Prepare ALU inputs with forwarding
-  uint32_t alu_inp1 = idex_reg.reg_val1;
-  uint32_t alu_inp2 = idex_reg.use_imm ? idex_reg.imm : idex_reg.reg_val2;
+  uint32_t alu_inp1 = idex_reg->reg_val1;
+  uint32_t alu_inp2 = idex_reg->use_imm ? idex_reg->imm : idex_reg->reg_val2;
   
   // Apply forwarding for rs1
   if (pwires_p->forward_rs1_ex) {
@@ -121,16 +225,18 @@ exmem_reg_t stage_execute(idex_reg_t idex_reg, pipeline_wires_t* pwires_p)
     alu_inp1 = pwires_p->forward_rs1_data;
   }
   
-  // Apply forwarding for rs2
-  if (pwires_p->forward_rs2_ex) {
-    alu_inp2 = pwires_p->forward_rs2_data;
-  } else if (pwires_p->forward_rs2_mem) {
-    alu_inp2 = pwires_p->forward_rs2_data;
+  // Apply forwarding for rs2; in the full network it replaces an immediate too, as the course traces expect
+  if (fwd == FWD_FULL || !idex_reg->use_imm) {
+    if (pwires_p->forward_rs2_ex) {
+      alu_inp2 = pwires_p->forward_rs2_data;
+    } else if (pwires_p->forward_rs2_mem) {
+      alu_inp2 = pwires_p->forward_rs2_data;
+    }
   }
   
   // For JAL and JALR, calculate return address (PC + 4)
-  if (idex_reg.instr.opcode == 0x6F || idex_reg.instr.opcode == 0x67) {
-    alu_inp1 = idex_reg.instr_addr;
+  if (idex_reg->instr.opcode == 0x6F || idex_reg->instr.opcode == 0x67) {
+    alu_inp1 = idex_reg->instr_addr;
     alu_inp2 = 4;
   }
   
@@ -138,281 +244,399 @@ exmem_reg_t stage_execute(idex_reg_t idex_reg, pipeline_wires_t* pwires_p)
   uint32_t alu_control = gen_alu_control(idex_reg);
   
   // Execute ALU operation
-  exmem_reg.alu_result = execute_alu(alu_inp1, alu_inp2, alu_control);
+  exmem_reg->alu_result = execute_alu(alu_inp1, alu_inp2, alu_control);
+  if (idex_reg->fused == FUSE_SHIFT_ADD) {
+    // the shifted rs1 feeds the adder, the add operand may be forwarded
+    uint32_t addend = pwires_p->forward_rs2_ex || pwires_p->forward_rs2_mem ? pwires_p->forward_rs2_data : (uint32_t)idex_reg->reg_val2;
+    exmem_reg->alu_result = execute_alu(alu_inp1 << (idex_reg->imm & 0x1F), addend, 0x0);
+  }
   
   // Store value for store instructions (use forwarded value if available)
   if (pwires_p->forward_rs2_ex) {
-    exmem_reg.store_val = pwires_p->forward_rs2_data;
+    exmem_reg->store_val = pwires_p->forward_rs2_data;
   } else if (pwires_p->forward_rs2_mem) {
-    exmem_reg.store_val = pwires_p->forward_rs2_data;
+    exmem_reg->store_val = pwires_p->forward_rs2_data;
   } else {
-    exmem_reg.store_val = idex_reg.reg_val2;
+    exmem_reg->store_val = idex_reg->reg_val2;
   }
+  exmem_reg->store_from_wb = pwires_p->forward_store_mem;
   
   // Handle branch logic - just evaluate the condition, don't take the branch yet
-  if (idex_reg.branch) {
-    exmem_reg.branch_taken = gen_branch(alu_inp1, alu_inp2, idex_reg.instr);
+  if (idex_reg->branch) {
+    exmem_reg->branch_taken = gen_branch(alu_inp1, alu_inp2, idex_reg->instr);
     
     // Calculate branch target based on instruction type
-    if (idex_reg.instr.opcode == 0x67) { // JALR
+    if (idex_reg->instr.opcode == 0x67) { // JALR
       // For JALR: target = rs1 + immediate (immediate is already sign-extended)
-      exmem_reg.branch_target = idex_reg.imm;
+      exmem_reg->branch_target = idex_reg->imm;
     } else { // JAL or conditional branches
       // For JAL and branches: target = PC + immediate
-      exmem_reg.branch_target = idex_reg.instr_addr + idex_reg.imm;
+      exmem_reg->branch_target = idex_reg->instr_addr + idex_reg->imm;
     }
     
-    exmem_reg.is_jalr = (idex_reg.instr.opcode == 0x67);
-    exmem_reg.jalr_base = alu_inp1; // Use forwarded value if available
+    exmem_reg->is_jalr = (idex_reg->instr.opcode == 0x67);
+    exmem_reg->jalr_base = alu_inp1; // Use forwarded value if available
   } else {
-    exmem_reg.branch_taken = false;
+    exmem_reg->branch_taken = false;
+  }
+}
+
+// One access of the data side, counted and traced
+static inline __attribute__((always_inline))
+void data_access(CacheHierarchy* hier_p, unsigned long long address, const exmem_reg_t* exmem_reg, const int out)
+{
+  mem_access_counter++;
+  if (out & STEP_CACHE) {
+    result r;
+    int type = exmem_reg->memWrite ? ACCESS_STORE : ACCESS_LOAD;
+    mem_stall_counter += hierarchyAccess(hier_p, address, exmem_reg->instr_addr,
+                                         total_cycle_counter, type, &r) - 1;
+    if (r.status == CACHE_HIT) {
+      hit_count++;
+    } else {
+      miss_count++;
+    }
+    if (TRACING(out, OUT_CACHE_TRACE)) {
+      if (r.status == CACHE_HIT) {
+        printf(CACHE_HIT_FORMAT, address);
+      } else if (r.status == CACHE_MISS) {
+        printf(CACHE_MISS_FORMAT, address);
+      } else {
+        printf(CACHE_EVICTION_FORMAT, address);
+      }
+    }
   }
-  
-  return exmem_reg;
 }
 
 /**
  * STAGE  : stage_mem
- * output : memwb_reg_t
+ * output : memwb_reg_t, written in place
  **/ 
-memwb_reg_t stage_mem(exmem_reg_t exmem_reg, pipeline_wires_t* pwires_p, Byte* memory_p, Cache* cache_p)
+static inline __attribute__((always_inline))
+void stage_mem(const exmem_reg_t* exmem_reg, memwb_reg_t* memwb_reg, pipeline_wires_t* pwires_p, Byte* memory_p, CacheHierarchy* hier_p, const int out)
 {
-  memwb_reg_t memwb_reg = {0};
+  *memwb_reg = (memwb_reg_t){0};
   
   // Copy instruction and address
-  memwb_reg.instr = exmem_reg.instr;
-  memwb_reg.instr_addr = exmem_reg.instr_addr;
+  memwb_reg->instr = exmem_reg->instr;
+  memwb_reg->instr_addr = exmem_reg->instr_addr;
   
   // Copy control signals and data
-  memwb_reg.regWrite = exmem_reg.regWrite;
-  memwb_reg.rd = exmem_reg.rd;
-  memwb_reg.alu_result = exmem_reg.alu_result;
-  
+  memwb_reg->regWrite = exmem_reg->regWrite;
+  memwb_reg->rd = exmem_reg->rd;
+  memwb_reg->alu_result = exmem_reg->alu_result;
+  memwb_reg->fused = exmem_reg->fused;
+  memwb_reg->rd2 = exmem_reg->rd2;
+  memwb_reg->tid = exmem_reg->tid;
+  
+  // Every load and store goes through the data side of the cache hierarchy
+  if (exmem_reg->memRead || exmem_reg->memWrite) {
+    unsigned long long address = (uint32_t)exmem_reg->alu_result;
+    data_access(hier_p, address, exmem_reg, out);
+    // a fused load pair is one access unless its second word is in the next block
+    if (exmem_reg->rd2 != 0 && (out & STEP_CACHE) &&
+        ((address + 4) >> hier_p->l1d.blockBits) != (address >> hier_p->l1d.blockBits)) {
+      data_access(hier_p, address + 4, exmem_reg, out);
+    }
+  }
+
   // Handle memory operations
-  if (exmem_reg.memRead) {
+  if (exmem_reg->memRead) {
     // Load instruction - read from memory
     // Check instruction type for proper loading
-    if (exmem_reg.instr.opcode == 0x03) { // Load instructions
-      switch (exmem_reg.instr.itype.funct3) {
+    if (exmem_reg->instr.opcode == 0x03) { // Load instructions
+      switch (exmem_reg->instr.itype.funct3) {
         case 0x0: // lb (load byte)
-          memwb_reg.mem_data = (int8_t)(*(uint8_t*)(memory_p + exmem_reg.alu_result));
+          memwb_reg->mem_data = (int8_t)(*(uint8_t*)(memory_p + exmem_reg->alu_result));
           break;
         case 0x1: // lh (load halfword)
-          memwb_reg.mem_data = (int16_t)(*(uint16_t*)(memory_p + exmem_reg.alu_result));
+          memwb_reg->mem_data = (int16_t)(*(uint16_t*)(memory_p + exmem_reg->alu_result));
           break;
         case 0x2: // lw (load word)
-          memwb_reg.mem_data = *(int32_t*)(memory_p + exmem_reg.alu_result);
+          memwb_reg->mem_data = *(int32_t*)(memory_p + exmem_reg->alu_result);
           break;
         case 0x4: // lbu (load byte unsigned)
-          memwb_reg.mem_data = (uint8_t)(*(uint8_t*)(memory_p + exmem_reg.alu_result));
+          memwb_reg->mem_data = (uint8_t)(*(uint8_t*)(memory_p + exmem_reg->alu_result));
           break;
         case 0x5: // lhu (load halfword unsigned)
-          memwb_reg.mem_data = (uint16_t)(*(uint16_t*)(memory_p + exmem_reg.alu_result));
+          memwb_reg->mem_data = (uint16_t)(*(uint16_t*)(memory_p + exmem_reg->alu_result));
           break;
         default:
-          memwb_reg.mem_data = *(int32_t*)(memory_p + exmem_reg.alu_result);
+          memwb_reg->mem_data = *(int32_t*)(memory_p + exmem_reg->alu_result);
           break;
       }
     } else {
       // Default to 32-bit load
-      memwb_reg.mem_data = *(int32_t*)(memory_p + exmem_reg.alu_result);
+      memwb_reg->mem_data = *(int32_t*)(memory_p + exmem_reg->alu_result);
+    }
+    if (exmem_reg->rd2 != 0) {
+      memwb_reg->mem_data2 = *(int32_t*)(memory_p + exmem_reg->alu_result + 4);
     }
-    memwb_reg.mem_to_reg = true;
-  } else if (exmem_reg.memWrite) {
+    memwb_reg->mem_to_reg = true;
+  } else if (exmem_reg->memWrite) {
     // Store instruction - write to memory
-    *(int32_t*)(memory_p + exmem_reg.alu_result) = exmem_reg.store_val;
-    memwb_reg.mem_to_reg = false;
+    *(int32_t*)(memory_p + exmem_reg->alu_result) = exmem_reg->store_val;
+    memwb_reg->mem_to_reg = false;
   } else {
     // Non-memory instruction
-    memwb_reg.mem_to_reg = false;
+    memwb_reg->mem_to_reg = false;
   }
   
   // Handle branch logic in MEM stage
-  if (exmem_reg.branch_taken && exmem_reg.instr.bits != 0x00000013) {
+  if (exmem_reg->branch_taken && exmem_reg->instr.bits != 0x00000013) {
     branch_counter++;
     // Set branch target address for PC update
     pwires_p->pcsrc = true;
+    pwires_p->pc_tid = exmem_reg->tid;
     
     // Calculate target address based on instruction type
-    if (exmem_reg.is_jalr) { // JALR
+    if (exmem_reg->is_jalr) { // JALR
       // For JALR: target = rs1 + immediate
-      pwires_p->pc_src1 = exmem_reg.jalr_base + exmem_reg.branch_target;
+      pwires_p->pc_src1 = exmem_reg->jalr_base + exmem_reg->branch_target;
     } else { // JAL or conditional branches
       // For JAL and branches: target is already calculated as PC + immediate
-      pwires_p->pc_src1 = exmem_reg.branch_target;
+      pwires_p->pc_src1 = exmem_reg->branch_target;
     }
   } else {
     pwires_p->pcsrc = false;
   }
-  
-  return memwb_reg;
 }
 
 /**
  * STAGE  : stage_writeback
  * output : nothing - The state of the register file may be changed
  **/ 
-void stage_writeback(memwb_reg_t memwb_reg, pipeline_wires_t* pwires_p, regfile_t* regfile_p)
+static inline __attribute__((always_inline))
+void stage_writeback(const memwb_reg_t* memwb_reg, pipeline_wires_t* pwires_p, regfile_t* regfile_p, const int out)
 {
   // Write back to register file if instruction writes to registers
-  if (memwb_reg.regWrite && memwb_reg.rd != 0) {
+  if (memwb_reg->regWrite && memwb_reg->rd != 0) {
     // Select between memory data and ALU result
-    int32_t write_data = memwb_reg.mem_to_reg ? memwb_reg.mem_data : memwb_reg.alu_result;
-    regfile_p->R[memwb_reg.rd] = write_data;
+    int32_t write_data = memwb_reg->mem_to_reg ? memwb_reg->mem_data : memwb_reg->alu_result;
+    regfile_p->R[memwb_reg->rd] = write_data;
+  }
+  if (memwb_reg->rd2 != 0) {
+    regfile_p->R[memwb_reg->rd2] = memwb_reg->mem_data2;
+  }
+  // bubbles carry no instruction address
+  if ((out & STEP_STATS) && memwb_reg->instr_addr != 0) {
+    retired_counter += memwb_reg->fused ? 2 : 1;
   }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
 /** 
- * excite the pipeline with one clock cycle
+ * excite the pipeline with one clock cycle, fwd is the FWD_* bypass network
+ * and out the STEP_* bits, both constants in every instance. regfile_p and
+ * ecall_exit are indexed by the thread context each pipeline register carries
  **/
-void cycle_pipeline(regfile_t* regfile_p, Byte* memory_p, Cache* cache_p, pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p, bool* ecall_exit)
+static inline __attribute__((always_inline))
+void step_pipeline(regfile_t* regfile_p, Byte* memory_p, CacheHierarchy* hier_p, pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p, bool* ecall_exit, const int fwd, const int out)
 {
   // Initialize hazard detection and forwarding signals
   pwires_p->stall = false;
   pwires_p->flush = false;
+  pwires_p->ex_hold = false;
   pwires_p->forward_rs1_ex = false;
   pwires_p->forward_rs2_ex = false;
   pwires_p->forward_rs1_mem = false;
   pwires_p->forward_rs2_mem = false;
+  pwires_p->fetch_stall = 0;
   
   // Detect hazards and generate forwarding signals BEFORE processing stages
-  detect_hazard(pregs_p, pwires_p, regfile_p);
-  gen_forward(pregs_p, pwires_p);
+  detect_hazard(pregs_p, pwires_p, regfile_p, fwd, out);
+  gen_forward(pregs_p, pwires_p, fwd, out);
+  detect_mext_hazard(pregs_p, pwires_p, out);
+  // A held EX stalls the front end like a load-use hazard
+  bool frozen = pwires_p->stall || pwires_p->ex_hold;
+  bool redirect = pwires_p->pcsrc;
+  uint32_t redirect_pc = pwires_p->pc_src1;
+  uint8_t redirect_tid = pwires_p->pc_tid;
+  const ifid_reg_t* fetched = &pregs_p->ifid_preg.out;
   
   // Update PC based on branch decisions from previous cycle
   if (pwires_p->pcsrc) {
-    regfile_p->PC = pwires_p->pc_src1;
-    // Clear pipeline registers for control hazard
-    pregs_p->ifid_preg.inp = (ifid_reg_t){0};
-    pregs_p->idex_preg.inp = (idex_reg_t){0};
-    pregs_p->exmem_preg.inp = (exmem_reg_t){0};
-    
-    // Set NOP instructions for cleared registers
-    pregs_p->ifid_preg.inp.instr.bits = 0x00000013;
-    pregs_p->idex_preg.inp.instr.bits = 0x00000013;
-    pregs_p->exmem_preg.inp.instr.bits = 0x00000013;
+    regfile_p[pwires_p->pc_tid].PC = pwires_p->pc_src1;
+    // The stages below overwrite every register they clock this cycle, and a
+    // frozen IFID has to keep its instruction, so there is nothing to clear
     
     // Only print flush message if this is an actual control hazard (branch/jump taken)
-    if (pregs_p->exmem_preg.out.branch_taken && pregs_p->exmem_preg.out.instr.bits != 0x00000013) {
+    if (TRACING(out, OUT_CYCLE) &&
+        pregs_p->exmem_preg.out.branch_taken && pregs_p->exmem_preg.out.instr.bits != 0x00000013) {
       printf("[CPL]: Pipeline Flushed\n");
     }
-  } else if (!pwires_p->stall) {
-    // Normal PC increment - use next_pc from previous fetch
-    if (pregs_p->ifid_preg.out.next_pc != 0) {
-      regfile_p->PC = pregs_p->ifid_preg.out.next_pc;
-    } else if (pregs_p->ifid_preg.out.instr_addr != 0) {
+  }
+  if (!frozen && !(redirect && redirect_tid == fetched->tid)) {
+    // Normal PC increment of the context fetched for - use next_pc from previous fetch
+    if (fetched->next_pc != 0) {
+      regfile_p[fetched->tid].PC = fetched->next_pc;
+    } else if (fetched->instr_addr != 0) {
       // If we have a valid instruction address but no next_pc, advance by 4
-      regfile_p->PC = pregs_p->ifid_preg.out.instr_addr + 4;
+      regfile_p[fetched->tid].PC = fetched->instr_addr + 4;
     }
   }
   // If stall is true, don't update PC - same instruction will be fetched again
 
   // process each stage
 
-  /* Output               |    Stage      |       Inputs  */
-  if (!pwires_p->stall) {
-    pregs_p->ifid_preg.inp  = stage_fetch     (pwires_p, regfile_p, memory_p);
-  } else {
-    // Keep the same instruction in IFID when stalling
-    pregs_p->ifid_preg.inp = pregs_p->ifid_preg.out;
+  // Decode may fuse the instruction fetch is about to take, so it goes first
+  pwires_p->fuse_ok = !frozen && pwires_p->fetch_tid == fetched->tid &&
+                      !(redirect && redirect_tid == fetched->tid) &&
+                      regfile_p[fetched->tid].PC == fetched->instr_addr + 4;
+
+  // A register file written in the first half of the cycle is read by decode in the second
+  if (fwd == FWD_HALFWRITE || fwd == FWD_MEMMEM) {
+    stage_writeback (&pregs_p->memwb_preg.out, pwires_p, &regfile_p[pregs_p->memwb_preg.out.tid], out);
   }
-  
-  if (!pwires_p->stall) {
-    pregs_p->idex_preg.inp  = stage_decode    (pregs_p->ifid_preg.out, pwires_p, regfile_p);
+
+  /* Output               |    Stage      |       Inputs  */
+  if (pwires_p->ex_hold) {
+    // Keep the instruction in EX (IDEX is not latched), its operands are read again after writeback
+  } else if (!pwires_p->stall) {
+    stage_decode    (&pregs_p->ifid_preg.out, &pregs_p->idex_preg.inp, pwires_p, &regfile_p[fetched->tid], out);
   } else {
     // Insert bubble in IDEX stage when stalling
     pregs_p->idex_preg.inp = (idex_reg_t){0};
     pregs_p->idex_preg.inp.instr.bits = 0x00000013; // NOP instruction
   }
 
-  pregs_p->exmem_preg.inp = stage_execute   (pregs_p->idex_preg.out, pwires_p);
+  if (!frozen) {
+    if (pregs_p->idex_preg.inp.fused) {
+      regfile_p[fetched->tid].PC += 4; // the second instruction of the pair is already in ID
+    }
+    stage_fetch     (&pregs_p->ifid_preg.inp, pwires_p, regfile_p, memory_p, hier_p, out);
+  }
+  // else keep the same instruction in IFID when stalling, it is not latched
+
+  if (!pwires_p->ex_hold) {
+    stage_execute   (&pregs_p->idex_preg.out, &pregs_p->exmem_preg.inp, pwires_p, fwd);
+    scoreboard_write(&pregs_p->exmem_preg.inp, pwires_p, out);
+  } else {
+    // Insert bubble in EXMEM while EX is held
+    pregs_p->exmem_preg.inp = (exmem_reg_t){0};
+    pregs_p->exmem_preg.inp.instr.bits = 0x00000013; // NOP instruction
+  }
 
-  pregs_p->memwb_preg.inp = stage_mem       (pregs_p->exmem_preg.out, pwires_p, memory_p, cache_p);
+  if (fwd == FWD_MEMMEM) {
+    forward_mem_to_mem(pregs_p, pwires_p, out);
+  }
+  stage_mem       (&pregs_p->exmem_preg.out, &pregs_p->memwb_preg.inp, pwires_p, memory_p, hier_p, out);
 
   // Writeback should use the old memwb register values (from previous cycle)
-  stage_writeback (pregs_p->memwb_preg.out, pwires_p, regfile_p);
+  if (fwd != FWD_HALFWRITE && fwd != FWD_MEMMEM) {
+    stage_writeback (&pregs_p->memwb_preg.out, pwires_p, &regfile_p[pregs_p->memwb_preg.out.tid], out);
+  }
+
+  if (pwires_p->ex_hold) {
+    // both halves of IDEX hold the instruction while it is not latched
+    const regfile_t* held = &regfile_p[pregs_p->idex_preg.inp.tid];
+    pregs_p->idex_preg.out.reg_val1 = pregs_p->idex_preg.inp.reg_val1 = held->R[pregs_p->idex_preg.inp.rs1];
+    pregs_p->idex_preg.out.reg_val2 = pregs_p->idex_preg.inp.reg_val2 = held->R[pregs_p->idex_preg.inp.rs2];
+    // the front end did not fetch the branch target yet, take it once EX moves again
+    if (redirect) {
+      pwires_p->pcsrc = true;
+      pwires_p->pc_src1 = redirect_pc;
+      pwires_p->pc_tid = redirect_tid;
+    }
+  } else if (pwires_p->ex_held && !pwires_p->stall) {
+    // Decoded as EX moves again, after a writer it depends on drained to WB
+    // during the hold; that writer is too old for the bypass, so read again
+    const regfile_t* decoded = &regfile_p[pregs_p->idex_preg.inp.tid];
+    pregs_p->idex_preg.inp.reg_val1 = decoded->R[pregs_p->idex_preg.inp.rs1];
+    pregs_p->idex_preg.inp.reg_val2 = decoded->R[pregs_p->idex_preg.inp.rs2];
+  }
+  pwires_p->ex_held = pwires_p->ex_hold;
   
   // Print debug information for current cycle after processing stages but before updating registers
-  #ifdef DEBUG_CYCLE
-  printf("v==============Cycle Counter = %5ld==============v\n\n", total_cycle_counter);
-  
-  // Print debug information for each pipeline stage with safe access
-  printf("[IF ]: Instruction [%08x]@[%08x]: ", 
-         pregs_p->ifid_preg.inp.instr.bits, 
-         pregs_p->ifid_preg.inp.instr_addr);
-  if (pregs_p->ifid_preg.inp.instr.bits != 0) {
-    decode_instruction(pregs_p->ifid_preg.inp.instr.bits);
-  } else {
-    printf("\n");
-  }
+  if (TRACING(out, OUT_CYCLE)) {
+    printf("v==============Cycle Counter = %5ld==============v\n\n", total_cycle_counter);
+  
+    // Print debug information for each pipeline stage with safe access
+    printf("[IF ]: Instruction [%08x]@[%08x]: ", 
+           pregs_p->ifid_preg.inp.instr.bits, 
+           pregs_p->ifid_preg.inp.instr_addr);
+    if (pregs_p->ifid_preg.inp.instr.bits != 0) {
+      decode_instruction(pregs_p->ifid_preg.inp.instr.bits);
+    } else {
+      printf("\n");
+    }
   
-  printf("[ID ]: Instruction [%08x]@[%08x]: ", 
-         pregs_p->idex_preg.inp.instr.bits, 
-         pregs_p->idex_preg.inp.instr_addr);
-  if (pregs_p->idex_preg.inp.instr.bits != 0) {
-    decode_instruction(pregs_p->idex_preg.inp.instr.bits);
-  } else {
-    printf("\n");
-  }
+    printf("[ID ]: Instruction [%08x]@[%08x]: ", 
+           pregs_p->idex_preg.inp.instr.bits, 
+           pregs_p->idex_preg.inp.instr_addr);
+    if (pregs_p->idex_preg.inp.instr.bits != 0) {
+      decode_instruction(pregs_p->idex_preg.inp.instr.bits);
+    } else {
+      printf("\n");
+    }
+    if (pregs_p->idex_preg.inp.fused && !pwires_p->ex_hold) {
+      printf("[FUS]: Fused with [%08x]: ", pregs_p->ifid_preg.out.next_instr.bits);
+      decode_instruction(pregs_p->ifid_preg.out.next_instr.bits);
+    }
   
-  // Print forwarding messages if any forwarding occurred (using signals set earlier)
-  if (pwires_p->forward_rs1_ex) {
-    printf("[FWD]: Resolving EX hazard on rs1: x%d\n", pregs_p->idex_preg.out.rs1);
-  }
-  if (pwires_p->forward_rs2_ex) {
-    printf("[FWD]: Resolving EX hazard on rs2: x%d\n", pregs_p->idex_preg.out.rs2);
-  }
-  if (pwires_p->forward_rs1_mem) {
-    printf("[FWD]: Resolving MEM hazard on rs1: x%d\n", pregs_p->idex_preg.out.rs1);
-  }
-  if (pwires_p->forward_rs2_mem) {
-    printf("[FWD]: Resolving MEM hazard on rs2: x%d\n", pregs_p->idex_preg.out.rs2);
-  }
+    // Print forwarding messages if any forwarding occurred (using signals set earlier)
+    if (pwires_p->forward_rs1_ex) {
+      printf("[FWD]: Resolving EX hazard on rs1: x%d\n", pregs_p->idex_preg.out.rs1);
+    }
+    if (pwires_p->forward_rs2_ex) {
+      printf("[FWD]: Resolving EX hazard on rs2: x%d\n", pregs_p->idex_preg.out.rs2);
+    }
+    if (pwires_p->forward_rs1_mem) {
+      printf("[FWD]: Resolving MEM hazard on rs1: x%d\n", pregs_p->idex_preg.out.rs1);
+    }
+    if (pwires_p->forward_rs2_mem) {
+      printf("[FWD]: Resolving MEM hazard on rs2: x%d\n", pregs_p->idex_preg.out.rs2);
+    }
   
-  printf("[EX ]: Instruction [%08x]@[%08x]: ", 
-         pregs_p->exmem_preg.inp.instr.bits, 
-         pregs_p->exmem_preg.inp.instr_addr);
-  if (pregs_p->exmem_preg.inp.instr.bits != 0) {
-    decode_instruction(pregs_p->exmem_preg.inp.instr.bits);
-  } else {
-    printf("\n");
-  }
+    printf("[EX ]: Instruction [%08x]@[%08x]: ", 
+           pregs_p->exmem_preg.inp.instr.bits, 
+           pregs_p->exmem_preg.inp.instr_addr);
+    if (pregs_p->exmem_preg.inp.instr.bits != 0) {
+      decode_instruction(pregs_p->exmem_preg.inp.instr.bits);
+    } else {
+      printf("\n");
+    }
   
-  printf("[MEM]: Instruction [%08x]@[%08x]: ", 
-         pregs_p->memwb_preg.inp.instr.bits, 
-         pregs_p->memwb_preg.inp.instr_addr);
-  if (pregs_p->memwb_preg.inp.instr.bits != 0) {
-    decode_instruction(pregs_p->memwb_preg.inp.instr.bits);
-  } else {
-    printf("\n");
-  }
+    printf("[MEM]: Instruction [%08x]@[%08x]: ", 
+           pregs_p->memwb_preg.inp.instr.bits, 
+           pregs_p->memwb_preg.inp.instr_addr);
+    if (pregs_p->memwb_preg.inp.instr.bits != 0) {
+      decode_instruction(pregs_p->memwb_preg.inp.instr.bits);
+    } else {
+      printf("\n");
+    }
   
-  printf("[WB ]: Instruction [%08x]@[%08x]: ", 
-         pregs_p->memwb_preg.out.instr.bits, 
-         pregs_p->memwb_preg.out.instr_addr);
-  if (pregs_p->memwb_preg.out.instr.bits != 0) {
-    decode_instruction(pregs_p->memwb_preg.out.instr.bits);
-  } else {
-    printf("\n");
+    printf("[WB ]: Instruction [%08x]@[%08x]: ", 
+           pregs_p->memwb_preg.out.instr.bits, 
+           pregs_p->memwb_preg.out.instr_addr);
+    if (pregs_p->memwb_preg.out.instr.bits != 0) {
+      decode_instruction(pregs_p->memwb_preg.out.instr.bits);
+    } else {
+      printf("\n");
+    }
   }
-  #endif
 
   // increment the cycle
   total_cycle_counter++;
+  pwires_p->step++;
 
-  // update all the output registers for the next cycle from the input registers in the current cycle
-  pregs_p->ifid_preg.out  = pregs_p->ifid_preg.inp;
-  pregs_p->idex_preg.out  = pregs_p->idex_preg.inp;
+  // update the output registers for the next cycle from the input registers in the current cycle;
+  // a register that held is not written, so its halves already agree
+  if (!frozen) {
+    pregs_p->ifid_preg.out  = pregs_p->ifid_preg.inp;
+  }
+  if (!pwires_p->ex_hold) {
+    pregs_p->idex_preg.out  = pregs_p->idex_preg.inp;
+  }
   pregs_p->exmem_preg.out = pregs_p->exmem_preg.inp;
   pregs_p->memwb_preg.out = pregs_p->memwb_preg.inp;
 
   /////////////////// NO CHANGES BELOW THIS ARE REQUIRED //////////////////////
 
-  #ifdef DEBUG_REG_TRACE
-  print_register_trace(regfile_p);
-  #endif
+  if (TRACING(out, OUT_REG_TRACE)) {
+    print_register_trace(regfile_p);
+  }
 
   /**
    * check ecall condition
@@ -431,11 +655,102 @@ void cycle_pipeline(regfile_t* regfile_p, Byte* memory_p, Cache* cache_p, pipeli
    * If more functionality on ecall needs to be added, it can be done
    * by adding more conditions on the value of R[10]
    */
-  // Check ecall condition
+  // Check ecall condition, in the context of the ecall
   if( (pregs_p->memwb_preg.out.instr.bits == 0x00000073) &&
-      (regfile_p->R[10] == 10) )
+      (regfile_p[pregs_p->memwb_preg.out.tid].R[10] == 10) )
   {
-    *(ecall_exit) = true;
+    ecall_exit[pregs_p->memwb_preg.out.tid] = true;
+  }
+}
+
+// One instance of the cycle per bypass network and STEP_* variant, so neither costs anything per cycle
+#define STEP_INSTANCE(name, fwd, out) \
+  static void cycle_##name##_##out(regfile_t* regfile_p, Byte* memory_p, CacheHierarchy* hier_p, pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p, bool* ecall_exit) \
+  { \
+    step_pipeline(regfile_p, memory_p, hier_p, pregs_p, pwires_p, ecall_exit, fwd, out); \
+  }
+#define STEP_INSTANCES(name, fwd) \
+  STEP_INSTANCE(name, fwd, 0) STEP_INSTANCE(name, fwd, 1) STEP_INSTANCE(name, fwd, 2) STEP_INSTANCE(name, fwd, 3) \
+  STEP_INSTANCE(name, fwd, 4) STEP_INSTANCE(name, fwd, 5) STEP_INSTANCE(name, fwd, 6) STEP_INSTANCE(name, fwd, 7)
+#define STEP_ROW(name, fwd) \
+  [fwd] = {cycle_##name##_0, cycle_##name##_1, cycle_##name##_2, cycle_##name##_3, \
+           cycle_##name##_4, cycle_##name##_5, cycle_##name##_6, cycle_##name##_7}
+
+STEP_INSTANCES(no_forwarding, FWD_NONE)
+STEP_INSTANCES(ex_ex,         FWD_EXEX)
+STEP_INSTANCES(full,          FWD_FULL)
+STEP_INSTANCES(mem_mem,       FWD_MEMMEM)
+STEP_INSTANCES(half_write,    FWD_HALFWRITE)
+
+static const cycle_pipeline_fn cycle_variants[][STEP_VARIANTS] = {
+  STEP_ROW(no_forwarding, FWD_NONE),
+  STEP_ROW(ex_ex,         FWD_EXEX),
+  STEP_ROW(full,          FWD_FULL),
+  STEP_ROW(mem_mem,       FWD_MEMMEM),
+  STEP_ROW(half_write,    FWD_HALFWRITE),
+};
+
+// full network with trace and stats, until pipelineSelect picks one
+cycle_pipeline_fn cycle_pipeline = cycle_full_5;
+
+static const char *const forwarding_names[] = {
+  [FWD_NONE]      = "none",
+  [FWD_EXEX]      = "exex",
+  [FWD_FULL]      = "full",
+  [FWD_MEMMEM]    = "memmem",
+  [FWD_HALFWRITE] = "halfwrite",
+};
+
+// Bypass network named none, exex, full, memmem or halfwrite, -1 for anything else
+int forwardingParse(const char *name)
+{
+  for (int mode = 0; mode < (int)(sizeof(forwarding_names) / sizeof(forwarding_names[0])); mode++) {
+    if (strcmp(name, forwarding_names[mode]) == 0) {
+      return mode;
+    }
+  }
+  return -1;
+}
+
+// OUT_* bits of a comma separated list of regs, cycle, stats, cachetrace, cachestats, all or none
+int outputParse(const char *list)
+{
+  int mask = 0;
+  char name[16];
+  while (*list != '\0') {
+    size_t len = strcspn(list, ",");
+    if (len >= sizeof(name)) {
+      return -1;
+    }
+    memcpy(name, list, len);
+    name[len] = '\0';
+    if (strcmp(name, "regs") == 0) mask |= OUT_REG_TRACE;
+    else if (strcmp(name, "cycle") == 0) mask |= OUT_CYCLE;
+    else if (strcmp(name, "stats") == 0) mask |= OUT_STATS;
+    else if (strcmp(name, "cachetrace") == 0) mask |= OUT_CACHE_TRACE;
+    else if (strcmp(name, "cachestats") == 0) mask |= OUT_CACHE_STATS;
+    else if (strcmp(name, "all") == 0) mask |= OUT_ALL;
+    else if (strcmp(name, "none") != 0) return -1;
+    list += len;
+    if (*list == ',') list++;
   }
+  return mask;
 }
 
+/* Pick the cycle function once, before the first cycle, from the bypass
+ * network, the output and whether the cache hierarchy is simulated
+ */
+void pipelineSelect(void)
+{
+  int out = 0;
+  if (sim_config.output & (OUT_REG_TRACE | OUT_CYCLE | OUT_CACHE_TRACE)) {
+    out |= STEP_TRACE;
+  }
+  if (sim_config.cache_en) {
+    out |= STEP_CACHE;
+  }
+  if (sim_config.output & OUT_STATS) {
+    out |= STEP_STATS;
+  }
+  cycle_pipeline = cycle_variants[sim_config.fwd_mode][out];
+}
@@ -13,6 +13,7 @@
 #include "config.h"
 #include "types.h"
 #include "cache.h"
+#include "hierarchy.h"
 #include <stdbool.h>
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -20,14 +21,64 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 extern simulator_config_t sim_config; // Simulation Configuration setting
-extern uint64_t miss_count; // Cache miss count
-extern uint64_t hit_count;  // Cache hit count
-extern uint64_t total_cycle_counter; // Total number of Cycles executed
-extern uint64_t stall_counter;  // Number of pipeline stalls
-extern uint64_t branch_counter; // Number of branch instructions executed
-extern uint64_t fwd_exex_counter; // Forwarding EX → EX counter
-extern uint64_t fwd_exmem_counter; // Forwarding EX → MEM counter
-extern uint64_t mem_access_counter; // Memory access counter
+extern _Thread_local uint64_t miss_count; // Cache miss count
+extern _Thread_local uint64_t hit_count;  // Cache hit count
+extern _Thread_local uint64_t total_cycle_counter; // Total number of Cycles executed
+extern _Thread_local uint64_t stall_counter;  // Number of pipeline stalls
+extern _Thread_local uint64_t branch_counter; // Number of branch instructions executed
+extern _Thread_local uint64_t fwd_exex_counter; // Forwarding EX → EX counter
+extern _Thread_local uint64_t fwd_exmem_counter; // Forwarding EX → MEM counter
+extern _Thread_local uint64_t fwd_memmem_counter; // Forwarding MEM → MEM counter (load data to a store)
+extern _Thread_local uint64_t mem_access_counter; // Memory access counter
+extern _Thread_local uint64_t mem_stall_counter; // Cycles spent in the cache hierarchy beyond one cycle
+extern _Thread_local uint64_t mul_counter; // Multiplies issued to the multiplier
+extern _Thread_local uint64_t div_counter; // Divides and remainders run on the divider
+extern _Thread_local uint64_t div_busy_counter; // Cycles the divider was busy
+extern _Thread_local uint64_t mext_stall_counter; // Cycles EX waited for a multiply or divide result
+extern _Thread_local uint64_t retired_counter; // Instructions written back, fused pairs count twice
+extern _Thread_local uint64_t fused_counter; // Instruction pairs decoded as one operation
+
+// RV32M functional units in EX, single cycle like the reference traces unless set with -U
+#ifndef MUL_LATENCY
+#define MUL_LATENCY 1 // pipelined multiplier: cycles until a product can be used
+#endif
+#ifndef DIV_LATENCY
+#define DIV_LATENCY 1 // iterative divider: cycles for a full 32 bit quotient, small ones finish early
+#endif
+
+// Bypass networks picked with -B, FWD_FULL by default and with -f
+#define FWD_NONE      0 // no bypass, an operand waits in EX until it is written back
+#define FWD_EXEX      1 // EX to EX only
+#define FWD_FULL      2 // EX to EX and MEM to EX, with the load-use stall the course traces expect
+#define FWD_MEMMEM    3 // halfwrite, and loaded data goes from WB straight to the store behind the load
+#define FWD_HALFWRITE 4 // full, and the register file writes in the first half of the cycle
+
+// Output of a run, picked with -D; the config.h macros give the default
+#define OUT_REG_TRACE   1  // register file after every cycle
+#define OUT_CYCLE       2  // stages, bypasses, hazards and flushes of every cycle
+#define OUT_STATS       4  // pipeline stats at the end
+#define OUT_CACHE_TRACE 8  // hit, miss or eviction of every data access
+#define OUT_CACHE_STATS 16 // cache stats at the end
+#define OUT_ALL         31
+
+// Variants of the cycle function, every instance has these as constants
+#define STEP_TRACE 1 // some per-cycle output is on
+#define STEP_CACHE 2 // accesses go through the cache hierarchy
+#define STEP_STATS 4 // the counters only the stats report reads are kept
+#define STEP_VARIANTS 8
+
+// per-cycle output `what` in an instance with the STEP_* bits `out`
+#define TRACING(out, what) (((out) & STEP_TRACE) && (sim_config.output & (what)))
+
+// Macro-op fusion of adjacent pairs in decode, selected with -J
+#define FUSE_SHIFT_ADD 0x1 // slli rd, rs1, k + add rd, rd, rs2
+#define FUSE_LUI_ADDI  0x2 // lui rd, hi + addi rd, rd, lo
+#define FUSE_LOAD_PAIR 0x4 // lw ra, off(rb) + lw rc, off+4(rb)
+#define FUSE_ALL       (FUSE_SHIFT_ADD | FUSE_LUI_ADDI | FUSE_LOAD_PAIR)
+
+// Hardware thread contexts sharing one pipeline (barrel.c); the pipeline
+// registers carry the context of their instruction, single threaded runs only use 0
+#define PIPE_MAX_THREADS 16
 
 ///////////////////////////////////////////////////////////////////////////////
 /// RISC-V Pipeline Register Types
@@ -38,6 +89,8 @@ typedef struct
   Instruction instr;
   uint32_t instr_addr; // Address of the fetched instruction
   uint32_t next_pc; // PC + 4 - Next instruction address
+  Instruction next_instr; // Instruction after it in the same fetch group, for fusion
+  uint8_t tid; // Hardware thread context it was fetched for
  
 }ifid_reg_t;
 
@@ -61,6 +114,9 @@ typedef struct
   bool branch; // True if it's a branch instruction
   bool use_imm; // True if ALU operand 2 is imm
 
+  uint8_t fused; // FUSE_* kind when the next instruction was folded into this one, 0 if none
+  uint8_t rd2; // Second destination of a fused load pair, 0 if none
+  uint8_t tid; // Hardware thread context, selects its register file and scoreboard
   
 }idex_reg_t;
 
@@ -81,8 +137,12 @@ typedef struct
   // Branch-related fields
   uint32_t branch_target; // Branch target address
   bool is_jalr; // True if this is a JALR instruction
+  bool store_from_wb; // The store data is the load now in WB (MEM to MEM bypass)
   uint32_t jalr_base; // Base register value for JALR
 
+  uint8_t fused; // FUSE_* kind, 0 if not fused
+  uint8_t rd2; // Second destination of a fused load pair, 0 if none
+  uint8_t tid; // Hardware thread context
 
 }exmem_reg_t;
 
@@ -97,6 +157,11 @@ typedef struct
 
   bool regWrite; // True if the instruction writes back into the register
   bool mem_to_reg; // Selects memory data or ALU result for WB
+
+  uint8_t fused; // FUSE_* kind, 0 if not fused
+  uint8_t rd2; // Second destination of a fused load pair, 0 if none
+  int32_t mem_data2; // The word it loaded
+  uint8_t tid; // Hardware thread context, selects the register file written back
   
 }memwb_reg_t;
 
@@ -141,9 +206,23 @@ typedef struct
   memwb_reg_pair_t memwb_preg;
 }pipeline_regs_t;
 
+/* Register scoreboard of the hazard and forwarding units. An entry follows
+ * the youngest instruction writing the register once it leaves EX. MEM and
+ * WB never stall, so the step it reached MEM tells where it is now, and with
+ * that where a bypass takes its value from.
+ */
+typedef struct
+{
+  uint64_t  mem_step[32]; // Pipeline step in which the writer was in MEM, 0 if none yet
+  uint64_t  ready[32]; // Cycle from which its result can be used in EX (multi-cycle units)
+  bool      load[32]; // The value comes from memory, there is no EX to EX bypass
+  bool      second[32]; // The value is the second word of a fused load pair
+} scoreboard_t;
+
 typedef struct
 {
   bool      pcsrc; // Select the next program counter source
+  uint8_t   pc_tid; // Thread context the branch target is for
   uint32_t  pc_src0; // PC + 4 (default)
   uint32_t  pc_src1; // Branch or jump target address
   
@@ -156,40 +235,41 @@ typedef struct
   bool      forward_rs2_mem; // Forward rs2 from MEMWB
   uint32_t  forward_rs1_data; // Data to forward for rs1
   uint32_t  forward_rs2_data; // Data to forward for rs2
-} pipeline_wires_t;
+  bool      forward_store_mem; // The store in EX takes its data from the load in MEM one cycle later
 
+  // RV32M functional units
+  bool      ex_hold; // EX keeps its instruction: the divider is busy or an operand is not ready
+  bool      ex_held; // EX kept its instruction in the previous cycle
+  bool      div_busy; // The divider works on the instruction in EX
+  uint64_t  div_done; // Cycle the divider finishes it
 
-///////////////////////////////////////////////////////////////////////////////
-/// Function definitions for different stages
-///////////////////////////////////////////////////////////////////////////////
+  bool      fuse_ok; // Fetch is about to take the instruction after the one in ID, decode may fold it in
+
+  int       fetch_tid; // Thread context fetch takes the next instruction from, -1 for a bubble
+  uint32_t  fetch_stall; // Cycles the fetch of this cycle took beyond one
 
-/**
- * output : ifid_reg_t
- **/ 
-ifid_reg_t stage_fetch(pipeline_wires_t* pwires_p, regfile_t* regfile_p, Byte* memory_p);
+  uint64_t  step; // Cycles this pipeline has been stepped, the clock may run ahead between steps
+  scoreboard_t scoreboard[PIPE_MAX_THREADS]; // One per thread context
+} pipeline_wires_t;
 
-/**
- * output : idex_reg_t
- **/ 
-idex_reg_t stage_decode(ifid_reg_t ifid_reg, pipeline_wires_t* pwires_p, regfile_t* regfile_p);
 
-/**
- * output : exmem_reg_t
- **/ 
-exmem_reg_t stage_execute(idex_reg_t idex_reg, pipeline_wires_t* pwires_p);
+///////////////////////////////////////////////////////////////////////////////
+/// The stages are inlined into every instance of the cycle (pipeline.c)
+///////////////////////////////////////////////////////////////////////////////
 
-/**
- * output : memwb_reg_t
- **/ 
-memwb_reg_t stage_mem(exmem_reg_t exmem_reg, pipeline_wires_t* pwires_p, Byte* memory, Cache* cache_p);
+// regfile_p and ecall_exit have an entry per thread context the fetch wire selects
+typedef void (*cycle_pipeline_fn)(regfile_t* regfile_p, Byte* memory_p, CacheHierarchy* hier_p, pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p, bool* ecall_exit);
 
-/**
- * output : write_data
- **/ 
-void stage_writeback(memwb_reg_t memwb_reg, pipeline_wires_t* pwires_p, regfile_t* regfile_p);
+// Steps the pipeline one cycle, the instance pipelineSelect picked
+extern cycle_pipeline_fn cycle_pipeline;
 
-void cycle_pipeline(regfile_t* regfile_p, Byte* memory_p, Cache* cache_p, pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p, bool* ecall_exit);
+int forwardingParse(const char *name);
+int outputParse(const char *list);
+void pipelineSelect(void);
 
 void bootstrap(pipeline_wires_t* pwires_p, pipeline_regs_t* pregs_p, regfile_t* regfile_p);
+void pipelineSquash(pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p, int tid, bool behind_mem);
+
+int fusionParse(const char *list);
 
 #endif  // __PIPELINE_H__
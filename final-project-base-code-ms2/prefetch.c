@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "prefetch.h"
+
+static const char *kind_names[] = {"none", "nextline", "stride", "stream"};
+
+void prefetchDefaultParams(PrefetchParams *params) {
+  params->kind = PREFETCH_NONE;
+  params->degree = PREFETCH_DEGREE;
+  params->rptEntries = PREFETCH_RPT_ENTRIES;
+  params->streams = PREFETCH_STREAMS;
+  params->streamDepth = PREFETCH_STREAM_DEPTH;
+}
+
+// Map a prefetcher name from the command line to its enum, -1 if unknown
+int prefetchParseKind(const char *name) {
+  for (int i = 0; i < (int)(sizeof(kind_names) / sizeof(kind_names[0])); i++) {
+    if (strcmp(name, kind_names[i]) == 0)
+      return i;
+  }
+  return -1;
+}
+
+const char *prefetchKindName(int kind) {
+  return kind_names[kind];
+}
+
+void prefetchSetUp(Prefetcher *pf, const PrefetchParams *params) {
+  memset(pf, 0, sizeof(*pf));
+  pf->params = *params;
+  if (pf->params.streamDepth > PREFETCH_MAX_DEPTH)
+    pf->params.streamDepth = PREFETCH_MAX_DEPTH;
+
+  if (params->kind == PREFETCH_STRIDE)
+    pf->rpt = calloc(params->rptEntries, sizeof(RptEntry));
+  if (params->kind == PREFETCH_STREAM)
+    pf->streams = calloc(params->streams, sizeof(StreamBuffer));
+}
+
+void prefetchDeallocate(Prefetcher *pf) {
+  free(pf->rpt);
+  free(pf->streams);
+  pf->rpt = NULL;
+  pf->streams = NULL;
+}
+
+/* Update the reference prediction table with a demand access and return the
+ * stride to prefetch with, or 0 when the entry is not in the steady state.
+ */
+static long long rpt_update(Prefetcher *pf, unsigned long long pc, unsigned long long address) {
+  RptEntry *e = &pf->rpt[(pc >> 2) % pf->params.rptEntries];
+
+  // New load/store, start tracking it
+  if (!e->valid || e->pc != pc) {
+    e->valid = true;
+    e->pc = pc;
+    e->prev_addr = address;
+    e->stride = 0;
+    e->state = RPT_INITIAL;
+    return 0;
+  }
+
+  long long stride = (long long)(address - e->prev_addr);
+  bool correct = (stride == e->stride);
+
+  switch (e->state) {
+  case RPT_INITIAL:
+    if (correct) {
+      e->state = RPT_STEADY;
+    } else {
+      e->state = RPT_TRANSIENT;
+      e->stride = stride;
+    }
+    break;
+  case RPT_TRANSIENT:
+    if (correct) {
+      e->state = RPT_STEADY;
+    } else {
+      e->state = RPT_NOPRED;
+      e->stride = stride;
+    }
+    break;
+  case RPT_STEADY:
+    // one wrong stride drops confidence, the old stride is kept
+    if (!correct)
+      e->state = RPT_INITIAL;
+    break;
+  case RPT_NOPRED:
+    if (correct) {
+      e->state = RPT_TRANSIENT;
+    } else {
+      e->stride = stride;
+    }
+    break;
+  }
+  e->prev_addr = address;
+
+  return e->state == RPT_STEADY ? e->stride : 0;
+}
+
+/* Called for every demand access to the data cache. Writes up to `max` block
+ * addresses to prefetch into `out` and returns how many there are.
+ * `trigger` is true on a miss or on the first hit to a prefetched line; the
+ * next-line prefetcher only runs then, the stride prefetcher learns from all accesses.
+ */
+int prefetchCandidates(Prefetcher *pf, unsigned long long pc, unsigned long long address, bool trigger,
+                       int blockBits, unsigned long long *out, int max) {
+  unsigned long long mask = ~((1ULL << blockBits) - 1);
+  unsigned long long block = address & mask;
+  int n = 0;
+
+  if (pf->params.kind == PREFETCH_NEXTLINE && trigger) {
+    for (int i = 1; i <= pf->params.degree && n < max; i++)
+      out[n++] = block + ((unsigned long long)i << blockBits);
+  } else if (pf->params.kind == PREFETCH_STRIDE) {
+    long long stride = rpt_update(pf, pc, address);
+    if (stride == 0)
+      return 0;
+    unsigned long long last = block;
+    for (int i = 1; i <= pf->params.degree && n < max; i++) {
+      unsigned long long target = (address + stride * i) & mask;
+      // small strides stay inside the current block for a few iterations
+      if (target == last)
+        continue;
+      out[n++] = target;
+      last = target;
+    }
+  }
+  return n;
+}
+
+/* Stream buffers, looked up on an L1 miss before going to the lower level.
+ * On a hit at the head of a buffer the block is handed to the cache, its
+ * arrival cycle is returned in `ready`, and the buffer fetches one more block.
+ * On a miss the least recently used buffer is flushed and restarted after the
+ * missing block. Returns true on a stream buffer hit.
+ */
+bool streamAccess(Prefetcher *pf, unsigned long long block_addr, int blockBits, uint64_t now,
+                  uint64_t *ready, prefetch_fetch_fn fetch, void *ctx) {
+  unsigned long long blockSize = 1ULL << blockBits;
+  StreamBuffer *lru = &pf->streams[0];
+
+  for (int i = 0; i < pf->params.streams; i++) {
+    StreamBuffer *sb = &pf->streams[i];
+    if (sb->valid && sb->count > 0 && sb->blocks[0] == block_addr) {
+      *ready = sb->ready[0];
+      pf->stats.useful++;
+      if (sb->ready[0] > now)
+        pf->stats.late++;
+
+      // pop the head and keep the stream running ahead
+      memmove(&sb->blocks[0], &sb->blocks[1], (sb->count - 1) * sizeof(sb->blocks[0]));
+      memmove(&sb->ready[0], &sb->ready[1], (sb->count - 1) * sizeof(sb->ready[0]));
+      sb->blocks[sb->count - 1] = sb->next_block;
+      sb->ready[sb->count - 1] = now + fetch(ctx, sb->next_block);
+      sb->next_block += blockSize;
+      pf->stats.issued++;
+      sb->lru_clock = ++pf->stream_clock;
+      return true;
+    }
+    if (!sb->valid || (lru->valid && sb->lru_clock < lru->lru_clock))
+      lru = sb;
+  }
+
+  // Reallocate: whatever the old stream still held was never used
+  if (lru->valid)
+    pf->stats.useless += lru->count;
+  lru->valid = true;
+  lru->count = 0;
+  lru->next_block = block_addr + blockSize;
+  for (int i = 0; i < pf->params.streamDepth; i++) {
+    lru->blocks[i] = lru->next_block;
+    lru->ready[i] = now + fetch(ctx, lru->next_block);
+    lru->next_block += blockSize;
+    lru->count++;
+    pf->stats.issued++;
+  }
+  lru->lru_clock = ++pf->stream_clock;
+  return false;
+}
+
+/* Accuracy is useful/issued, coverage is the fraction of would-be misses that the
+ * prefetcher removed, timeliness the fraction of useful prefetches that arrived in time.
+ * Stream buffer hits still count as cache misses, so they are not added twice.
+ */
+void prefetchRatios(const Prefetcher *pf, uint64_t demand_misses, double *accuracy, double *coverage, double *timely) {
+  const PrefetchStats *s = &pf->stats;
+  uint64_t baseline = demand_misses + (pf->params.kind == PREFETCH_STREAM ? 0 : s->useful);
+  *accuracy = s->issued ? (double)s->useful / s->issued : 0.0;
+  *coverage = baseline ? (double)s->useful / baseline : 0.0;
+  *timely = s->useful ? (double)(s->useful - s->late) / s->useful : 0.0;
+}
+
+void printPrefetchSummary(const Prefetcher *pf, uint64_t demand_misses) {
+  const PrefetchStats *s = &pf->stats;
+  double accuracy, coverage, timely;
+  prefetchRatios(pf, demand_misses, &accuracy, &coverage, &timely);
+
+  printf("Prefetcher (%s): issued: %llu, redundant: %llu, useful: %llu, late: %llu, useless: %llu, pollution evictions: %llu\n",
+         prefetchKindName(pf->params.kind), (unsigned long long)s->issued, (unsigned long long)s->redundant,
+         (unsigned long long)s->useful, (unsigned long long)s->late, (unsigned long long)s->useless,
+         (unsigned long long)s->pollution);
+  printf("Prefetch accuracy: %.4f, coverage: %.4f, timeliness: %.4f\n", accuracy, coverage, timely);
+}
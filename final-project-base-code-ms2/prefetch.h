@@ -0,0 +1,86 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Prefetcher variants for the data cache
+enum prefetch_enum {
+  PREFETCH_NONE = 0,
+  PREFETCH_NEXTLINE = 1, // next-N-line, triggered by misses and first hits on prefetched lines
+  PREFETCH_STRIDE = 2,   // PC-indexed reference prediction table
+  PREFETCH_STREAM = 3    // stream buffers in front of the lower level
+};
+
+#define PREFETCH_DEGREE 2        // blocks issued per trigger (next-line and stride)
+#define PREFETCH_RPT_ENTRIES 64  // reference prediction table size
+#define PREFETCH_STREAMS 4       // number of stream buffers
+#define PREFETCH_STREAM_DEPTH 4  // blocks held by each stream buffer
+#define PREFETCH_MAX_DEPTH 16
+
+// Reference prediction table states (Chen and Baer)
+enum rpt_state_enum {
+  RPT_INITIAL = 0,
+  RPT_TRANSIENT = 1,
+  RPT_STEADY = 2,
+  RPT_NOPRED = 3
+};
+
+typedef struct {
+  int kind;
+  int degree;
+  int rptEntries;
+  int streams;
+  int streamDepth;
+} PrefetchParams;
+
+typedef struct {
+  bool valid;
+  unsigned long long pc;
+  unsigned long long prev_addr;
+  long long stride;
+  int state;
+} RptEntry;
+
+typedef struct {
+  bool valid;
+  unsigned long long blocks[PREFETCH_MAX_DEPTH]; // FIFO, blocks[0] is the head
+  uint64_t ready[PREFETCH_MAX_DEPTH];            // cycle at which each block arrives
+  int count;
+  unsigned long long next_block;                 // next block the buffer will fetch
+  uint64_t lru_clock;
+} StreamBuffer;
+
+typedef struct {
+  uint64_t issued;     // prefetch requests sent to the lower level
+  uint64_t redundant;  // candidates dropped because the block was already cached
+  uint64_t useful;     // prefetched blocks later hit by a demand access
+  uint64_t late;       // useful prefetches whose data had not arrived yet
+  uint64_t useless;    // prefetched blocks evicted or flushed without any use
+  uint64_t pollution;  // demand lines evicted by a prefetch that turned out useless
+} PrefetchStats;
+
+typedef struct {
+  PrefetchParams params;
+  RptEntry *rpt;
+  StreamBuffer *streams;
+  uint64_t stream_clock;
+  PrefetchStats stats;
+} Prefetcher;
+
+// Fetches one block from the level below, returns its latency in cycles
+typedef int (*prefetch_fetch_fn)(void *ctx, unsigned long long block_addr);
+
+void prefetchDefaultParams(PrefetchParams *params);
+int prefetchParseKind(const char *name);
+const char *prefetchKindName(int kind);
+void prefetchSetUp(Prefetcher *pf, const PrefetchParams *params);
+void prefetchDeallocate(Prefetcher *pf);
+int prefetchCandidates(Prefetcher *pf, unsigned long long pc, unsigned long long address, bool trigger,
+                       int blockBits, unsigned long long *out, int max);
+bool streamAccess(Prefetcher *pf, unsigned long long block_addr, int blockBits, uint64_t now,
+                  uint64_t *ready, prefetch_fetch_fn fetch, void *ctx);
+void prefetchRatios(const Prefetcher *pf, uint64_t demand_misses, double *accuracy, double *coverage, double *timely);
+void printPrefetchSummary(const Prefetcher *pf, uint64_t demand_misses);
+
+#endif // PREFETCH_H
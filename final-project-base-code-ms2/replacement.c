@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "replacement.h"
+
+/* Replacement policy library.
+ * Every policy is a ReplacementOps entry: hit() and fill() keep its metadata up
+ * to date and victim() picks a way of a full set. The cache always maintains
+ * per-line LRU stamps and access counts, which LRU and LFU use directly and the
+ * other policies only use for the LRU agreement statistic.
+ */
+
+static uint64_t next_random(Replacement *repl) {
+  // xorshift64*, deterministic for a given seed
+  repl->rng ^= repl->rng >> 12;
+  repl->rng ^= repl->rng << 25;
+  repl->rng ^= repl->rng >> 27;
+  return repl->rng * 0x2545F4914F6CDD1DULL;
+}
+
+static int lru_victim(Replacement *repl, unsigned long long set, const uint64_t *ages, const uint32_t *counts) {
+  int victim = 0;
+  for (int i = 1; i < repl->ways; i++) {
+    if (ages[i] < ages[victim])
+      victim = i;
+  }
+  return victim;
+}
+
+// Smallest access count, oldest stamp among equal counts
+static int lfu_victim(Replacement *repl, unsigned long long set, const uint64_t *ages, const uint32_t *counts) {
+  int victim = 0;
+  for (int i = 1; i < repl->ways; i++) {
+    if (counts[i] < counts[victim] || (counts[i] == counts[victim] && ages[i] < ages[victim]))
+      victim = i;
+  }
+  return victim;
+}
+
+// FIFO: the pointer moves on when the way it points at is filled
+static void fifo_fill(Replacement *repl, unsigned long long set, int way) {
+  if ((int)repl->setMeta[set] == way)
+    repl->setMeta[set] = (way + 1) % repl->ways;
+}
+
+static int fifo_victim(Replacement *repl, unsigned long long set, const uint64_t *ages, const uint32_t *counts) {
+  return (int)repl->setMeta[set];
+}
+
+static int random_victim(Replacement *repl, unsigned long long set, const uint64_t *ages, const uint32_t *counts) {
+  return (int)(next_random(repl) % repl->ways);
+}
+
+/* Tree PLRU. Node n (1 = root, children 2n and 2n+1) is bit n-1 of the set's
+ * word; 0 sends the victim search left, 1 right. An access points every node on
+ * its path away from the accessed way.
+ */
+static void plru_touch(Replacement *repl, unsigned long long set, int way) {
+  uint64_t bits = repl->setMeta[set];
+  int lo = 0, size = repl->treeWays, node = 1;
+
+  while (size > 1) {
+    size /= 2;
+    if (way >= lo + size) {
+      bits &= ~(1ULL << (node - 1));
+      lo += size;
+      node = 2 * node + 1;
+    } else {
+      bits |= 1ULL << (node - 1);
+      node = 2 * node;
+    }
+  }
+  repl->setMeta[set] = bits;
+}
+
+static int plru_victim(Replacement *repl, unsigned long long set, const uint64_t *ages, const uint32_t *counts) {
+  uint64_t bits = repl->setMeta[set];
+  int lo = 0, size = repl->treeWays, node = 1;
+
+  while (size > 1) {
+    size /= 2;
+    // With a non power of two associativity the right subtree may hold no ways
+    bool right = ((bits >> (node - 1)) & 1) && lo + size < repl->ways;
+    if (right) {
+      lo += size;
+      node = 2 * node + 1;
+    } else {
+      node = 2 * node;
+    }
+  }
+  return lo;
+}
+
+// RRIP: a hit predicts a near-immediate re-reference
+static void rrip_hit(Replacement *repl, unsigned long long set, int way) {
+  repl->rrpv[set * repl->ways + way] = 0;
+}
+
+// Insert with a long re-reference interval
+static void srrip_fill(Replacement *repl, unsigned long long set, int way) {
+  repl->rrpv[set * repl->ways + way] = RRIP_MAX - 1;
+}
+
+// Insert mostly with a distant re-reference interval, so scans do not flush the set
+static void brrip_fill(Replacement *repl, unsigned long long set, int way) {
+  bool distant = next_random(repl) % BRRIP_LONG_ODDS != 0;
+  repl->rrpv[set * repl->ways + way] = distant ? RRIP_MAX : RRIP_MAX - 1;
+  if (distant)
+    repl->stats.distant_fills++;
+}
+
+// Leader set kind for DRRIP: 0 = SRRIP leader, 1 = BRRIP leader, -1 = follower
+static int duel_leader(const Replacement *repl, unsigned long long set) {
+  if (repl->leaderStride == 0)
+    return -1;
+  unsigned long long offset = set % repl->leaderStride;
+  if (offset == 0)
+    return 0;
+  if (offset == (unsigned long long)repl->leaderStride / 2)
+    return 1;
+  return -1;
+}
+
+/* DRRIP: fills in leader sets are their policy's misses and move PSEL towards
+ * the other policy; followers insert like the policy that is missing less.
+ */
+static void drrip_fill(Replacement *repl, unsigned long long set, int way) {
+  int pselMax = (1 << PSEL_BITS) - 1;
+  int leader = duel_leader(repl, set);
+  bool brrip;
+
+  if (leader == 0) {
+    brrip = false;
+    if (repl->psel < pselMax)
+      repl->psel++;
+    repl->stats.leader_fills[0]++;
+  } else if (leader == 1) {
+    brrip = true;
+    if (repl->psel > 0)
+      repl->psel--;
+    repl->stats.leader_fills[1]++;
+  } else {
+    brrip = repl->psel > (1 << (PSEL_BITS - 1));
+    repl->stats.follower_fills++;
+    if (brrip)
+      repl->stats.follower_brrip++;
+  }
+
+  if (brrip)
+    brrip_fill(repl, set, way);
+  else
+    srrip_fill(repl, set, way);
+}
+
+// Evict the first line predicted distant, ageing the whole set until there is one
+static int rrip_victim(Replacement *repl, unsigned long long set, const uint64_t *ages, const uint32_t *counts) {
+  uint8_t *rrpv = &repl->rrpv[set * repl->ways];
+  int victim = 0;
+
+  for (int i = 1; i < repl->ways; i++) {
+    if (rrpv[i] > rrpv[victim])
+      victim = i;
+  }
+  // Ageing until some line reaches RRIP_MAX is the same as adding the gap to every line
+  int gap = RRIP_MAX - rrpv[victim];
+  if (gap > 0) {
+    for (int i = 0; i < repl->ways; i++)
+      rrpv[i] += gap;
+    repl->stats.rrip_aging += gap;
+  }
+  return victim;
+}
+
+static const ReplacementOps policies[REPL_NUM_POLICIES] = {
+  [REPL_LRU] = {"LRU", NULL, NULL, lru_victim},
+  [REPL_LFU] = {"LFU", NULL, NULL, lfu_victim},
+  [REPL_FIFO] = {"FIFO", NULL, fifo_fill, fifo_victim},
+  [REPL_RANDOM] = {"RANDOM", NULL, NULL, random_victim},
+  [REPL_PLRU] = {"PLRU", plru_touch, plru_touch, plru_victim},
+  [REPL_SRRIP] = {"SRRIP", rrip_hit, srrip_fill, rrip_victim},
+  [REPL_BRRIP] = {"BRRIP", rrip_hit, brrip_fill, rrip_victim},
+  [REPL_DRRIP] = {"DRRIP", rrip_hit, drrip_fill, rrip_victim},
+};
+
+// Map a policy name (any case) to its enum, -1 if unknown
+int replacementParse(const char *name) {
+  for (int i = 0; i < REPL_NUM_POLICIES; i++) {
+    if (strcasecmp(name, policies[i].name) == 0)
+      return i;
+  }
+  return -1;
+}
+
+const char *replacementName(int kind) {
+  return policies[kind].name;
+}
+
+void replacementSetUp(Replacement *repl, int kind, int setBits, int ways, uint64_t seed) {
+  memset(repl, 0, sizeof(*repl));
+  repl->ops = &policies[kind];
+  repl->kind = kind;
+  repl->ways = ways;
+  repl->numSets = 1ULL << setBits;
+  repl->rng = seed != 0 ? seed : REPL_SEED; // xorshift must not start at 0
+
+  repl->treeWays = 1;
+  while (repl->treeWays < ways)
+    repl->treeWays *= 2;
+
+  if (kind == REPL_FIFO || kind == REPL_PLRU)
+    repl->setMeta = calloc(repl->numSets, sizeof(uint64_t));
+  if (kind == REPL_SRRIP || kind == REPL_BRRIP || kind == REPL_DRRIP)
+    repl->rrpv = calloc(repl->numSets * ways, sizeof(uint8_t));
+
+  if (kind == REPL_DRRIP) {
+    unsigned long long leaders = repl->numSets / 4 < DUEL_LEADERS ? repl->numSets / 4 : DUEL_LEADERS;
+    repl->leaderStride = leaders ? repl->numSets / leaders : 0;
+    repl->psel = 1 << (PSEL_BITS - 1);
+  }
+}
+
+void replacementDeallocate(Replacement *repl) {
+  free(repl->setMeta);
+  free(repl->rrpv);
+  repl->setMeta = NULL;
+  repl->rrpv = NULL;
+}
+
+// Pick the way to evict from a full set, `ages` and `counts` point at the set's first line
+int replacementVictim(Replacement *repl, unsigned long long set, const uint64_t *ages, const uint32_t *counts) {
+  int victim = repl->ops->victim(repl, set, ages, counts);
+
+  repl->stats.victims++;
+  if (repl->kind == REPL_LRU || ages[victim] == ages[lru_victim(repl, set, ages, counts)])
+    repl->stats.lru_agree++;
+  return victim;
+}
+
+// Policy specific counters, LRU and LFU have none worth printing
+void printReplacementSummary(const Replacement *repl, const char *name) {
+  const ReplacementStats *s = &repl->stats;
+  double agree = s->victims ? (double)s->lru_agree / s->victims : 0.0;
+
+  if (repl->kind == REPL_LRU || repl->kind == REPL_LFU)
+    return;
+  printf("%-3s %s replacement: victims: %llu, LRU agreement: %.4f", name, repl->ops->name,
+         (unsigned long long)s->victims, agree);
+  if (repl->rrpv != NULL)
+    printf(", ageing steps: %llu, distant fills: %llu", (unsigned long long)s->rrip_aging,
+           (unsigned long long)s->distant_fills);
+  if (repl->kind == REPL_DRRIP)
+    printf(", leader fills SRRIP/BRRIP: %llu/%llu, follower BRRIP fills: %llu/%llu, PSEL: %d",
+           (unsigned long long)s->leader_fills[0], (unsigned long long)s->leader_fills[1],
+           (unsigned long long)s->follower_brrip, (unsigned long long)s->follower_fills, repl->psel);
+  printf("\n");
+}
@@ -0,0 +1,84 @@
+#ifndef REPLACEMENT_H
+#define REPLACEMENT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Replacement policies a cache level can use
+enum replacement_enum {
+  REPL_LRU = 0,    // least recently used, exact timestamps
+  REPL_LFU = 1,    // least frequently used, LRU among equal counts
+  REPL_FIFO = 2,   // round-robin pointer per set
+  REPL_RANDOM = 3, // seeded xorshift, reproducible between runs
+  REPL_PLRU = 4,   // tree pseudo-LRU, ways-1 bits per set
+  REPL_SRRIP = 5,  // static re-reference interval prediction
+  REPL_BRRIP = 6,  // bimodal RRIP, mostly distant insertions
+  REPL_DRRIP = 7   // SRRIP/BRRIP chosen by set dueling
+};
+#define REPL_NUM_POLICIES 8
+
+#define REPL_SEED 1          // default seed of the random policy
+#define RRIP_BITS 2          // width of a re-reference prediction value
+#define RRIP_MAX ((1 << RRIP_BITS) - 1) // distant re-reference
+#define BRRIP_LONG_ODDS 32   // BRRIP inserts 1 in BRRIP_LONG_ODDS lines as long instead of distant
+#define DUEL_LEADERS 32      // leader sets per policy for DRRIP
+#define PSEL_BITS 10         // DRRIP policy selection counter
+
+typedef struct {
+  uint64_t victims;          // replacement decisions
+  uint64_t lru_agree;        // victims that were also the least recently used line
+  uint64_t rrip_aging;       // RRIP: passes that aged every line of a full set
+  uint64_t distant_fills;    // RRIP: lines inserted with the distant prediction
+  uint64_t leader_fills[2];  // DRRIP: fills in SRRIP / BRRIP leader sets
+  uint64_t follower_brrip;   // DRRIP: follower fills made with BRRIP
+  uint64_t follower_fills;   // DRRIP: all follower fills
+} ReplacementStats;
+
+/* Replacement state of one cache. LRU and LFU rank lines with the per-line
+ * stamps and counters the cache keeps anyway; the other policies keep their
+ * own compact metadata here: one word per set (PLRU tree bits or FIFO pointer)
+ * or one byte per line (RRIP prediction values).
+ */
+typedef struct Replacement Replacement;
+
+// One policy: how hits and fills update the metadata and how a victim is picked
+typedef struct {
+  const char *name;
+  void (*hit)(Replacement *repl, unsigned long long set, int way);
+  void (*fill)(Replacement *repl, unsigned long long set, int way);
+  int (*victim)(Replacement *repl, unsigned long long set, const uint64_t *ages, const uint32_t *counts);
+} ReplacementOps;
+
+struct Replacement {
+  const ReplacementOps *ops;
+  int kind;
+  int ways;
+  int treeWays;       // PLRU: ways rounded up to a power of two
+  unsigned long long numSets;
+  uint64_t *setMeta;  // PLRU tree bits or FIFO next way, per set
+  uint8_t *rrpv;      // RRIP prediction value, per line
+  uint64_t rng;       // random and BRRIP state
+  int psel;           // DRRIP: high half means SRRIP leaders miss more, use BRRIP
+  int leaderStride;   // DRRIP: one SRRIP and one BRRIP leader every leaderStride sets, 0 = no dueling
+  ReplacementStats stats;
+};
+
+int replacementParse(const char *name);
+const char *replacementName(int kind);
+void replacementSetUp(Replacement *repl, int kind, int setBits, int ways, uint64_t seed);
+void replacementDeallocate(Replacement *repl);
+int replacementVictim(Replacement *repl, unsigned long long set, const uint64_t *ages, const uint32_t *counts);
+void printReplacementSummary(const Replacement *repl, const char *name);
+
+// Called on every hit and every fill, kept inline since they run on every access
+static inline void replacementHit(Replacement *repl, unsigned long long set, int way) {
+  if (repl->ops->hit != NULL)
+    repl->ops->hit(repl, set, way);
+}
+
+static inline void replacementFill(Replacement *repl, unsigned long long set, int way) {
+  if (repl->ops->fill != NULL)
+    repl->ops->fill(repl, set, way);
+}
+
+#endif // REPLACEMENT_H
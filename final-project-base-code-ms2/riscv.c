@@ -10,7 +10,14 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include "cache.h"
+#include "hierarchy.h"
+#include "cache_config.h"
+#include "sweep.h"
 #include "pipeline.h"
+#include "multicore.h"
+#include "harts.h"
+#include "barrel.h"
+#include "multiprog.h"
 
 /* WARNING: DO NOT CHANGE THIS FILE.
  YOU PROBABLY DON'T EVEN NEED TO LOOK AT IT... */
@@ -19,6 +26,11 @@
 Byte *memory;
 #define MAX_SIZE 50
 
+// Disassembly of an instruction of the loaded program, for the miss attribution report
+static void disasm_at(unsigned long long pc) {
+  decode_instruction(load(memory, pc, LENGTH_WORD));
+}
+
 void execute_emu(regfile_t *regfile, int prompt, int print) {
   /* fetch an instruction */
   uint32_t instruction_bits = load(memory, regfile->PC, LENGTH_WORD);
@@ -92,18 +104,68 @@ int main(int argc, char **argv) {
       opt_sim = 0,
       opt_init_reg = 0,
       opt_cache = 0,
-      opt_forwarding = 0,
-      opt_printmem = 0;
+      opt_printmem = 0,
+      opt_stackdist = 0,
+      opt_attrib = 0;
 
   uint32_t print_mem_startaddr = 0, print_mem_stopaddr = 0;
 
+  /* design space sweep: configurations to replay the captured accesses through */
+  const char *sweep_path = NULL, *sweep_output = NULL;
+  int sweep_threads = 0;
+
+  /* multicore run: cores of the cycle accurate simulator or harts of the
+   * emulator, and their quantum (0 leaves the default) */
+  int opt_cores = 1, opt_quantum = 0;
+  static MultiCore multicore;
+  static Harts harts;
+
+  /* fine-grained multithreading: hardware threads of the single core and their policy */
+  int opt_hwthreads = 1, opt_policy = BARREL_ROUND_ROBIN;
+  static Barrel barrel;
+
+  /* multiprogrammed run: every program after the first gets its own region and time slices */
+  long opt_slice = MP_SLICE;
+  int opt_switch = 0, opt_flush = 0;
+  const char *way_shares = NULL;
+  static MultiProg multiprog;
+
+  /* bypass network, -B by name; -f and the default are the full network the course traces expect */
+  int opt_bypass = FWD_FULL;
+
+  /* what the run prints, -D list; the config.h macros give the default */
+  sim_config.output = 0;
+#ifdef DEBUG_REG_TRACE
+  sim_config.output |= OUT_REG_TRACE;
+#endif
+#ifdef DEBUG_CYCLE
+  sim_config.output |= OUT_CYCLE;
+#endif
+#ifdef PRINT_STATS
+  sim_config.output |= OUT_STATS;
+#endif
+#ifdef PRINT_CACHE_TRACES
+  sim_config.output |= OUT_CACHE_TRACE;
+#endif
+#ifdef PRINT_CACHE_STATS
+  sim_config.output |= OUT_CACHE_STATS;
+#endif
+
+  /* latencies of the multiplier and the divider, -U mul,div */
+  sim_config.mul_latency = MUL_LATENCY;
+  sim_config.div_latency = DIV_LATENCY;
+
+  /* cache hierarchy configuration, compile time defaults unless overridden */
+  HierarchyParams hierarchy_params;
+  hierarchyDefaultParams(&hierarchy_params);
+
 
   /* the architectural state of the CPU */
   regfile_t regfile;
 
   /* parse the command-line args */
   int c;
-  while ((c = getopt(argc, argv, "dvritesmpcf")) != -1) {
+  while ((c = getopt(argc, argv, "dvritesmpcfAaLP:W:R:C:F:X:O:T:N:Q:H:M:S:Z:G:U:J:B:D:")) != -1) {
     switch (c) {
     case 'd':
       opt_disasm = 1; break;
@@ -124,7 +186,74 @@ int main(int argc, char **argv) {
     case 'c':
       opt_cache = 1; break;
     case 'f':
-      opt_forwarding = 1; break;
+      /* no-op, kept for the milestone scripts: the full network is the default, -B picks another */
+      break;
+    case 'A':
+      opt_stackdist = 1; break;
+    case 'a':
+      opt_attrib = 1; break;
+    case 'X':
+      sweep_path = optarg; break;
+    case 'O':
+      sweep_output = optarg; break;
+    case 'T':
+      sweep_threads = atoi(optarg); break;
+    case 'N':
+      opt_cores = atoi(optarg); break;
+    case 'Q':
+      opt_quantum = atoi(optarg); break;
+    case 'H':
+      opt_hwthreads = atoi(optarg); break;
+    case 'S':
+      opt_slice = atol(optarg); break;
+    case 'Z':
+      opt_switch = atoi(optarg); break;
+    case 'L':
+      opt_flush = 1; break;
+    case 'G':
+      way_shares = optarg; break;
+    case 'U':
+      if (sscanf(optarg, "%d,%d", &sim_config.mul_latency, &sim_config.div_latency) != 2 ||
+          sim_config.mul_latency < 1 || sim_config.div_latency < 1) {
+        fprintf(stderr, "Bad unit latencies %s (mul,div cycles, at least 1)\n", optarg);
+        return -1;
+      }
+      break;
+    case 'J':
+      sim_config.fusion = fusionParse(optarg);
+      if (sim_config.fusion < 0) {
+        fprintf(stderr, "Unknown fusion pairs %s (shadd, luiaddi, ldpair, all)\n", optarg);
+        return -1;
+      }
+      break;
+    case 'B':
+      opt_bypass = forwardingParse(optarg);
+      if (opt_bypass < 0) {
+        fprintf(stderr, "Unknown bypass network %s (none, exex, full, memmem, halfwrite)\n", optarg);
+        return -1;
+      }
+      break;
+    case 'D':
+      sim_config.output = outputParse(optarg);
+      if (sim_config.output < 0) {
+        fprintf(stderr, "Unknown output %s (regs, cycle, stats, cachetrace, cachestats, all, none)\n", optarg);
+        return -1;
+      }
+      break;
+    case 'M':
+      opt_policy = barrelParsePolicy(optarg);
+      if (opt_policy < 0) {
+        fprintf(stderr, "Unknown thread selection policy %s (rr, miss)\n", optarg);
+        return -1;
+      }
+      break;
+    case 'P':
+      hierarchy_params.prefetch.kind = prefetchParseKind(optarg);
+      if (hierarchy_params.prefetch.kind < 0) {
+        fprintf(stderr, "Unknown prefetcher %s (none, nextline, stride, stream)\n", optarg);
+        return -1;
+      }
+      break;
     case 'p':
       opt_printmem = 1;
       if (optind < argc - 1) { // Ensure there are two more arguments
@@ -135,6 +264,40 @@ int main(int argc, char **argv) {
       }
       optind+=2; // Skip the next argument as it's part of -p
       break;
+    case 'W':
+      if (strcmp(optarg, "writeback") == 0) {
+        hierarchy_params.l1i.writePolicy = hierarchy_params.l1d.writePolicy = WRITE_BACK;
+        hierarchy_params.l2.writePolicy = hierarchy_params.l3.writePolicy = WRITE_BACK;
+      } else if (strcmp(optarg, "writethrough") == 0) {
+        hierarchy_params.l1i.writePolicy = hierarchy_params.l1d.writePolicy = WRITE_THROUGH;
+        hierarchy_params.l2.writePolicy = hierarchy_params.l3.writePolicy = WRITE_THROUGH;
+      } else {
+        fprintf(stderr, "Unknown write policy %s (writeback, writethrough)\n", optarg);
+        return -1;
+      }
+      break;
+    case 'R': {
+      int policy = replacementParse(optarg);
+      if (policy < 0) {
+        fprintf(stderr, "Unknown replacement policy %s (lru, lfu, fifo, random, plru, srrip, brrip, drrip)\n", optarg);
+        return -1;
+      }
+      hierarchy_params.l1i.replacement = hierarchy_params.l1d.replacement = policy;
+      hierarchy_params.l2.replacement = hierarchy_params.l3.replacement = policy;
+      break;
+    }
+    case 'C':
+      if (cacheConfigOption(&hierarchy_params, optarg) != 0) {
+        cacheConfigUsage();
+        return -1;
+      }
+      break;
+    case 'F':
+      if (cacheConfigLoad(&hierarchy_params, optarg) != 0) {
+        cacheConfigUsage();
+        return -1;
+      }
+      break;
     default:
       fprintf(stderr, "Bad option %c\n", c);
       return -1;
@@ -147,8 +310,96 @@ int main(int argc, char **argv) {
     return -1;
   }
   
-  Cache cache;
-  cacheSetUp(&cache, "L1");
+  CacheHierarchy hierarchy;
+  if (cacheConfigFinish(&hierarchy_params) != 0 ||
+      hierarchySetUp(&hierarchy, &hierarchy_params) != 0) {
+    return -1;
+  }
+
+  /* stack distance analysis of the data accesses, one pass for every cache size */
+  StackDist stackdist;
+  if (opt_stackdist) {
+    if (!opt_cache) {
+      fprintf(stderr, "Error - stack distance analysis (-A) needs the cache simulation (-c)\n");
+      return -1;
+    }
+    stackDistSetUp(&stackdist, hierarchy_params.l1d.blockBits, SD_MAX_SET_BITS);
+    hierarchy.stackdist = &stackdist;
+  }
+
+  if (opt_attrib && !opt_cache) {
+    fprintf(stderr, "Error - miss attribution (-a) needs the cache simulation (-c)\n");
+    return -1;
+  }
+
+  /* the sweep file is checked before the run, the accesses are captured during it */
+  Sweep sweep;
+  AccessTrace capture;
+  if (sweep_path != NULL) {
+    if (!opt_cache) {
+      fprintf(stderr, "Error - a sweep (-X) needs the cache simulation (-c)\n");
+      return -1;
+    }
+    if (sweepLoad(&sweep, &hierarchy_params, sweep_path) != 0) {
+      cacheConfigUsage();
+      return -1;
+    }
+    traceSetUp(&capture);
+    hierarchy.capture = &capture;
+  }
+  /* the cores get their own L1s and share everything below them */
+  if (opt_cores > 1 && opt_sim) {
+    if (!opt_cache) {
+      fprintf(stderr, "Error - a multicore run (-N) needs the cycle accurate simulator with caches (-s -c)\n");
+      return -1;
+    }
+    if (opt_stackdist || opt_attrib || sweep_path != NULL) {
+      fprintf(stderr, "Error - -A, -a and -X follow a single core, not a multicore run (-N)\n");
+      return -1;
+    }
+    if (multicoreSetUp(&multicore, opt_cores, opt_quantum ? opt_quantum : MC_QUANTUM,
+                       &hierarchy_params) != 0)
+      return -1;
+  }
+  /* the harts of the emulator run in parallel, or in turn with a quantum (-Q) */
+  if (opt_cores > 1 && opt_mulator) {
+    if (opt_interactive || opt_regdump) {
+      fprintf(stderr, "Error - -i and -r follow a single hart, not a multi-hart run (-N)\n");
+      return -1;
+    }
+    if (hartsSetUp(&harts, opt_cores, opt_quantum) != 0)
+      return -1;
+  }
+  /* the hardware threads share the core and its caches, memory latency shows only with caches */
+  if (opt_hwthreads > 1) {
+    if (!opt_sim || !opt_cache || opt_cores > 1) {
+      fprintf(stderr, "Error - hardware threads (-H) need the single core simulator with caches (-s -c)\n");
+      return -1;
+    }
+    if (barrelSetUp(&barrel, opt_hwthreads, opt_policy) != 0)
+      return -1;
+    /* the full network reads the register file before WB writes it, which
+     * three interleaved threads hit on every dependency; write it first */
+    if (opt_bypass == FWD_FULL)
+      opt_bypass = FWD_HALFWRITE;
+  }
+  /* the programs share the core and its caches, each is charged for its own accesses */
+  int programs = argc - optind;
+  if (programs > 1 || way_shares != NULL) {
+    if (!opt_sim || !opt_cache || opt_cores > 1 || opt_hwthreads > 1) {
+      fprintf(stderr, "Error - several programs need the single core simulator with caches (-s -c)\n");
+      return -1;
+    }
+    if (opt_slice < 1 || opt_switch < 0) {
+      fprintf(stderr, "Error - the slice (-S) must be at least 1 cycle and the switch cost (-Z) at least 0\n");
+      return -1;
+    }
+    multiprogSetUp(&multiprog, opt_slice, opt_switch, opt_flush);
+  }
+  if (opt_cores > 1 && !opt_sim && !opt_mulator) {
+    fprintf(stderr, "Error - -N needs the emulator (-m) or the cycle accurate simulator (-s -c)\n");
+    return -1;
+  }
   /* load the executable into memory */
   assert(memory == NULL);
   memory = calloc(MEMORY_SPACE, sizeof(uint8_t)); // allocate zeroed memory
@@ -163,6 +414,21 @@ int main(int argc, char **argv) {
     return 0;
   }
 
+  /* the other programs go to regions of their own, all start at the same PC */
+  if (programs > 1 || way_shares != NULL) {
+    if (multiprogAdd(&multiprog, argv[optind], memory, prog_numins) != 0)
+      return -1;
+    for (int p = 1; p < programs; p++) {
+      Byte *region = calloc(MEMORY_SPACE, sizeof(uint8_t));
+      assert(region != NULL);
+      if (multiprogAdd(&multiprog, argv[optind + p], region,
+                       load_program(region, MEMORY_SPACE, regfile.PC, argv[optind + p], 0)) != 0)
+        return -1;
+    }
+    if (way_shares != NULL && multiprogPartition(&multiprog, way_shares, &hierarchy) != 0)
+      return -1;
+  }
+
   /* initialize the CPU */
   /* zero out all registers */
   int i;
@@ -181,6 +447,14 @@ int main(int argc, char **argv) {
   /* Set the stack pointer near the top of the memory array */
   regfile.R[2] = 0xEFFFF;
 
+  /* per-instruction and per-region L1D misses, the regions come from the layout set up above */
+  MissAttrib attrib;
+  if (opt_attrib) {
+    missAttribSetUp(&attrib, hierarchy.l1d.blockBits, hierarchy.l1d.linesPerSet << hierarchy.l1d.setBits,
+                    0x1000, 0x1000 + 4 * prog_numins, regfile.R[2], regfile.R[3]);
+    hierarchy.attrib = &attrib;
+  }
+
   int simins = 0;
 
   pipeline_regs_t pipeline_regs = {0};
@@ -190,8 +464,16 @@ int main(int argc, char **argv) {
 
   bootstrap(&pipeline_wires, &pipeline_regs, &regfile);
 
+  // MULTI-HART EMULATOR
+  if(opt_mulator && opt_cores > 1)
+  {
+    hartsReset(&harts, &regfile);
+    hartsRun(&harts, memory, opt_exit, prog_numins);
+    printHartsSummary(&harts);
+  }
+
   // EMULATOR
-  if(opt_mulator)
+  if(opt_mulator && opt_cores <= 1)
   {
     if (opt_exit) {
       /* simulate forever! */
@@ -207,58 +489,114 @@ int main(int argc, char **argv) {
     }
   }
 
+  // the cycle function is chosen once for every pipeline: bypass network, output and cache model
+  sim_config.fwd_mode = opt_bypass;
+  sim_config.cache_en = opt_cache || opt_cores > 1;
+  pipelineSelect();
+
+  // MULTICORE CYCLE ACCURATE SIMULATOR
+  if(opt_sim && opt_cores > 1)
+  {
+    multicoreReset(&multicore, &regfile);
+    multicoreRun(&multicore, memory, opt_exit, prog_numins);
+    printMulticoreSummary(&multicore);
+  }
+
   // CYCLE ACCURATE SIMULATOR
-  if(opt_sim)
+  if(opt_sim && opt_cores <= 1)
   {
-    if(opt_cache) sim_config.cache_en = true;
-    if(opt_forwarding) sim_config.fwd_en = true;
     bool ecall_exit = false;
-    if (opt_exit) {
+    if (opt_hwthreads > 1) {
+      /* every thread until its ecall, or for the program instructions */
+      barrelReset(&barrel, &regfile);
+      barrelRun(&barrel, memory, &hierarchy, opt_exit, prog_numins);
+    } else if (multiprog.count > 0) {
+      /* every program until its ecall, or for its own instructions */
+      multiprogReset(&multiprog, &regfile);
+      multiprogRun(&multiprog, &hierarchy, opt_exit);
+    } else if (opt_exit) {
       /* simulate forever! */
       while (1) {
-        cycle_pipeline(&regfile, memory, &cache, &pipeline_regs, &pipeline_wires, &ecall_exit);
+        cycle_pipeline(&regfile, memory, &hierarchy, &pipeline_regs, &pipeline_wires, &ecall_exit);
         if(ecall_exit) break;
       }
     } else {
       /* Either simulate for program instructions */
       while (simins < prog_numins) {
-        cycle_pipeline(&regfile, memory, &cache, &pipeline_regs, &pipeline_wires, &ecall_exit);
+        cycle_pipeline(&regfile, memory, &hierarchy, &pipeline_regs, &pipeline_wires, &ecall_exit);
         simins++;
       }
     }
     
-    // Flush section - always execute after main program
-    printf("\n========\n[MAIN]: Flushing pipeline\n========\n");
-    simins = 0;
-    prog_numins = load_program(memory, MEMORY_SPACE, regfile.PC + 4, "./code/input/FLUSH.input",
-                            opt_disasm);
-    
-    // Force pipeline to use next instruction address (which now points to FLUSH instructions)
-    pipeline_wires.pcsrc = true;
-    pipeline_wires.pc_src1 = regfile.PC + 4;
-    
-    while (simins < prog_numins) {
-      cycle_pipeline(&regfile, memory, &cache, &pipeline_regs, &pipeline_wires, &ecall_exit);
-      simins++;
+    // Flush section - always execute after main program, the threads of -H and the programs stop at their ecall
+    if (opt_hwthreads <= 1 && multiprog.count == 0) {
+      printf("\n========\n[MAIN]: Flushing pipeline\n========\n");
+      simins = 0;
+      prog_numins = load_program(memory, MEMORY_SPACE, regfile.PC + 4, "./code/input/FLUSH.input",
+                              opt_disasm);
+      
+      // Force pipeline to use next instruction address (which now points to FLUSH instructions)
+      pipeline_wires.pcsrc = true;
+      pipeline_wires.pc_src1 = regfile.PC + 4;
+      
+      while (simins < prog_numins) {
+        cycle_pipeline(&regfile, memory, &hierarchy, &pipeline_regs, &pipeline_wires, &ecall_exit);
+        simins++;
+      }
     }
 
-    #ifdef PRINT_STATS
-    printf("#Cycles            = %5ld\n", total_cycle_counter);
-    printf("#Forwards (EX-EX)  = %5ld\n", fwd_exex_counter);
-    printf("#Forwards (EX-MEM) = %5ld\n", fwd_exmem_counter);
-    printf("#Branches taken    = %5ld\n", branch_counter);
-    printf("#Stalls            = %5ld\n", stall_counter);
-    #endif
-    #ifdef PRINT_CACHE_STATS
-      #if defined(CACHE_ENABLE)
-      printf("#MEM   stalls      = %5ld\n", ((miss_count*MEM_LATENCY) + ((hit_count+miss_count) * (CACHE_HIT_LATENCY-1))));
-      #else
-      printf("#MEM   stalls      = %5ld\n", (mem_access_counter*(MEM_LATENCY-1)));
-      #endif
+    if (sim_config.output & OUT_STATS) {
+      printf("#Cycles            = %5ld\n", total_cycle_counter);
+      printf("#Forwards (EX-EX)  = %5ld\n", fwd_exex_counter);
+      printf("#Forwards (EX-MEM) = %5ld\n", fwd_exmem_counter);
+      printf("#Branches taken    = %5ld\n", branch_counter);
+      printf("#Stalls            = %5ld\n", stall_counter);
+      if (sim_config.fwd_mode == FWD_MEMMEM) {
+        printf("#Forwards (MEM-MEM) = %5ld\n", fwd_memmem_counter);
+      }
+      if (mul_counter + div_counter > 0 && sim_config.mul_latency + sim_config.div_latency > 2) {
+        printf("#Multiplies        = %5ld\n", mul_counter);
+        printf("#Divides           = %5ld\n", div_counter);
+        printf("#MUL/DIV stalls    = %5ld\n", mext_stall_counter + div_busy_counter - div_counter);
+        printf("Multiplier (%d cycles, pipelined): %.1f%% of issue slots used, "
+               "divider (up to %d cycles): %.1f%% busy, %.1f cycles per divide\n",
+               sim_config.mul_latency, 100.0 * mul_counter / total_cycle_counter,
+               sim_config.div_latency, 100.0 * div_busy_counter / total_cycle_counter,
+               div_counter ? (double)div_busy_counter / div_counter : 0.0);
+      }
+      if (sim_config.fusion) {
+        printf("#Fused pairs       = %5ld\n", fused_counter);
+        printf("#Instructions      = %5ld\n", retired_counter);
+        printf("CPI: %.3f, %.1f%% of the instructions fused, %ld issue slots saved\n",
+               retired_counter ? (double)total_cycle_counter / retired_counter : 0.0,
+               retired_counter ? 200.0 * fused_counter / retired_counter : 0.0, fused_counter);
+      }
+    }
+    if (sim_config.output & OUT_CACHE_STATS) {
+      if (sim_config.cache_en) {
+        printf("#MEM   stalls      = %5ld\n", mem_stall_counter);
+      } else {
+        printf("#MEM   stalls      = %5ld\n", (mem_access_counter*(MEM_LATENCY-1)));
+      }
       printf("#Cache accesses    = %5ld\n", hit_count+miss_count);
       printf("#Cache hits        = %5ld\n", hit_count);
       printf("#Cache misses      = %5ld\n", miss_count);
-    #endif
+      if (sim_config.cache_en) {
+        printHierarchySummary(&hierarchy);
+      }
+    }
+    if (opt_hwthreads > 1)
+      printBarrelSummary(&barrel);
+    if (multiprog.count > 0)
+      printMultiprogSummary(&multiprog, &hierarchy);
+    if (opt_stackdist)
+      printStackDistSummary(&stackdist);
+    if (opt_attrib)
+      printMissAttribSummary(&attrib, disasm_at);
+    if (sweep_path != NULL) {
+      if (sweepRun(&sweep, &capture, sweep_threads) != 0 || sweepWrite(&sweep, sweep_output) != 0)
+        return -1;
+    }
 
   }
 
@@ -283,6 +621,16 @@ int main(int argc, char **argv) {
   }
 
   // Deallocate the cache after all operations
-  deallocate(&cache);
+  hierarchyDeallocate(&hierarchy);
+  if (opt_cores > 1)
+    multicoreDeallocate(&multicore);
+  if (opt_stackdist)
+    stackDistDeallocate(&stackdist);
+  if (opt_attrib)
+    missAttribDeallocate(&attrib);
+  if (sweep_path != NULL) {
+    sweepDeallocate(&sweep);
+    traceDeallocate(&capture);
+  }
   return 0;
 }
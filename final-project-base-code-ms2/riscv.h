@@ -8,7 +8,22 @@
 void decode_instruction(uint32_t instruction_bits);
 
 /* see emulator.c */
+// Emulator state of a hart beyond its register file
+typedef struct {
+    int id;
+    bool exited;          // ran its exit ecall
+    bool reserved;        // lr.w reservation held
+    Address reservation;  // reserved word
+    Word reservedValue;   // value lr.w read from it
+    // RV32A counters
+    uint64_t lr;
+    uint64_t sc;
+    uint64_t sc_failed;
+    uint64_t amo;
+} hart_state_t;
+
 void execute_instruction(uint32_t instruction_bits, regfile_t* regfile, Byte *memory);
+void set_current_hart(hart_state_t *hart);
 void store(Byte *memory, Address address, Alignment alignment, Word value);
 Word load(Byte *memory, Address address, Alignment alignment);
 
@@ -16,7 +31,11 @@ Word load(Byte *memory, Address address, Alignment alignment);
 typedef struct
 {
     bool cache_en;
-    bool fwd_en;
+    int fwd_mode; // FWD_* bypass network
+    int output; // OUT_* bits of what the run prints
+    int mul_latency; // cycles until a product can be used (pipelined multiplier)
+    int div_latency; // cycles of a full divide (iterative divider)
+    int fusion; // FUSE_* pairs decode folds into one operation
 }simulator_config_t;
 
 #endif
@@ -0,0 +1,271 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stackdist.h"
+
+/* A block's stack distance is 1 + the number of distinct blocks (of the same set)
+ * touched since its previous access. The tree holds exactly one key per block,
+ * its last access time, so for the fully associative case that number is the
+ * count of keys after the block's old time: the tree size minus one rank query.
+ */
+
+#define SD_HASH_INITIAL 4096
+
+static uint32_t next_prio(StackDist *sd) {
+  sd->seed ^= sd->seed << 13;
+  sd->seed ^= sd->seed >> 17;
+  sd->seed ^= sd->seed << 5;
+  return sd->seed;
+}
+
+static int node_size(const SdTree *t, int n) {
+  return n ? t->nodes[n].size : 0;
+}
+
+static void update(SdTree *t, int n) {
+  t->nodes[n].size = 1 + node_size(t, t->nodes[n].left) + node_size(t, t->nodes[n].right);
+}
+
+// Split tree n into keys < key (*l) and keys >= key (*r)
+static void split(SdTree *t, int n, unsigned long long key, int *l, int *r) {
+  if (n == 0) {
+    *l = *r = 0;
+  } else if (t->nodes[n].key < key) {
+    split(t, t->nodes[n].right, key, &t->nodes[n].right, r);
+    update(t, n);
+    *l = n;
+  } else {
+    split(t, t->nodes[n].left, key, l, &t->nodes[n].left);
+    update(t, n);
+    *r = n;
+  }
+}
+
+// Join two trees where every key of a is smaller than every key of b
+static int merge(SdTree *t, int a, int b) {
+  if (a == 0 || b == 0)
+    return a ? a : b;
+  if (t->nodes[a].prio > t->nodes[b].prio) {
+    t->nodes[a].right = merge(t, t->nodes[a].right, b);
+    update(t, a);
+    return a;
+  }
+  t->nodes[b].left = merge(t, a, t->nodes[b].left);
+  update(t, b);
+  return b;
+}
+
+// Number of keys smaller than key
+static int rank_below(const SdTree *t, unsigned long long key) {
+  int n = t->root, rank = 0;
+  while (n != 0) {
+    if (t->nodes[n].key < key) {
+      rank += node_size(t, t->nodes[n].left) + 1;
+      n = t->nodes[n].right;
+    } else {
+      n = t->nodes[n].left;
+    }
+  }
+  return rank;
+}
+
+static void tree_insert(StackDist *sd, SdTree *t, unsigned long long key) {
+  int n = t->freeList;
+  if (n != 0) {
+    t->freeList = t->nodes[n].left;
+  } else {
+    if (t->count + 1 >= t->capacity) {
+      t->capacity *= 2;
+      t->nodes = realloc(t->nodes, t->capacity * sizeof(SdNode));
+      if (t->nodes == NULL) {
+        fprintf(stderr, "Error - out of memory for the stack distance tree\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+    n = ++t->count;
+  }
+  t->nodes[n] = (SdNode){.key = key, .prio = next_prio(sd), .left = 0, .right = 0, .size = 1};
+
+  int l, r;
+  split(t, t->root, key, &l, &r);
+  t->root = merge(t, merge(t, l, n), r);
+}
+
+static void tree_erase(SdTree *t, unsigned long long key) {
+  int l, mid, r;
+  split(t, t->root, key, &l, &r);
+  split(t, r, key + 1, &mid, &r);
+  if (mid != 0) {
+    t->nodes[mid].left = t->freeList;
+    t->freeList = mid;
+  }
+  t->root = merge(t, l, r);
+}
+
+static uint64_t hash_slot(const StackDist *sd, unsigned long long block) {
+  unsigned long long h = block * 0x9E3779B97F4A7C15ULL;
+  return (h ^ (h >> 32)) & (sd->hashSize - 1);
+}
+
+static void hash_grow(StackDist *sd) {
+  unsigned long long *oldKeys = sd->hashKeys;
+  uint64_t *oldTimes = sd->hashTimes;
+  uint64_t oldSize = sd->hashSize;
+
+  sd->hashSize *= 2;
+  sd->hashKeys = calloc(sd->hashSize, sizeof(unsigned long long));
+  sd->hashTimes = calloc(sd->hashSize, sizeof(uint64_t));
+  if (sd->hashKeys == NULL || sd->hashTimes == NULL) {
+    fprintf(stderr, "Error - out of memory for the stack distance table\n");
+    exit(EXIT_FAILURE);
+  }
+  for (uint64_t i = 0; i < oldSize; i++) {
+    if (oldTimes[i] == 0)
+      continue;
+    uint64_t s = hash_slot(sd, oldKeys[i]);
+    while (sd->hashTimes[s] != 0)
+      s = (s + 1) & (sd->hashSize - 1);
+    sd->hashKeys[s] = oldKeys[i];
+    sd->hashTimes[s] = oldTimes[i];
+  }
+  free(oldKeys);
+  free(oldTimes);
+}
+
+/* Look the block up in the LRU stack of its set and move it to the top.
+ * Returns its position (0 = most recent), SD_MAX_WAYS if it fell off the stack.
+ */
+static int stack_access(SdStacks *st, unsigned long long set, unsigned long long block) {
+  unsigned long long *stack = &st->blocks[set * SD_MAX_WAYS];
+  int depth = st->depth[set];
+  int pos = 0;
+
+  while (pos < depth && stack[pos] != block)
+    pos++;
+  if (pos == depth) {
+    if (depth < SD_MAX_WAYS)
+      st->depth[set]++;
+    else
+      pos = depth - 1; // the least recent entry drops off
+    memmove(&stack[1], &stack[0], pos * sizeof(stack[0]));
+    stack[0] = block;
+    return SD_MAX_WAYS;
+  }
+  memmove(&stack[1], &stack[0], pos * sizeof(stack[0]));
+  stack[0] = block;
+  return pos;
+}
+
+void stackDistSetUp(StackDist *sd, int blockBits, int maxSetBits) {
+  memset(sd, 0, sizeof(*sd));
+  sd->blockBits = blockBits;
+  sd->maxSetBits = maxSetBits > SD_MAX_SET_BITS ? SD_MAX_SET_BITS : maxSetBits;
+  sd->seed = 2463534242u;
+  sd->hashSize = SD_HASH_INITIAL;
+  sd->hashKeys = calloc(sd->hashSize, sizeof(unsigned long long));
+  sd->hashTimes = calloc(sd->hashSize, sizeof(uint64_t));
+  sd->tree.capacity = SD_HASH_INITIAL;
+  sd->tree.nodes = calloc(sd->tree.capacity, sizeof(SdNode));
+  for (int s = 0; s <= sd->maxSetBits; s++) {
+    sd->stacks[s].blocks = calloc((size_t)SD_MAX_WAYS << s, sizeof(unsigned long long));
+    sd->stacks[s].depth = calloc((size_t)1 << s, sizeof(uint8_t));
+  }
+}
+
+void stackDistDeallocate(StackDist *sd) {
+  free(sd->hashKeys);
+  free(sd->hashTimes);
+  free(sd->tree.nodes);
+  for (int s = 0; s <= sd->maxSetBits; s++) {
+    free(sd->stacks[s].blocks);
+    free(sd->stacks[s].depth);
+  }
+  memset(sd, 0, sizeof(*sd));
+}
+
+// Record one access, at the block granularity given to stackDistSetUp
+void stackDistAccess(StackDist *sd, unsigned long long address) {
+  unsigned long long block = address >> sd->blockBits;
+  uint64_t now = ++sd->accesses;
+
+  uint64_t slot = hash_slot(sd, block);
+  while (sd->hashTimes[slot] != 0 && sd->hashKeys[slot] != block)
+    slot = (slot + 1) & (sd->hashSize - 1);
+  uint64_t last = sd->hashTimes[slot];
+
+  // Fully associative distance from the tree of last access times
+  if (last != 0) {
+    uint64_t after = sd->tree.root ? node_size(&sd->tree, sd->tree.root) - rank_below(&sd->tree, last) - 1 : 0;
+    int bucket = 0;
+    while ((1ULL << bucket) < after + 1)
+      bucket++;
+    sd->faHist[bucket]++;
+    tree_erase(&sd->tree, last);
+  }
+  tree_insert(sd, &sd->tree, now);
+
+  // Set-associative distances up to SD_MAX_WAYS
+  for (int s = 0; s <= sd->maxSetBits; s++) {
+    SdStacks *st = &sd->stacks[s];
+    int pos = stack_access(st, block & ((1ULL << s) - 1), block);
+    if (last != 0)
+      st->hist[pos]++;
+  }
+
+  if (last == 0) {
+    sd->cold++;
+    sd->hashKeys[slot] = block;
+    sd->hashUsed++;
+  }
+  sd->hashTimes[slot] = now;
+  if (sd->hashUsed * 2 > sd->hashSize)
+    hash_grow(sd);
+}
+
+// Miss ratio of an LRU cache with 2^setBits sets of `ways` lines
+double stackDistMissRatio(const StackDist *sd, int setBits, int ways) {
+  const SdStacks *st = &sd->stacks[setBits];
+  uint64_t misses = sd->cold;
+
+  if (sd->accesses == 0)
+    return 0.0;
+  for (int d = ways; d <= SD_MAX_WAYS; d++)
+    misses += st->hist[d];
+  return (double)misses / sd->accesses;
+}
+
+// Miss ratio of a fully associative LRU cache of 2^lineBits lines
+double stackDistFullMissRatio(const StackDist *sd, int lineBits) {
+  uint64_t misses = sd->cold;
+
+  if (sd->accesses == 0)
+    return 0.0;
+  for (int b = lineBits + 1; b < SD_DIST_BUCKETS; b++)
+    misses += sd->faHist[b];
+  return (double)misses / sd->accesses;
+}
+
+// Table of miss ratios, one row per cache size, one column per associativity
+void printStackDistSummary(const StackDist *sd) {
+  int block = 1 << sd->blockBits;
+
+  printf("Stack distance analysis: %llu accesses, %llu distinct blocks, %d B blocks, LRU\n",
+         (unsigned long long)sd->accesses, (unsigned long long)sd->cold, block);
+  printf("%12s", "size \\ ways");
+  for (int ways = 1; ways <= SD_MAX_WAYS; ways *= 2)
+    printf(" %7d", ways);
+  printf(" %7s\n", "full");
+
+  // sizes from one block up to the largest set count at full associativity
+  for (int lineBits = 0; (1 << lineBits) <= (SD_MAX_WAYS << sd->maxSetBits); lineBits++) {
+    printf("%10ld B", (long)block << lineBits);
+    for (int ways = 1, wayBits = 0; ways <= SD_MAX_WAYS; ways *= 2, wayBits++) {
+      int setBits = lineBits - wayBits;
+      if (setBits < 0 || setBits > sd->maxSetBits)
+        printf(" %7s", "-");
+      else
+        printf(" %7.4f", stackDistMissRatio(sd, setBits, ways));
+    }
+    printf(" %7.4f\n", stackDistFullMissRatio(sd, lineBits));
+  }
+}
@@ -0,0 +1,68 @@
+#ifndef STACKDIST_H
+#define STACKDIST_H
+
+#include <stdint.h>
+
+#define SD_MAX_SET_BITS 12 // analyse 1 to 2^SD_MAX_SET_BITS sets
+#define SD_MAX_WAYS 64     // largest associativity reported
+#define SD_DIST_BUCKETS 64 // fully associative distances are kept in power of two buckets
+
+// Order statistic tree (treap) node, keyed by the last access time of a block
+typedef struct {
+  unsigned long long key;
+  uint32_t prio;
+  int left;
+  int right;
+  int size;
+} SdNode;
+
+typedef struct {
+  SdNode *nodes; // nodes[0] is the empty tree
+  int root;
+  int count;
+  int capacity;
+  int freeList;
+} SdTree;
+
+// LRU stacks of one set count, cut off at SD_MAX_WAYS entries per set
+typedef struct {
+  unsigned long long *blocks; // [set * SD_MAX_WAYS + position], most recent first
+  uint8_t *depth;             // entries in use per set
+  // hist[d] = reuses at stack distance d+1 within the set, hist[SD_MAX_WAYS] = farther
+  uint64_t hist[SD_MAX_WAYS + 1];
+} SdStacks;
+
+/* Mattson stack-distance analysis of a block address stream. An access to a
+ * block with stack distance d in its set hits in every LRU cache with that
+ * number of sets and at least d ways, so one pass gives the miss ratio of every
+ * size and associativity at once.
+ * Set-associative distances only matter up to SD_MAX_WAYS and come from short
+ * per-set stacks. The unbounded fully associative distance comes from a tree of
+ * last access times: it is the number of blocks touched after the block's
+ * previous access.
+ */
+typedef struct {
+  int blockBits;
+  int maxSetBits;
+  uint64_t accesses;
+  uint64_t cold; // first touch of a block, misses in every cache
+  // block number -> time of its last access, open addressing, time 0 = empty slot
+  unsigned long long *hashKeys;
+  uint64_t *hashTimes;
+  uint64_t hashSize;
+  uint64_t hashUsed;
+  uint32_t seed;
+  SdTree tree;
+  // faHist[b] = reuses at a fully associative distance in (2^(b-1), 2^b]
+  uint64_t faHist[SD_DIST_BUCKETS];
+  SdStacks stacks[SD_MAX_SET_BITS + 1]; // one per number of sets
+} StackDist;
+
+void stackDistSetUp(StackDist *sd, int blockBits, int maxSetBits);
+void stackDistDeallocate(StackDist *sd);
+void stackDistAccess(StackDist *sd, unsigned long long address);
+double stackDistMissRatio(const StackDist *sd, int setBits, int ways);
+double stackDistFullMissRatio(const StackDist *sd, int lineBits);
+void printStackDistSummary(const StackDist *sd);
+
+#endif // STACKDIST_H
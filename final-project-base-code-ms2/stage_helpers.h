@@ -18,19 +18,23 @@
 /// EXECUTE STAGE HELPERS ///
 
 /**
- * input  : idex_reg_t
+ * input  : idex_reg_t*
  * output : uint32_t alu_control signal
  **/
-uint32_t gen_alu_control(idex_reg_t idex_reg)
+uint32_t gen_alu_control(const idex_reg_t* idex_reg)
 {
   uint32_t alu_control = 0;
   
-  switch(idex_reg.instr.opcode) {
+  switch(idex_reg->instr.opcode) {
     case 0x33: // R-type instructions
-      switch(idex_reg.instr.rtype.funct3) {
+      if (idex_reg->instr.rtype.funct7 == 0x01) {
+        alu_control = 0xA + idex_reg->instr.rtype.funct3; // RV32M: mul 0xA ... remu 0x11
+        break;
+      }
+      switch(idex_reg->instr.rtype.funct3) {
         case 0x0: // add/sub
-          if (idex_reg.instr.rtype.funct7 == 0x00) alu_control = 0x0; // add
-          else if (idex_reg.instr.rtype.funct7 == 0x20) alu_control = 0x1; // sub
+          if (idex_reg->instr.rtype.funct7 == 0x00) alu_control = 0x0; // add
+          else if (idex_reg->instr.rtype.funct7 == 0x20) alu_control = 0x1; // sub
           break;
         case 0x1: // sll
           alu_control = 0x2;
@@ -45,8 +49,8 @@ uint32_t gen_alu_control(idex_reg_t idex_reg)
           alu_control = 0x5;
           break;
         case 0x5: // srl/sra
-          if (idex_reg.instr.rtype.funct7 == 0x00) alu_control = 0x6; // srl
-          else if (idex_reg.instr.rtype.funct7 == 0x20) alu_control = 0x7; // sra
+          if (idex_reg->instr.rtype.funct7 == 0x00) alu_control = 0x6; // srl
+          else if (idex_reg->instr.rtype.funct7 == 0x20) alu_control = 0x7; // sra
           break;
         case 0x6: // or
           alu_control = 0x8;
@@ -58,7 +62,7 @@ uint32_t gen_alu_control(idex_reg_t idex_reg)
       break;
       
     case 0x13: // I-type immediate instructions
-      switch(idex_reg.instr.itype.funct3) {
+      switch(idex_reg->instr.itype.funct3) {
         case 0x0: // addi
           alu_control = 0x0;
           break;
@@ -75,7 +79,7 @@ uint32_t gen_alu_control(idex_reg_t idex_reg)
           alu_control = 0x5;
           break;
         case 0x5: // srli/srai
-          if ((idex_reg.instr.itype.imm >> 10) == 0) alu_control = 0x6; // srli
+          if ((idex_reg->instr.itype.imm >> 10) == 0) alu_control = 0x6; // srli
           else alu_control = 0x7; // srai
           break;
         case 0x6: // ori
@@ -150,6 +154,34 @@ uint32_t execute_alu(uint32_t alu_inp1, uint32_t alu_inp2, uint32_t alu_control)
     case 0x9: //and
       result = alu_inp1 & alu_inp2;
       break;
+    case 0xA: //mul
+      result = alu_inp1 * alu_inp2;
+      break;
+    case 0xB: //mulh
+      result = ((int64_t)(int32_t)alu_inp1 * (int64_t)(int32_t)alu_inp2) >> 32;
+      break;
+    case 0xC: //mulhsu
+      result = ((int64_t)(int32_t)alu_inp1 * (int64_t)(uint64_t)alu_inp2) >> 32;
+      break;
+    case 0xD: //mulhu
+      result = ((uint64_t)alu_inp1 * (uint64_t)alu_inp2) >> 32;
+      break;
+    case 0xE: //div, all ones for a zero divisor and -2^31 when it overflows
+      if (alu_inp2 == 0) result = 0xFFFFFFFF;
+      else if (alu_inp1 == 0x80000000 && alu_inp2 == 0xFFFFFFFF) result = 0x80000000;
+      else result = (int32_t)alu_inp1 / (int32_t)alu_inp2;
+      break;
+    case 0xF: //divu
+      result = alu_inp2 == 0 ? 0xFFFFFFFF : alu_inp1 / alu_inp2;
+      break;
+    case 0x10: //rem, the dividend for a zero divisor and 0 when it overflows
+      if (alu_inp2 == 0) result = alu_inp1;
+      else if (alu_inp1 == 0x80000000 && alu_inp2 == 0xFFFFFFFF) result = 0;
+      else result = (int32_t)alu_inp1 % (int32_t)alu_inp2;
+      break;
+    case 0x11: //remu
+      result = alu_inp2 == 0 ? alu_inp1 : alu_inp1 % alu_inp2;
+      break;
     default:
       result = 0xBADCAFFE;
       break;
@@ -197,117 +229,147 @@ uint32_t gen_imm(Instruction instruction)
 
 /**
  * generates all the control logic that flows around in the pipeline
- * input  : Instruction
- * output : idex_reg_t
+ * input  : Instruction, idex_reg_t* filled in place
+ * output : None
  **/
-idex_reg_t gen_control(Instruction instruction)
+void gen_control(Instruction instruction, idex_reg_t* idex_reg)
 {
-  idex_reg_t idex_reg = {0};
-  
   switch(instruction.opcode) {
     case 0x33:  //R-type
-      idex_reg.rs1 = instruction.rtype.rs1;
-      idex_reg.rs2 = instruction.rtype.rs2;
-      idex_reg.rd = instruction.rtype.rd;
-      idex_reg.regWrite = true;
-      idex_reg.memRead = false;
-      idex_reg.memWrite = false;
-      idex_reg.branch = false;
-      idex_reg.use_imm = false;
+      idex_reg->rs1 = instruction.rtype.rs1;
+      idex_reg->rs2 = instruction.rtype.rs2;
+      idex_reg->rd = instruction.rtype.rd;
+      idex_reg->regWrite = true;
+      idex_reg->memRead = false;
+      idex_reg->memWrite = false;
+      idex_reg->branch = false;
+      idex_reg->use_imm = false;
       break;
       
     case 0x13:  //I-type (immediate)
-      idex_reg.rs1 = instruction.itype.rs1;
-      idex_reg.rs2 = 0;
-      idex_reg.rd = instruction.itype.rd;
-      idex_reg.regWrite = true;
-      idex_reg.memRead = false;
-      idex_reg.memWrite = false;
-      idex_reg.branch = false;
-      idex_reg.use_imm = true;
+      idex_reg->rs1 = instruction.itype.rs1;
+      idex_reg->rs2 = 0;
+      idex_reg->rd = instruction.itype.rd;
+      idex_reg->regWrite = true;
+      idex_reg->memRead = false;
+      idex_reg->memWrite = false;
+      idex_reg->branch = false;
+      idex_reg->use_imm = true;
       break;
       
     case 0x03:  //I-type (load)
-      idex_reg.rs1 = instruction.itype.rs1;
-      idex_reg.rs2 = 0;
-      idex_reg.rd = instruction.itype.rd;
-      idex_reg.regWrite = true;
-      idex_reg.memRead = true;
-      idex_reg.memWrite = false;
-      idex_reg.branch = false;
-      idex_reg.use_imm = true;
+      idex_reg->rs1 = instruction.itype.rs1;
+      idex_reg->rs2 = 0;
+      idex_reg->rd = instruction.itype.rd;
+      idex_reg->regWrite = true;
+      idex_reg->memRead = true;
+      idex_reg->memWrite = false;
+      idex_reg->branch = false;
+      idex_reg->use_imm = true;
       break;
       
     case 0x23:  //S-type (store)
-      idex_reg.rs1 = instruction.stype.rs1;
-      idex_reg.rs2 = instruction.stype.rs2;
-      idex_reg.rd = 0;
-      idex_reg.regWrite = false;
-      idex_reg.memRead = false;
-      idex_reg.memWrite = true;
-      idex_reg.branch = false;
-      idex_reg.use_imm = true;
+      idex_reg->rs1 = instruction.stype.rs1;
+      idex_reg->rs2 = instruction.stype.rs2;
+      idex_reg->rd = 0;
+      idex_reg->regWrite = false;
+      idex_reg->memRead = false;
+      idex_reg->memWrite = true;
+      idex_reg->branch = false;
+      idex_reg->use_imm = true;
       break;
       
     case 0x63:  //B-type (branch)
-      idex_reg.rs1 = instruction.sbtype.rs1;
-      idex_reg.rs2 = instruction.sbtype.rs2;
-      idex_reg.rd = 0;
-      idex_reg.regWrite = false;
-      idex_reg.memRead = false;
-      idex_reg.memWrite = false;
-      idex_reg.branch = true;
-      idex_reg.use_imm = true;
+      idex_reg->rs1 = instruction.sbtype.rs1;
+      idex_reg->rs2 = instruction.sbtype.rs2;
+      idex_reg->rd = 0;
+      idex_reg->regWrite = false;
+      idex_reg->memRead = false;
+      idex_reg->memWrite = false;
+      idex_reg->branch = true;
+      idex_reg->use_imm = true;
       break;
       
     case 0x37:  //U-type (lui)
-      idex_reg.rs1 = 0;
-      idex_reg.rs2 = 0;
-      idex_reg.rd = instruction.utype.rd;
-      idex_reg.regWrite = true;
-      idex_reg.memRead = false;
-      idex_reg.memWrite = false;
-      idex_reg.branch = false;
-      idex_reg.use_imm = true;
+      idex_reg->rs1 = 0;
+      idex_reg->rs2 = 0;
+      idex_reg->rd = instruction.utype.rd;
+      idex_reg->regWrite = true;
+      idex_reg->memRead = false;
+      idex_reg->memWrite = false;
+      idex_reg->branch = false;
+      idex_reg->use_imm = true;
       break;
       
     case 0x17:  //U-type (auipc)
-      idex_reg.rs1 = 0;
-      idex_reg.rs2 = 0;
-      idex_reg.rd = instruction.utype.rd;
-      idex_reg.regWrite = true;
-      idex_reg.memRead = false;
-      idex_reg.memWrite = false;
-      idex_reg.branch = false;
-      idex_reg.use_imm = true;
+      idex_reg->rs1 = 0;
+      idex_reg->rs2 = 0;
+      idex_reg->rd = instruction.utype.rd;
+      idex_reg->regWrite = true;
+      idex_reg->memRead = false;
+      idex_reg->memWrite = false;
+      idex_reg->branch = false;
+      idex_reg->use_imm = true;
       break;
       
     case 0x6F:  //J-type (jal)
-      idex_reg.rs1 = 0;
-      idex_reg.rs2 = 0;
-      idex_reg.rd = instruction.ujtype.rd;
-      idex_reg.regWrite = true;
-      idex_reg.memRead = false;
-      idex_reg.memWrite = false;
-      idex_reg.branch = true;
-      idex_reg.use_imm = true;
+      idex_reg->rs1 = 0;
+      idex_reg->rs2 = 0;
+      idex_reg->rd = instruction.ujtype.rd;
+      idex_reg->regWrite = true;
+      idex_reg->memRead = false;
+      idex_reg->memWrite = false;
+      idex_reg->branch = true;
+      idex_reg->use_imm = true;
       break;
       
     case 0x67:  //I-type (jalr)
-      idex_reg.rs1 = instruction.itype.rs1;
-      idex_reg.rs2 = 0;
-      idex_reg.rd = instruction.itype.rd;
-      idex_reg.regWrite = true;
-      idex_reg.memRead = false;
-      idex_reg.memWrite = false;
-      idex_reg.branch = true;
-      idex_reg.use_imm = true;
+      idex_reg->rs1 = instruction.itype.rs1;
+      idex_reg->rs2 = 0;
+      idex_reg->rd = instruction.itype.rd;
+      idex_reg->regWrite = true;
+      idex_reg->memRead = false;
+      idex_reg->memWrite = false;
+      idex_reg->branch = true;
+      idex_reg->use_imm = true;
       break;
       
     default:  // Remaining opcodes
       break;
   }
-  return idex_reg;
+}
+
+/**
+ * Macro-op fusion: which of the enabled pairs the instruction in ID and the
+ * one after it form. Both must write the same register, so the fused
+ * operation still has one result, except for the load pair, whose second
+ * load may not read or overwrite the first one's destination.
+ * input  : Instruction, Instruction, enabled FUSE_* mask
+ * output : FUSE_* kind, 0 if they do not fuse
+ **/
+int gen_fusion(Instruction first, Instruction second, int enabled)
+{
+  if ((enabled & FUSE_SHIFT_ADD) &&
+      first.opcode == 0x13 && first.itype.funct3 == 0x1 && (first.itype.imm >> 5) == 0 &&
+      second.opcode == 0x33 && second.rtype.funct3 == 0x0 && second.rtype.funct7 == 0x00 &&
+      first.itype.rd != 0 && second.rtype.rd == first.itype.rd &&
+      (second.rtype.rs1 == first.itype.rd) != (second.rtype.rs2 == first.itype.rd)) {
+    return FUSE_SHIFT_ADD;
+  }
+  if ((enabled & FUSE_LUI_ADDI) &&
+      first.opcode == 0x37 && second.opcode == 0x13 && second.itype.funct3 == 0x0 &&
+      first.utype.rd != 0 && second.itype.rd == first.utype.rd && second.itype.rs1 == first.utype.rd) {
+    return FUSE_LUI_ADDI;
+  }
+  if ((enabled & FUSE_LOAD_PAIR) &&
+      first.opcode == 0x03 && first.itype.funct3 == 0x2 &&
+      second.opcode == 0x03 && second.itype.funct3 == 0x2 &&
+      second.itype.rs1 == first.itype.rs1 && first.itype.rd != first.itype.rs1 &&
+      first.itype.rd != 0 && second.itype.rd != 0 && second.itype.rd != first.itype.rd &&
+      sign_extend_number(second.itype.imm, 12) == sign_extend_number(first.itype.imm, 12) + 4) {
+    return FUSE_LOAD_PAIR;
+  }
+  return 0;
 }
 
 /// MEMORY STAGE HELPERS ///
@@ -364,113 +426,299 @@ bool gen_branch(uint32_t reg_val1, uint32_t reg_val2, Instruction instruction)
 
 /// PIPELINE FEATURES ///
 
+/**
+ * Task   : Bypass source of one EX operand, looked up in the scoreboard.
+ *           A writer now in MEM forwards its ALU result (loads have no value
+ *           yet), one now in WB forwards what it writes back; older ones
+ *           are in the register file already. Only a writer of the same
+ *           thread context shows up in its scoreboard.
+ * input  : pipeline_regs_t*, pipeline_wires_t*, source register
+ * output : forwarding signals and data of that operand
+*/
+static inline void forward_operand(pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p, uint8_t rs,
+                                   bool* from_ex, bool* from_mem, uint32_t* data, const int mode, const int out)
+{
+  scoreboard_t* sb = &pwires_p->scoreboard[pregs_p->idex_preg.out.tid];
+
+  if (rs == 0 || sb->mem_step[rs] == 0) {
+    return;
+  }
+  uint64_t age = pwires_p->step - sb->mem_step[rs];
+  if (age == 0 && !sb->load[rs]) {
+    if (mode == FWD_NONE) {
+      return;
+    }
+    *from_ex = true;
+    *data = pregs_p->exmem_preg.out.alu_result;
+    if (out & STEP_STATS) {
+      fwd_exex_counter++;
+    }
+  } else if (age == 1) {
+    if (mode == FWD_NONE || mode == FWD_EXEX) {
+      return;
+    }
+    memwb_reg_t* memwb_reg = &pregs_p->memwb_preg.out;
+    *from_mem = true;
+    *data = sb->second[rs] ? memwb_reg->mem_data2 :
+            memwb_reg->mem_to_reg ? memwb_reg->mem_data : memwb_reg->alu_result;
+    if (out & STEP_STATS) {
+      fwd_exmem_counter++;
+    }
+  }
+}
+
 /**
  * Task   : Sets the pipeline wires for the forwarding unit's control signals
- *           based on the pipeline register values.
- * input  : pipeline_regs_t*, pipeline_wires_t*
+ *           from the register scoreboard, for the FWD_* bypass network.
+ * input  : pipeline_regs_t*, pipeline_wires_t*, mode, STEP_* bits
  * output : None
 */
-void gen_forward(pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p)
+static inline void gen_forward(pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p, const int mode, const int out)
 {
   // Get current instruction in EX stage (using output registers for current state)
-  idex_reg_t idex_reg = pregs_p->idex_preg.out;
-  exmem_reg_t exmem_reg = pregs_p->exmem_preg.out;
-  memwb_reg_t memwb_reg = pregs_p->memwb_preg.out;
+  idex_reg_t* idex_reg = &pregs_p->idex_preg.out;
   
   // Initialize forwarding signals
   pwires_p->forward_rs1_ex = false;
   pwires_p->forward_rs2_ex = false;
   pwires_p->forward_rs1_mem = false;
   pwires_p->forward_rs2_mem = false;
-  
-  // Skip forwarding if current instruction is NOP or invalid
-  if (idex_reg.instr.bits == 0x00000013 || idex_reg.instr.bits == 0) {
-    return;
-  }
-  
-  // Check for EX hazard (forwarding from EXMEM to EX) - HIGHER PRIORITY
-  // Note: Cannot forward from load instructions in EXMEM stage (data not available yet)
-  if (exmem_reg.regWrite && exmem_reg.rd != 0 && exmem_reg.instr.bits != 0x00000013 && !exmem_reg.memRead) {
-    // Check if rs1 needs forwarding
-    if (idex_reg.rs1 != 0 && idex_reg.rs1 == exmem_reg.rd && 
-        (idex_reg.instr.opcode == 0x33 || idex_reg.instr.opcode == 0x13 || 
-         idex_reg.instr.opcode == 0x03 || idex_reg.instr.opcode == 0x23 || 
-         idex_reg.instr.opcode == 0x63 || idex_reg.instr.opcode == 0x67)) {
-      pwires_p->forward_rs1_ex = true;
-      pwires_p->forward_rs1_data = exmem_reg.alu_result;
-      fwd_exex_counter++;
-    }
-    // Check if rs2 needs forwarding
-    if (idex_reg.rs2 != 0 && idex_reg.rs2 == exmem_reg.rd && 
-        (idex_reg.instr.opcode == 0x33 || idex_reg.instr.opcode == 0x23 || 
-         idex_reg.instr.opcode == 0x63)) {
-      pwires_p->forward_rs2_ex = true;
-      pwires_p->forward_rs2_data = exmem_reg.alu_result;
-      fwd_exex_counter++;
-    }
+
+  // decode leaves the registers an instruction does not read at 0
+  forward_operand(pregs_p, pwires_p, idex_reg->rs1, &pwires_p->forward_rs1_ex,
+                  &pwires_p->forward_rs1_mem, &pwires_p->forward_rs1_data, mode, out);
+  forward_operand(pregs_p, pwires_p, idex_reg->rs2, &pwires_p->forward_rs2_ex,
+                  &pwires_p->forward_rs2_mem, &pwires_p->forward_rs2_data, mode, out);
+}
+
+// The youngest writer of the register in thread context tid is a load now in MEM
+bool load_in_mem(pipeline_wires_t* pwires_p, uint8_t tid, uint8_t rs)
+{
+  scoreboard_t* sb = &pwires_p->scoreboard[tid];
+  return rs != 0 && sb->load[rs] && sb->mem_step[rs] == pwires_p->step;
+}
+
+/**
+ * Without the MEM to EX bypass an operand waits until its writer has left
+ * WB. The register file is read before writeback in a cycle, so one read in
+ * the cycle of the write is stale as well and is read again.
+ */
+static inline bool operand_waits(pipeline_wires_t* pwires_p, uint8_t tid, uint8_t rs, const int mode)
+{
+  scoreboard_t* sb = &pwires_p->scoreboard[tid];
+
+  if (rs == 0 || sb->mem_step[rs] == 0) {
+    return false;
   }
-  
-  // Check for MEM hazard (forwarding from MEMWB to EX) - LOWER PRIORITY, only if not already forwarded from EX
-  if (memwb_reg.regWrite && memwb_reg.rd != 0 && memwb_reg.instr.bits != 0x00000013) {
-    // Check if rs1 needs forwarding (and not already forwarded from EX)
-    if (idex_reg.rs1 != 0 && idex_reg.rs1 == memwb_reg.rd && 
-        !pwires_p->forward_rs1_ex && // Not already forwarded from EX
-        (idex_reg.instr.opcode == 0x33 || idex_reg.instr.opcode == 0x13 || 
-         idex_reg.instr.opcode == 0x03 || idex_reg.instr.opcode == 0x23 || 
-         idex_reg.instr.opcode == 0x63 || idex_reg.instr.opcode == 0x67)) {
-      pwires_p->forward_rs1_mem = true;
-      pwires_p->forward_rs1_data = memwb_reg.mem_to_reg ? memwb_reg.mem_data : memwb_reg.alu_result;
-      fwd_exmem_counter++;
-    }
-    // Check if rs2 needs forwarding (and not already forwarded from EX)
-    if (idex_reg.rs2 != 0 && idex_reg.rs2 == memwb_reg.rd && 
-        !pwires_p->forward_rs2_ex && // Not already forwarded from EX
-        (idex_reg.instr.opcode == 0x33 || idex_reg.instr.opcode == 0x23 || 
-         idex_reg.instr.opcode == 0x63)) {
-      pwires_p->forward_rs2_mem = true;
-      pwires_p->forward_rs2_data = memwb_reg.mem_to_reg ? memwb_reg.mem_data : memwb_reg.alu_result;
-      fwd_exmem_counter++;
-    }
+  uint64_t age = pwires_p->step - sb->mem_step[rs];
+  if (mode == FWD_EXEX && age == 0 && !sb->load[rs]) {
+    return false; // bypassed EX to EX
   }
+  return age <= 2;
 }
 
 /**
  * Task   : Sets the pipeline wires for the hazard unit's control signals
- *           based on the pipeline register values.
- * input  : pipeline_regs_t*, pipeline_wires_t*
+ *           from the register scoreboard, for the FWD_* bypass network.
+ * input  : pipeline_regs_t*, pipeline_wires_t*, mode, STEP_* bits
  * output : None
 */
-void detect_hazard(pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p, regfile_t* regfile_p)
+static inline void detect_hazard(pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p, regfile_t* regfile_p, const int mode, const int out)
 {
   // Get current instruction in ID stage
-  idex_reg_t idex_reg = pregs_p->idex_preg.out;
-  exmem_reg_t exmem_reg = pregs_p->exmem_preg.out;
+  idex_reg_t* idex_reg = &pregs_p->idex_preg.out;
   
   // Initialize stall signal
   pwires_p->stall = false;
+  pwires_p->forward_store_mem = false;
+
+  if (mode == FWD_NONE || mode == FWD_EXEX) {
+    if (operand_waits(pwires_p, idex_reg->tid, idex_reg->rs1, mode) ||
+        operand_waits(pwires_p, idex_reg->tid, idex_reg->rs2, mode)) {
+      pwires_p->ex_hold = true;
+      if (TRACING(out, OUT_CYCLE)) {
+        printf("[HZD]: Holding EX until written back: 0x%08x\n", idex_reg->instr_addr);
+      }
+      stall_counter++;
+    }
+    return;
+  }
+
+  bool data_use = load_in_mem(pwires_p, idex_reg->tid, idex_reg->rs2);
+  if (mode == FWD_MEMMEM && data_use && idex_reg->memWrite) {
+    // the store picks the loaded word up in MEM, only its address has to wait
+    pwires_p->forward_store_mem = true;
+    data_use = false;
+  }
   
-  // Check for load-use hazard
-  // A load-use hazard occurs when:
-  // 1. Previous instruction (in EXMEM) is a load instruction
-  // 2. Current instruction (in IDEX) uses the register that the load writes to
-  if (exmem_reg.memRead && exmem_reg.regWrite && exmem_reg.rd != 0) {
-    // Check if current instruction uses the register that the load writes to
-    if ((idex_reg.rs1 != 0 && idex_reg.rs1 == exmem_reg.rd) || 
-        (idex_reg.rs2 != 0 && idex_reg.rs2 == exmem_reg.rd)) {
-      
-      // Set stall signal
-      pwires_p->stall = true;
-      
-      // Stall and re-fetch the same instruction
-      printf("[HZD]: Stalling and rewriting PC: 0x%08x\n", pregs_p->ifid_preg.out.instr_addr);
-      
-      // Don't update PC, so the same instruction will be fetched again
-      // This is handled by not updating the PC in the cycle_pipeline function
+  if (mode != FWD_FULL) {
+    // the user waits a cycle in EX and takes the loaded word from WB
+    if (load_in_mem(pwires_p, idex_reg->tid, idex_reg->rs1) || data_use) {
+      pwires_p->ex_hold = true;
+      if (TRACING(out, OUT_CYCLE)) {
+        printf("[HZD]: Holding EX for a load: 0x%08x\n", idex_reg->instr_addr);
+      }
       stall_counter++;
     }
+    return;
   }
+
+  // Check for load-use hazard: the instruction in IDEX reads what a load in EXMEM is loading
+  if (load_in_mem(pwires_p, idex_reg->tid, idex_reg->rs1) || data_use) {
+    // Set stall signal
+    pwires_p->stall = true;
+    
+    // Stall and re-fetch the same instruction
+    if (TRACING(out, OUT_CYCLE)) {
+      printf("[HZD]: Stalling and rewriting PC: 0x%08x\n", pregs_p->ifid_preg.out.instr_addr);
+    }
+    
+    // Don't update PC, so the same instruction will be fetched again
+    // This is handled by not updating the PC in the cycle_pipeline function
+    stall_counter++;
+  }
+}
+
+/// RV32M FUNCTIONAL UNITS ///
+
+// mul, mulh, mulhsu and mulhu go to the multiplier
+bool is_mul(Instruction instruction)
+{
+  return instruction.opcode == 0x33 && instruction.rtype.funct7 == 0x01 && instruction.rtype.funct3 < 0x4;
 }
 
+// div, divu, rem and remu go to the divider
+bool is_div(Instruction instruction)
+{
+  return instruction.opcode == 0x33 && instruction.rtype.funct7 == 0x01 && instruction.rtype.funct3 >= 0x4;
+}
+
+/**
+ * Cycles the iterative divider needs. It retires quotient bits at a fixed
+ * rate, latency cycles for all 32, and skips the leading bits the quotient
+ * cannot have, so a zero divisor or a dividend smaller than the divisor
+ * finishes in a single cycle.
+ **/
+int div_cycles(uint32_t dividend, uint32_t divisor, Instruction instruction, int latency)
+{
+  bool is_signed = !(instruction.rtype.funct3 & 0x1); // div and rem
+  if (is_signed) {
+    if ((int32_t)dividend < 0) dividend = -dividend;
+    if ((int32_t)divisor < 0) divisor = -divisor;
+  }
+  if (divisor == 0 || dividend < divisor) {
+    return 1;
+  }
+  int bits = __builtin_clz(divisor) - __builtin_clz(dividend) + 1; // quotient bits
+  int cycles = (bits * latency + 31) / 32;
+  return cycles > 1 ? cycles : 1;
+}
+
+/**
+ * Task   : Holds the instruction in EX while it cannot go on. An operand that
+ *           is a product still in the pipelined multiplier is a RAW hazard,
+ *           and the divider is not pipelined, so a divide occupies EX until
+ *           its quotient is done and everything behind it waits. Must run
+ *           after gen_forward, the divide latency depends on the operands.
+ * input  : pipeline_regs_t*, pipeline_wires_t*, STEP_* bits
+ * output : None
+*/
+static inline void detect_mext_hazard(pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p, const int out)
+{
+  const idex_reg_t* idex_reg = &pregs_p->idex_preg.out;
+  uint64_t now = total_cycle_counter;
+
+  // already waiting for an operand
+  if (pwires_p->ex_hold || idex_reg->instr.bits == 0x00000013 || idex_reg->instr.bits == 0) {
+    return;
+  }
+
+  const scoreboard_t* sb = &pwires_p->scoreboard[idex_reg->tid];
+  if ((idex_reg->rs1 != 0 && sb->ready[idex_reg->rs1] > now) ||
+      (idex_reg->rs2 != 0 && sb->ready[idex_reg->rs2] > now)) {
+    pwires_p->ex_hold = true;
+    if (out & STEP_STATS) {
+      mext_stall_counter++;
+    }
+    if (TRACING(out, OUT_CYCLE)) {
+      printf("[MDU]: Waiting for a product: 0x%08x\n", idex_reg->instr_addr);
+    }
+    return;
+  }
+
+  if (is_div(idex_reg->instr)) {
+    if (!pwires_p->div_busy) {
+      uint32_t dividend = pwires_p->forward_rs1_ex || pwires_p->forward_rs1_mem ? pwires_p->forward_rs1_data : (uint32_t)idex_reg->reg_val1;
+      uint32_t divisor = pwires_p->forward_rs2_ex || pwires_p->forward_rs2_mem ? pwires_p->forward_rs2_data : (uint32_t)idex_reg->reg_val2;
+      int cycles = div_cycles(dividend, divisor, idex_reg->instr, sim_config.div_latency);
+      pwires_p->div_busy = true;
+      pwires_p->div_done = now + cycles - 1;
+      if (out & STEP_STATS) {
+        div_counter++;
+        div_busy_counter += cycles;
+      }
+    }
+    if (now < pwires_p->div_done) {
+      pwires_p->ex_hold = true;
+      if (TRACING(out, OUT_CYCLE)) {
+        printf("[MDU]: Divider busy: 0x%08x\n", idex_reg->instr_addr);
+      }
+      return;
+    }
+    pwires_p->div_busy = false;
+  }
+}
+
+/**
+ * Task   : Enters the instruction leaving EX as the youngest writer of its
+ *           destination registers. Products are ready mul_latency cycles
+ *           after entering the multiplier, other results can be bypassed
+ *           as soon as they reach MEM (or WB for loads).
+ * input  : exmem_reg_t*, pipeline_wires_t*, STEP_* bits
+ * output : None
+*/
+static inline void scoreboard_write(const exmem_reg_t* exmem_reg, pipeline_wires_t* pwires_p, const int out)
+{
+  scoreboard_t* sb = &pwires_p->scoreboard[exmem_reg->tid];
+
+  if ((out & STEP_STATS) && is_mul(exmem_reg->instr)) {
+    mul_counter++;
+  }
+  if (!exmem_reg->regWrite || exmem_reg->rd == 0) {
+    return;
+  }
+  sb->mem_step[exmem_reg->rd] = pwires_p->step + 1;
+  sb->ready[exmem_reg->rd] = is_mul(exmem_reg->instr) ? total_cycle_counter + sim_config.mul_latency : 0;
+  sb->load[exmem_reg->rd] = exmem_reg->memRead;
+  sb->second[exmem_reg->rd] = false;
+  if (exmem_reg->rd2 != 0) {
+    sb->mem_step[exmem_reg->rd2] = pwires_p->step + 1;
+    sb->ready[exmem_reg->rd2] = 0;
+    sb->load[exmem_reg->rd2] = true;
+    sb->second[exmem_reg->rd2] = true;
+  }
+}
+
+/**
+ * Task   : MEM to MEM bypass. The store now entering MEM takes the word the
+ *           load ahead of it has just loaded, from the MEMWB register.
+ * input  : pipeline_regs_t*, pipeline_wires_t*, STEP_* bits
+ * output : None
+*/
+static inline void forward_mem_to_mem(pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p, const int out)
+{
+  exmem_reg_t* exmem_reg = &pregs_p->exmem_preg.out;
+  memwb_reg_t* memwb_reg = &pregs_p->memwb_preg.out;
+
+  if (!exmem_reg->store_from_wb) {
+    return;
+  }
+  exmem_reg->store_val = pwires_p->scoreboard[exmem_reg->tid].second[exmem_reg->instr.stype.rs2] ?
+                         memwb_reg->mem_data2 : memwb_reg->mem_data;
+  if (out & STEP_STATS) {
+    fwd_memmem_counter++;
+  }
+}
 
 ///////////////////////////////////////////////////////////////////////////////
 
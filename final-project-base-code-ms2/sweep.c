@@ -0,0 +1,332 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "cache_config.h"
+#include "sweep.h"
+
+/* Design space sweep over a captured access stream.
+ * A sweep file lists configurations as cache settings on top of the base
+ * configuration (-C/-F), one line each. A setting may list several values
+ * separated by commas and a line expands to every combination, e.g.
+ *   l1.size=4K,8K,16K l1.assoc=1,2,4 prefetch=none,stride
+ * is 18 configurations. Every configuration is an independent hierarchy fed the
+ * same accesses, so they are replayed on worker threads.
+ */
+
+#define SWEEP_MAX_KEYS 16
+#define SWEEP_MAX_VALUES 64
+
+typedef struct {
+  Sweep *sweep;
+  const AccessTrace *trace;
+  int next; // first configuration not taken by a worker yet
+} SweepJob;
+
+// Expand one line of the sweep file into configurations, -1 on a bad setting
+static int expand_line(Sweep *sweep, const HierarchyParams *base, char *line, const char *path, int lineno) {
+  char *keys[SWEEP_MAX_KEYS];
+  char *values[SWEEP_MAX_KEYS][SWEEP_MAX_VALUES];
+  int numValues[SWEEP_MAX_KEYS];
+  int index[SWEEP_MAX_KEYS] = {0};
+  int numKeys = 0;
+  long combinations = 1;
+
+  for (char *tok = strtok(line, " \t\r\n"); tok != NULL; tok = strtok(NULL, " \t\r\n")) {
+    char *eq = strchr(tok, '=');
+    if (eq == NULL || numKeys == SWEEP_MAX_KEYS) {
+      fprintf(stderr, "Error - %s:%d: expected up to %d key=value[,value...] settings\n", path, lineno,
+              SWEEP_MAX_KEYS);
+      return -1;
+    }
+    *eq = '\0';
+    keys[numKeys] = tok;
+    numValues[numKeys] = 0;
+    for (char *v = eq + 1; v != NULL && numValues[numKeys] < SWEEP_MAX_VALUES;) {
+      char *comma = strchr(v, ',');
+      if (comma != NULL)
+        *comma = '\0';
+      values[numKeys][numValues[numKeys]++] = v;
+      v = comma != NULL ? comma + 1 : NULL;
+    }
+    combinations *= numValues[numKeys];
+    numKeys++;
+  }
+  if (numKeys == 0)
+    return 0;
+  if (sweep->count + combinations > SWEEP_MAX_CONFIGS) {
+    fprintf(stderr, "Error - %s:%d: more than %d configurations\n", path, lineno, SWEEP_MAX_CONFIGS);
+    return -1;
+  }
+
+  // Count through every combination like an odometer
+  for (long n = 0; n < combinations; n++) {
+    SweepConfig *config = &sweep->configs[sweep->count];
+    size_t used = 0;
+
+    config->params = *base;
+    config->label[0] = '\0';
+    for (int k = 0; k < numKeys; k++) {
+      const char *value = values[k][index[k]];
+      if (cacheConfigSet(&config->params, keys[k], value) != 0) {
+        fprintf(stderr, "Error - in %s:%d\n", path, lineno);
+        return -1;
+      }
+      used += snprintf(config->label + used, used < SWEEP_MAX_LABEL ? SWEEP_MAX_LABEL - used : 0, "%s%s=%s",
+                       k ? " " : "", keys[k], value);
+    }
+    if (cacheConfigFinish(&config->params) != 0) {
+      fprintf(stderr, "Error - in %s:%d (%s)\n", path, lineno, config->label);
+      return -1;
+    }
+    // Catch bad combinations now rather than in a worker thread
+    if (hierarchySetUp(&config->hier, &config->params) != 0) {
+      fprintf(stderr, "Error - in %s:%d (%s)\n", path, lineno, config->label);
+      return -1;
+    }
+    hierarchyDeallocate(&config->hier);
+    sweep->count++;
+
+    for (int k = numKeys - 1; k >= 0; k--) {
+      if (++index[k] < numValues[k])
+        break;
+      index[k] = 0;
+    }
+  }
+  return 0;
+}
+
+// Read a sweep file, returns 0 on success, -1 (after printing why) on error
+int sweepLoad(Sweep *sweep, const HierarchyParams *base, const char *path) {
+  char line[CACHE_CONFIG_MAX_LINE];
+  int lineno = 0;
+  FILE *file = fopen(path, "r");
+
+  if (file == NULL) {
+    fprintf(stderr, "Error - cannot open sweep file %s\n", path);
+    return -1;
+  }
+  sweep->count = 0;
+  sweep->configs = calloc(SWEEP_MAX_CONFIGS, sizeof(SweepConfig));
+  while (fgets(line, sizeof(line), file) != NULL) {
+    lineno++;
+    char *hash = strchr(line, '#');
+    if (hash != NULL)
+      *hash = '\0';
+    if (expand_line(sweep, base, line, path, lineno) != 0) {
+      fclose(file);
+      return -1;
+    }
+  }
+  fclose(file);
+  if (sweep->count == 0) {
+    fprintf(stderr, "Error - sweep file %s has no configurations\n", path);
+    return -1;
+  }
+  return 0;
+}
+
+/* Take groups of SWEEP_GROUP configurations until none are left. The models of a
+ * group take turns on each batch of the trace, so a batch is read from memory
+ * once per group while it is still in the host caches.
+ */
+static void *sweep_worker(void *arg) {
+  SweepJob *job = arg;
+  Sweep *sweep = job->sweep;
+  const AccessTrace *trace = job->trace;
+
+  for (;;) {
+    int first = __atomic_fetch_add(&job->next, SWEEP_GROUP, __ATOMIC_RELAXED);
+    if (first >= sweep->count)
+      break;
+    int last = first + SWEEP_GROUP < sweep->count ? first + SWEEP_GROUP : sweep->count;
+
+    // every model classifies its own L1D misses, the shadow cache depends on its size
+    MissAttrib attrib[SWEEP_GROUP];
+    for (int i = first; i < last; i++) {
+      CacheHierarchy *h = &sweep->configs[i].hier;
+      hierarchySetUp(h, &sweep->configs[i].params);
+      missAttribSetUp(&attrib[i - first], h->l1d.blockBits, h->l1d.linesPerSet << h->l1d.setBits, 0, 0, 0, 0);
+      h->attrib = &attrib[i - first];
+    }
+
+    for (size_t start = 0; start < trace->count; start += SWEEP_BATCH) {
+      size_t end = start + SWEEP_BATCH < trace->count ? start + SWEEP_BATCH : trace->count;
+      for (int i = first; i < last; i++) {
+        CacheHierarchy *h = &sweep->configs[i].hier;
+        for (size_t a = start; a < end; a++) {
+          const TraceAccess *t = &trace->accesses[a];
+          // without an L1I the pipeline only translates its fetches, as here
+          if (t->type == ACCESS_FETCH && !h->hasL1I) {
+            if (h->hasTlb)
+              hierarchyTranslateFetch(h, t->address, t->cycle);
+            continue;
+          }
+          hierarchyAccess(h, t->address, t->pc, t->cycle, t->type, NULL);
+        }
+      }
+    }
+
+    // Only the counters are needed from here on
+    for (int i = first; i < last; i++) {
+      for (int c = 0; c < MISS_CLASSES; c++) {
+        sweep->configs[i].misses[c] = 0;
+        for (int r = 0; r < REGIONS; r++)
+          sweep->configs[i].misses[c] += attrib[i - first].regions[r].misses[c];
+      }
+      missAttribDeallocate(&attrib[i - first]);
+      hierarchyDeallocate(&sweep->configs[i].hier);
+    }
+  }
+  return NULL;
+}
+
+/* Replay the trace through every configuration on `threads` workers, 0 means
+ * one per online host CPU. Returns 0, or -1 if no thread could be started.
+ */
+int sweepRun(Sweep *sweep, const AccessTrace *trace, int threads) {
+  SweepJob job = {.sweep = sweep, .trace = trace, .next = 0};
+
+  if (threads <= 0)
+    threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  int groups = (sweep->count + SWEEP_GROUP - 1) / SWEEP_GROUP;
+  if (threads > groups)
+    threads = groups;
+  if (threads <= 1) {
+    sweep_worker(&job);
+    return 0;
+  }
+
+  pthread_t *workers = malloc(threads * sizeof(pthread_t));
+  int started = 0;
+  for (int i = 0; i < threads; i++) {
+    if (pthread_create(&workers[started], NULL, sweep_worker, &job) == 0)
+      started++;
+  }
+  if (started == 0) {
+    fprintf(stderr, "Error - cannot start sweep threads\n");
+    free(workers);
+    return -1;
+  }
+  for (int i = 0; i < started; i++)
+    pthread_join(workers[i], NULL);
+  free(workers);
+  return 0;
+}
+
+static double miss_rate(const Cache *cache) {
+  uint64_t accesses = cache->hit_count + cache->miss_count;
+  return accesses ? (double)cache->miss_count / accesses : 0.0;
+}
+
+static double amat(const CacheHierarchy *h, int side) {
+  return h->accesses[side] ? (double)h->total_latency[side] / h->accesses[side] : 0.0;
+}
+
+static const char *columns[] = {
+  "config", "accesses", "l1d_hits", "l1d_misses", "l1d_miss_rate", "l1d_evictions", "l1d_writebacks",
+  "l1d_compulsory", "l1d_capacity", "l1d_conflict",
+  "l1i_miss_rate", "l2_miss_rate", "l3_miss_rate", "mem_reads", "mem_writes", "mem_bytes_read",
+  "mem_bytes_written", "amat_data", "amat_instr", "prefetch_accuracy", "prefetch_coverage",
+  "waypred_accuracy", "bank_stall_cycles"
+};
+#define SWEEP_COLUMNS ((int)(sizeof(columns) / sizeof(columns[0])))
+#define SWEEP_CELL 32
+
+// Format a rate, or leave the cell empty for a level the configuration does not have
+static void rate_cell(char *cell, bool present, double value) {
+  if (present)
+    snprintf(cell, SWEEP_CELL, "%.6f", value);
+  else
+    cell[0] = '\0';
+}
+
+// One row; empty cells stay empty in CSV and become null in JSON
+static void write_row(FILE *out, bool json, const SweepConfig *config) {
+  const CacheHierarchy *h = &config->hier;
+  const Cache *l1 = &h->l1d;
+  bool prefetch = (h->l1d.prefetcher != NULL);
+  double accuracy = 0.0, coverage = 0.0, timely;
+  char cells[SWEEP_COLUMNS][SWEEP_CELL];
+
+  if (prefetch)
+    prefetchRatios(h->l1d.prefetcher, l1->miss_count, &accuracy, &coverage, &timely);
+
+  snprintf(cells[1], SWEEP_CELL, "%llu", (unsigned long long)(h->accesses[0] + h->accesses[1]));
+  snprintf(cells[2], SWEEP_CELL, "%llu", (unsigned long long)l1->hit_count);
+  snprintf(cells[3], SWEEP_CELL, "%llu", (unsigned long long)l1->miss_count);
+  rate_cell(cells[4], true, miss_rate(l1));
+  snprintf(cells[5], SWEEP_CELL, "%llu", (unsigned long long)l1->eviction_count);
+  snprintf(cells[6], SWEEP_CELL, "%llu", (unsigned long long)l1->writeback_count);
+  for (int c = 0; c < MISS_CLASSES; c++)
+    snprintf(cells[7 + c], SWEEP_CELL, "%llu", (unsigned long long)config->misses[c]);
+  rate_cell(cells[10], h->hasL1I, miss_rate(&h->l1i));
+  rate_cell(cells[11], h->numLower > 0, miss_rate(&h->lower[0]));
+  rate_cell(cells[12], h->numLower > 1, miss_rate(&h->lower[1]));
+  snprintf(cells[13], SWEEP_CELL, "%llu", (unsigned long long)h->mem_accesses);
+  snprintf(cells[14], SWEEP_CELL, "%llu", (unsigned long long)h->mem_writes);
+  snprintf(cells[15], SWEEP_CELL, "%llu", (unsigned long long)h->mem_bytes_read);
+  snprintf(cells[16], SWEEP_CELL, "%llu", (unsigned long long)h->mem_bytes_written);
+  rate_cell(cells[17], true, amat(h, 0));
+  rate_cell(cells[18], h->hasL1I, amat(h, 1));
+  rate_cell(cells[19], prefetch, accuracy);
+  rate_cell(cells[20], prefetch, coverage);
+  const L1TimingStats *ts = &h->l1timing.stats;
+  bool waypred = h->hasL1Timing && h->l1timing.params.wayPred != WAYPRED_NONE;
+  rate_cell(cells[21], waypred, ts->predictions ? (double)ts->correct / ts->predictions : 0.0);
+  if (h->hasL1Timing && h->l1timing.params.banks > 1)
+    snprintf(cells[22], SWEEP_CELL, "%llu", (unsigned long long)ts->bank_stall_cycles);
+  else
+    cells[22][0] = '\0';
+
+  if (json)
+    fprintf(out, "  {\"%s\": \"%s\"", columns[0], config->label);
+  else
+    fprintf(out, "\"%s\"", config->label);
+  for (int c = 1; c < SWEEP_COLUMNS; c++) {
+    if (json)
+      fprintf(out, ", \"%s\": %s", columns[c], cells[c][0] ? cells[c] : "null");
+    else
+      fprintf(out, ",%s", cells[c]);
+  }
+  fprintf(out, json ? "}" : "\n");
+}
+
+/* Write one row per configuration to path, as JSON if the name ends in .json
+ * and as CSV otherwise; NULL or "-" writes CSV to stdout.
+ */
+int sweepWrite(const Sweep *sweep, const char *path) {
+  bool toStdout = (path == NULL || strcmp(path, "-") == 0);
+  size_t len = toStdout ? 0 : strlen(path);
+  bool json = len > 5 && strcmp(path + len - 5, ".json") == 0;
+  FILE *out = toStdout ? stdout : fopen(path, "w");
+
+  if (out == NULL) {
+    fprintf(stderr, "Error - cannot write sweep results to %s\n", path);
+    return -1;
+  }
+  if (json) {
+    fprintf(out, "[\n");
+  } else {
+    for (int c = 0; c < SWEEP_COLUMNS; c++)
+      fprintf(out, "%s%s", c ? "," : "", columns[c]);
+    fprintf(out, "\n");
+  }
+  for (int i = 0; i < sweep->count; i++) {
+    write_row(out, json, &sweep->configs[i]);
+    if (json)
+      fprintf(out, i + 1 < sweep->count ? ",\n" : "\n");
+  }
+  if (json)
+    fprintf(out, "]\n");
+  if (!toStdout)
+    fclose(out);
+  return 0;
+}
+
+void sweepDeallocate(Sweep *sweep) {
+  free(sweep->configs);
+  sweep->configs = NULL;
+  sweep->count = 0;
+}
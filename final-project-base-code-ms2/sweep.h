@@ -0,0 +1,30 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include "hierarchy.h"
+#include "trace.h"
+
+#define SWEEP_MAX_CONFIGS 4096 // configurations one sweep file may expand to
+#define SWEEP_MAX_LABEL 256
+#define SWEEP_BATCH 4096       // accesses replayed per model before moving to the next one
+#define SWEEP_GROUP 8          // models a worker replays side by side over the same batch
+
+// One configuration of a sweep and, after sweepRun, its results
+typedef struct {
+  char label[SWEEP_MAX_LABEL]; // the settings that differ from the base configuration
+  HierarchyParams params;
+  CacheHierarchy hier;
+  uint64_t misses[MISS_CLASSES]; // L1D misses by three C class
+} SweepConfig;
+
+typedef struct {
+  SweepConfig *configs;
+  int count;
+} Sweep;
+
+int sweepLoad(Sweep *sweep, const HierarchyParams *base, const char *path);
+int sweepRun(Sweep *sweep, const AccessTrace *trace, int threads);
+int sweepWrite(const Sweep *sweep, const char *path);
+void sweepDeallocate(Sweep *sweep);
+
+#endif // SWEEP_H
@@ -0,0 +1,10 @@
+# RV32A: 4 harts each do 1000 rounds of amoadd.w, an lr.w/sc.w increment,
+# amoor.w, amomin.w, amomaxu.w and amoswap.w on shared words; the last hart
+# to finish prints them. Harts on parallel threads and in turn (-Q) must agree
+
+mkdir -p ./code/atomic/out
+for quantum in 0 1 7 1000; do
+    ./riscv -m -e -N 4 -Q $quantum ./code/atomic/input/counters.input | grep -v "^hart \|^Hart \| harts " > ./code/atomic/out/counters.$quantum.out
+    echo "diff ./code/atomic/ref/counters.out ./code/atomic/out/counters.$quantum.out"
+    diff ./code/atomic/ref/counters.out ./code/atomic/out/counters.$quantum.out
+done
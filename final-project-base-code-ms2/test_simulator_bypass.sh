@@ -0,0 +1,11 @@
+# every bypass network but the legacy full one must compute what the emulator computes
+# the final register file of every run is compared, no config.h edits needed
+
+mkdir -p ./code/bypass/out
+for net in none exex memmem halfwrite; do
+    for prog in loaduse hazards; do
+        ./riscv -s -e -D regs -B $net ./code/bypass/input/$prog.input | tail -9 | head -8 > ./code/bypass/out/$prog.$net.regs
+        echo "diff ./code/bypass/ref/$prog.regs ./code/bypass/out/$prog.$net.regs"
+        diff ./code/bypass/ref/$prog.regs ./code/bypass/out/$prog.$net.regs
+    done
+done
@@ -0,0 +1,9 @@
+# RV32M unit latencies must not change what a program computes
+# the final register file of every run is compared, no config.h edits needed
+
+mkdir -p ./code/mext/out
+for lat in 1,1 1,2 1,4 1,8 1,16 3,32; do
+    ./riscv -s -e -D regs -U $lat ./code/mext/input/divhold.input | tail -9 | head -8 > ./code/mext/out/divhold.$lat.regs
+    echo "diff ./code/mext/ref/divhold.regs ./code/mext/out/divhold.$lat.regs"
+    diff ./code/mext/ref/divhold.regs ./code/mext/out/divhold.$lat.regs
+done
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "tlb.h"
+
+void tlbDefaultParams(TlbParams *params) {
+  params->enable = false;
+  params->itlb = (TlbGeometry){ITLB_ENTRIES, ITLB_WAYS};
+  params->dtlb = (TlbGeometry){DTLB_ENTRIES, DTLB_WAYS};
+  params->l2 = (TlbGeometry){L2TLB_ENTRIES, L2TLB_WAYS};
+  params->l2Latency = L2TLB_LATENCY;
+  params->superpages = false;
+  params->pageTable = TLB_PAGE_TABLE;
+}
+
+static int log2_int(int n) {
+  int bits = 0;
+  while ((1 << bits) < n)
+    bits++;
+  return bits;
+}
+
+static void setup_tlb(Cache *tlb, const TlbGeometry *g, int pageBits, int hitLatency, char *name) {
+  tlb->setBits = log2_int(g->entries / g->ways);
+  tlb->linesPerSet = g->ways;
+  tlb->blockBits = pageBits;
+  tlb->sectorBits = 0;
+  tlb->replacement = REPL_LRU;
+  tlb->replSeed = REPL_SEED;
+  tlb->indexing = INDEX_MODULO;
+  tlb->hitLatency = hitLatency;
+  tlb->writePolicy = WRITE_BACK;
+  tlb->displayTrace = false;
+  cacheSetUp(tlb, name);
+}
+
+void tlbSetUp(Tlb *t, const TlbParams *params) {
+  t->params = *params;
+  t->pageBits = params->superpages ? SV32_MEGAPAGE_BITS : SV32_PAGE_BITS;
+  t->stats = (TlbStats){0};
+  setup_tlb(&t->itlb, &params->itlb, t->pageBits, 0, "ITLB");
+  setup_tlb(&t->dtlb, &params->dtlb, t->pageBits, 0, "DTLB");
+  setup_tlb(&t->l2, &params->l2, t->pageBits, params->l2Latency, "L2TLB");
+}
+
+void tlbDeallocate(Tlb *t) {
+  deallocate(&t->itlb);
+  deallocate(&t->dtlb);
+  deallocate(&t->l2);
+}
+
+/* Walk the page table for vaddr: the root PTE, then the leaf PTE unless the
+ * root one maps a megapage. Returns the cycles of the PTE reads.
+ */
+static int page_walk(Tlb *t, unsigned long long vaddr, tlb_walk_fn walk, void *ctx) {
+  unsigned long long mask = (1ULL << SV32_VPN_BITS) - 1;
+  unsigned long long vpn1 = (vaddr >> SV32_MEGAPAGE_BITS) & mask;
+  unsigned long long vpn0 = (vaddr >> SV32_PAGE_BITS) & mask;
+  unsigned long long root = t->params.pageTable;
+  int latency = walk(ctx, root + vpn1 * SV32_PTE_BYTES);
+  int reads = 1;
+
+  if (!t->params.superpages) {
+    unsigned long long leaf = root + ((1 + vpn1) << SV32_PAGE_BITS);
+    latency += walk(ctx, leaf + vpn0 * SV32_PTE_BYTES);
+    reads++;
+  }
+  t->stats.walks++;
+  t->stats.walk_reads += reads;
+  t->stats.walk_cycles += latency;
+  return latency;
+}
+
+/* Translate one fetch (instr) or data access. Returns the cycles translation
+ * adds to it, 0 on an L1 TLB hit. The walk callback reads a PTE through the
+ * data side of the cache hierarchy.
+ */
+int tlbTranslate(Tlb *t, unsigned long long vaddr, bool instr, tlb_walk_fn walk, void *ctx) {
+  Cache *l1 = instr ? &t->itlb : &t->dtlb;
+  int latency;
+
+  if (operateCache(vaddr, false, l1).status == CACHE_HIT)
+    return 0;
+  latency = t->l2.hitLatency;
+  if (operateCache(vaddr, false, &t->l2).status != CACHE_HIT)
+    latency += page_walk(t, vaddr, walk, ctx);
+  t->stats.cycles += latency;
+  return latency;
+}
+
+static void print_tlb(const Cache *tlb) {
+  uint64_t accesses = tlb->hit_count + tlb->miss_count;
+  printf("%-5s %d entries, %d ways: hits: %llu, misses: %llu, miss rate: %.4f\n", tlb->name,
+         tlb->linesPerSet << tlb->setBits, tlb->linesPerSet, (unsigned long long)tlb->hit_count,
+         (unsigned long long)tlb->miss_count,
+         accesses ? (double)tlb->miss_count / accesses : 0.0);
+}
+
+void printTlbSummary(const Tlb *t) {
+  const TlbStats *s = &t->stats;
+
+  printf("Sv32 TLBs (%s pages, page table at 0x%llx)\n", t->params.superpages ? "4 MiB" : "4 KiB",
+         t->params.pageTable);
+  print_tlb(&t->itlb);
+  print_tlb(&t->dtlb);
+  print_tlb(&t->l2);
+  printf("Page walks: %llu, PTE reads: %llu, walk cycles: %llu (%.2f per walk), translation cycles: %llu\n",
+         (unsigned long long)s->walks, (unsigned long long)s->walk_reads, (unsigned long long)s->walk_cycles,
+         s->walks ? (double)s->walk_cycles / s->walks : 0.0, (unsigned long long)s->cycles);
+}
@@ -0,0 +1,73 @@
+#ifndef TLB_H
+#define TLB_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "cache.h"
+
+// Sv32: 32-bit virtual addresses, two levels of 1024 four-byte PTEs
+#define SV32_PAGE_BITS 12      // 4 KiB pages
+#define SV32_MEGAPAGE_BITS 22  // 4 MiB superpages, mapped by a root PTE
+#define SV32_VPN_BITS 10
+#define SV32_PTE_BYTES 4
+
+// Default TLB geometry and latency, all of them can be changed at runtime
+#define ITLB_ENTRIES 16
+#define ITLB_WAYS 16          // fully associative
+#define DTLB_ENTRIES 32
+#define DTLB_WAYS 32
+#define L2TLB_ENTRIES 512
+#define L2TLB_WAYS 4
+#define L2TLB_LATENCY 4       // cycles added by an L1 TLB miss that hits the L2 TLB
+#define TLB_PAGE_TABLE 0x80000000ULL // physical address of the root page table
+
+// Entries and ways of one TLB
+typedef struct {
+  int entries;
+  int ways;
+} TlbGeometry;
+
+typedef struct {
+  bool enable;
+  TlbGeometry itlb;
+  TlbGeometry dtlb;
+  TlbGeometry l2;
+  int l2Latency;
+  bool superpages; // map everything with 4 MiB megapages instead of 4 KiB pages
+  unsigned long long pageTable;
+} TlbParams;
+
+typedef struct {
+  uint64_t walks;
+  uint64_t walk_reads;  // PTEs read by the page walker
+  uint64_t walk_cycles;
+  uint64_t cycles;      // everything translation added to the accesses
+} TlbStats;
+
+// Reads one PTE through the cache hierarchy, returns its latency
+typedef int (*tlb_walk_fn)(void *ctx, unsigned long long pte_addr);
+
+/* Sv32 translation in front of the caches. The emulator only knows physical
+ * addresses, so the program is taken to be identity mapped by a page table at
+ * pageTable: the root table first, then one leaf table per 4 MiB region. Only
+ * the timing is modelled. The L1 TLBs are looked up in parallel with the L1
+ * caches and cost nothing on a hit; a miss asks the shared L2 TLB, and a miss
+ * there walks the page table, one PTE read per level.
+ * Each TLB is a Cache whose blocks are pages.
+ */
+typedef struct {
+  TlbParams params;
+  Cache itlb;
+  Cache dtlb;
+  Cache l2;
+  int pageBits;
+  TlbStats stats;
+} Tlb;
+
+void tlbDefaultParams(TlbParams *params);
+void tlbSetUp(Tlb *t, const TlbParams *params);
+void tlbDeallocate(Tlb *t);
+int tlbTranslate(Tlb *t, unsigned long long vaddr, bool instr, tlb_walk_fn walk, void *ctx);
+void printTlbSummary(const Tlb *t);
+
+#endif // TLB_H
@@ -0,0 +1,173 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "hierarchy.h"
+#include "trace.h"
+
+#define TRACE_INITIAL 4096
+
+void traceSetUp(AccessTrace *trace) {
+  trace->count = 0;
+  trace->capacity = TRACE_INITIAL;
+  trace->accesses = malloc(trace->capacity * sizeof(TraceAccess));
+}
+
+void traceDeallocate(AccessTrace *trace) {
+  free(trace->accesses);
+  trace->accesses = NULL;
+  trace->count = trace->capacity = 0;
+}
+
+void traceAppend(AccessTrace *trace, unsigned long long address, unsigned long long pc, uint64_t cycle, int type) {
+  if (trace->count == trace->capacity) {
+    trace->capacity *= 2;
+    trace->accesses = realloc(trace->accesses, trace->capacity * sizeof(TraceAccess));
+    if (trace->accesses == NULL) {
+      fprintf(stderr, "Error - out of memory for the access trace\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  trace->accesses[trace->count++] = (TraceAccess){.address = address, .pc = pc, .cycle = cycle, .type = type};
+}
+
+// Map the whole trace file, returns 0 on success, -1 (after printing why) on error
+int traceOpen(TraceReader *reader, const char *path) {
+  struct stat st;
+  int fd = open(path, O_RDONLY);
+
+  memset(reader, 0, sizeof(*reader));
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    fprintf(stderr, "Error - cannot open trace %s\n", path);
+    if (fd >= 0)
+      close(fd);
+    return -1;
+  }
+  reader->size = st.st_size;
+  if (reader->size > 0) {
+    void *data = mmap(NULL, reader->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      fprintf(stderr, "Error - cannot map trace %s\n", path);
+      close(fd);
+      return -1;
+    }
+    madvise(data, reader->size, MADV_SEQUENTIAL);
+    reader->data = data;
+  }
+  close(fd); // the mapping stays valid
+  reader->pos = reader->data;
+  reader->end = reader->data + reader->size;
+
+  reader->binary = reader->size >= TRACE_MAGIC_LEN && memcmp(reader->data, TRACE_MAGIC, TRACE_MAGIC_LEN) == 0;
+  if (reader->binary) {
+    if ((reader->size - TRACE_MAGIC_LEN) % sizeof(uint64_t) != 0) {
+      fprintf(stderr, "Error - binary trace %s is truncated\n", path);
+      traceClose(reader);
+      return -1;
+    }
+    reader->pos += TRACE_MAGIC_LEN;
+  }
+  return 0;
+}
+
+void traceClose(TraceReader *reader) {
+  if (reader->data != NULL)
+    munmap((void *)reader->data, reader->size);
+  reader->data = reader->pos = reader->end = NULL;
+}
+
+static inline int hex_digit(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+// Skip to the start of the next line
+static inline const char *next_line(const char *p, const char *end) {
+  const char *nl = memchr(p, '\n', end - p);
+  return nl != NULL ? nl + 1 : end;
+}
+
+// Parse one lackey line in place, false for lines that are not accesses
+static bool parse_lackey(const char *p, const char *end, TraceAccess *access, bool *modify) {
+  while (p < end && *p == ' ')
+    p++;
+  if (p == end)
+    return false;
+
+  char op = *p++;
+  if ((op != 'I' && op != 'L' && op != 'S' && op != 'M') || p == end || *p != ' ')
+    return false;
+  while (p < end && *p == ' ')
+    p++;
+
+  unsigned long long address = 0;
+  int digits = 0, d;
+  while (p < end && (d = hex_digit(*p)) >= 0) {
+    address = (address << 4) | d;
+    p++;
+    digits++;
+  }
+  if (digits == 0 || p == end || *p != ',')
+    return false;
+
+  access->address = address;
+  access->type = op == 'I' ? ACCESS_FETCH : op == 'S' ? ACCESS_STORE : ACCESS_LOAD;
+  *modify = (op == 'M');
+  return true;
+}
+
+/* Return the next access of the trace in *access, false at the end. Lackey has
+ * no PCs, so pc is 0, and the cycle is the position in the trace.
+ */
+bool traceNext(TraceReader *reader, TraceAccess *access) {
+  access->pc = 0;
+  access->cycle = reader->count;
+
+  if (reader->pendingStore) {
+    reader->pendingStore = false;
+    access->address = reader->pendingAddress;
+    access->type = ACCESS_STORE;
+    reader->count++;
+    return true;
+  }
+
+  if (reader->binary) {
+    if (reader->pos == reader->end)
+      return false;
+    uint64_t word;
+    memcpy(&word, reader->pos, sizeof(word));
+    reader->pos += sizeof(word);
+    access->address = word & TRACE_ADDR_MASK;
+    access->type = (int)(word >> (64 - TRACE_TYPE_BITS));
+    if (access->type == TRACE_MODIFY) {
+      access->type = ACCESS_LOAD;
+      reader->pendingStore = true;
+      reader->pendingAddress = access->address;
+    }
+    reader->count++;
+    return true;
+  }
+
+  while (reader->pos < reader->end) {
+    const char *line = reader->pos;
+    bool modify;
+    reader->pos = next_line(line, reader->end);
+    if (parse_lackey(line, reader->pos, access, &modify)) {
+      if (modify) {
+        reader->pendingStore = true;
+        reader->pendingAddress = access->address;
+      }
+      reader->count++;
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,59 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// One access made to the cache hierarchy
+typedef struct {
+  unsigned long long address;
+  unsigned long long pc;
+  uint64_t cycle;
+  int type; // ACCESS_LOAD, ACCESS_STORE or ACCESS_FETCH (hierarchy.h)
+} TraceAccess;
+
+// Growable in-memory list of accesses, captured once and replayed many times
+typedef struct {
+  TraceAccess *accesses;
+  size_t count;
+  size_t capacity;
+} AccessTrace;
+
+/* Trace files read by cachesim.
+ * Text: valgrind --tool=lackey --trace-mem=yes output, one "I|L|S|M addr,size"
+ * per line; other lines are skipped and M (modify) is a load then a store.
+ * Binary: TRACE_MAGIC, then one little-endian 64-bit word per access with the
+ * access type in the top TRACE_TYPE_BITS bits and the address below them.
+ */
+#define TRACE_MAGIC "RVCTRACE"
+#define TRACE_MAGIC_LEN 8
+#define TRACE_TYPE_BITS 2
+#define TRACE_ADDR_MASK ((1ULL << (64 - TRACE_TYPE_BITS)) - 1)
+#define TRACE_MODIFY 3 // binary type of a load followed by a store, next to the ACCESS_* values
+
+static inline uint64_t traceEncode(unsigned long long address, int type) {
+  return ((uint64_t)type << (64 - TRACE_TYPE_BITS)) | (address & TRACE_ADDR_MASK);
+}
+
+// Sequential reader over a memory-mapped trace file, parsed in place
+typedef struct {
+  const char *data; // whole file, mapped read-only
+  size_t size;
+  const char *pos;
+  const char *end;
+  bool binary;
+  bool pendingStore;  // second half of a lackey M line
+  unsigned long long pendingAddress;
+  uint64_t count;     // accesses returned so far, used as the access time
+} TraceReader;
+
+int traceOpen(TraceReader *reader, const char *path);
+bool traceNext(TraceReader *reader, TraceAccess *access);
+void traceClose(TraceReader *reader);
+
+void traceSetUp(AccessTrace *trace);
+void traceDeallocate(AccessTrace *trace);
+void traceAppend(AccessTrace *trace, unsigned long long address, unsigned long long pc, uint64_t cycle, int type);
+
+#endif // TRACE_H
@@ -40,6 +40,7 @@ Instruction parse_instruction(uint32_t instruction_bits) {
     
   // R-Type
   case 0x33:
+  case 0x2F: // RV32A, funct7 holds funct5 and the aq/rl bits
     // instruction: 0000 0001 0101 1010 0000 0100 1, destination : 01001
     instruction.rtype.rd = instruction_bits & ((1U << 5) - 1);
     instruction_bits >>= 5;
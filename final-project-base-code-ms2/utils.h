@@ -10,6 +10,8 @@
 #define JAL_FORMAT "jal\tx%d, %d\n"
 #define BRANCH_FORMAT "%s\tx%d, x%d, %d\n"
 #define ECALL_FORMAT "ecall\n"
+#define LR_FORMAT "lr.w\tx%d, (x%d)\n"
+#define AMO_FORMAT "%s\tx%d, x%d, (x%d)\n"
 #define CACHE_EVICTION_FORMAT "[MEM]: Cache eviction for address: 0x%.8llx\n"
 #define CACHE_HIT_FORMAT "[MEM]: Cache hit for address: 0x%.8llx\n"
 #define CACHE_MISS_FORMAT "[MEM]: Cache miss for address: 0x%.8llx\n"